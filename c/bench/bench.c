@@ -0,0 +1,729 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+/**
+ * @file bench.c
+ * @brief Microbenchmarks of the protocol layer.
+ *
+ * The library talks to a backend: by default a responder thread on a pseudo
+ * terminal, the simulated module in memory, or any port the library can open
+ * (a real module, evifluor-sim, evifluor-ptysim). The whole path from framing
+ * to decoding is exercised. The transport is wrapped to count commands and
+ * round trips, heap allocations are counted by wrapping the allocator of the
+ * C library.
+ */
+
+#define _GNU_SOURCE
+#include "evibase.h"
+#include "evifluor.h"
+#include "commonindex.h"
+#include "evifluorindex.h"
+#include "evitransport.h"
+#include "crc-16-ccitt.h"
+#include "simdevice.h"
+#include "cJSON.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define VERSION_BENCH "0.2.0"
+#define BENCH_ITERATIONS_DEFAULT 1000
+#define BENCH_CRC_BYTES (64u * 1024u * 1024u)
+
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCATIONS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static atomic_ulong allocations;
+
+void *malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+#endif
+
+typedef struct
+{
+    int master;
+    volatile bool stop;
+} Responder_t;
+
+// Counts what crosses the transport of the session
+typedef struct
+{
+    const EviTransport_t *inner;
+    void *innerUser;
+    unsigned long commands;
+    unsigned long roundTrips;
+    unsigned long bytesOut;
+    unsigned long bytesIn;
+} BenchCounter_t;
+
+typedef struct
+{
+    BenchCounter_t *counter;
+    void *connection;
+    bool receivedLast;
+} CountingConnection_t;
+
+typedef Error_t (*BenchOperation_t)(Evi_t *evi);
+
+typedef struct
+{
+    const char *name;
+    BenchOperation_t execute;
+} BenchCase_t;
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static unsigned long allocationCount()
+{
+#ifdef BENCH_COUNT_ALLOCATIONS
+    return atomic_load_explicit(&allocations, memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+static size_t responderAnswer(const char *line, char *reply, size_t size)
+{
+    // line is the frame without stop character, e.g. ":V 0"
+    char command = line[1];
+    switch (command)
+    {
+    case 'V':
+        // "V index" reads, "V index value" writes
+        return snprintf(reply, size, strchr(line + 3, ' ') ? ":V\n" : ":V 42\n");
+    case 'M':
+        return snprintf(reply, size, ":M 12.345 2345.678 128 0 0 0\n");
+    default:
+        return snprintf(reply, size, ":E %d\n", ERROR_EVI_UNKNOWN_COMMAND);
+    }
+}
+
+static void *responderRun(void *arg)
+{
+    Responder_t *responder = (Responder_t *)arg;
+    char line[EVI_MAX_LINE_LENGTH];
+    char reply[EVI_MAX_LINE_LENGTH];
+    size_t length = 0;
+
+    while (!responder->stop)
+    {
+        char c;
+        ssize_t n = read(responder->master, &c, 1);
+        if (n <= 0)
+        {
+            continue;
+        }
+        if (c == EVI_STOP1)
+        {
+            line[length] = '\0';
+            if (length > 1)
+            {
+                size_t replyLength = responderAnswer(line, reply, sizeof(reply));
+                if (write(responder->master, reply, replyLength) != (ssize_t)replyLength)
+                {
+                    break;
+                }
+            }
+            length = 0;
+        }
+        else if (c != EVI_STOP2 && length < sizeof(line) - 1)
+        {
+            line[length++] = c;
+        }
+    }
+    return 0;
+}
+
+static bool responderStart(Responder_t *responder, pthread_t *thread, char *portName, size_t portNameSize)
+{
+    struct termios options;
+
+    responder->stop = false;
+    responder->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (responder->master == -1 || grantpt(responder->master) != 0 || unlockpt(responder->master) != 0)
+    {
+        return false;
+    }
+
+    // No echo and no line discipline, the pty behaves like a CDC port
+    tcgetattr(responder->master, &options);
+    cfmakeraw(&options);
+    options.c_cc[VMIN] = 0;
+    options.c_cc[VTIME] = 1;
+    tcsetattr(responder->master, TCSANOW, &options);
+
+    if (ptsname_r(responder->master, portName, portNameSize) != 0)
+    {
+        return false;
+    }
+    return pthread_create(thread, 0, responderRun, responder) == 0;
+}
+
+static void responderStop(Responder_t *responder, pthread_t thread)
+{
+    responder->stop = true;
+    pthread_join(thread, 0);
+    close(responder->master);
+}
+
+static void *countingOpen(const char *port, void *user, bool verbose)
+{
+    BenchCounter_t *counter = (BenchCounter_t *)user;
+    void *connection = counter->inner->open(port, counter->innerUser, verbose);
+    CountingConnection_t *c;
+
+    if (connection == NULL)
+    {
+        return NULL;
+    }
+    c = (CountingConnection_t *)calloc(1, sizeof(CountingConnection_t));
+    if (c == NULL)
+    {
+        counter->inner->close(connection);
+        return NULL;
+    }
+    c->counter = counter;
+    c->connection = connection;
+    c->receivedLast = true;
+    return c;
+}
+
+static void countingClose(void *connection)
+{
+    CountingConnection_t *c = (CountingConnection_t *)connection;
+    c->counter->inner->close(c->connection);
+    free(c);
+}
+
+static bool countingWrite(void *connection, const char *data, size_t size)
+{
+    CountingConnection_t *c = (CountingConnection_t *)connection;
+
+    // Commands written back to back before the next reply share one round trip
+    if (c->receivedLast)
+    {
+        c->counter->roundTrips++;
+        c->receivedLast = false;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        c->counter->commands += data[i] == EVI_STOP1;
+    }
+    c->counter->bytesOut += size;
+    return c->counter->inner->write(c->connection, data, size);
+}
+
+static int countingPoll(void *connection, uint32_t timeoutMs)
+{
+    CountingConnection_t *c = (CountingConnection_t *)connection;
+    return c->counter->inner->poll(c->connection, timeoutMs);
+}
+
+static int countingRead(void *connection, char *data, size_t size)
+{
+    CountingConnection_t *c = (CountingConnection_t *)connection;
+    int n = c->counter->inner->read(c->connection, data, size);
+    if (n > 0)
+    {
+        c->receivedLast = true;
+        c->counter->bytesIn += (unsigned long)n;
+    }
+    return n;
+}
+
+static bool countingSerialNumber(void *connection, char *serialNumber, size_t size)
+{
+    CountingConnection_t *c = (CountingConnection_t *)connection;
+    return c->counter->inner->serialNumber(c->connection, serialNumber, size);
+}
+
+// The simulated module answers in the calling thread, latencies are skipped
+static size_t memoryRespond(const char *request, size_t length, char *reply, size_t replySize, void *user)
+{
+    SimDevice_t *device = (SimDevice_t *)user;
+    char line[SIM_MAX_LINE_LENGTH];
+    size_t total = 0;
+    size_t n = 0;
+
+    // A pipelined write holds several frames
+    for (size_t i = 0; i < length; i++)
+    {
+        if (request[i] != EVI_STOP1 && request[i] != EVI_STOP2)
+        {
+            if (n < sizeof(line) - 1)
+            {
+                line[n++] = request[i];
+            }
+            continue;
+        }
+        if (n > 0)
+        {
+            size_t replyLength;
+            uint32_t delayMs;
+            line[n] = '\0';
+            if (simDeviceExecute(device, line, reply + total, replySize - total, &replyLength, &delayMs) == SIM_REPLY)
+            {
+                total += replyLength;
+            }
+        }
+        n = 0;
+    }
+    return total;
+}
+
+static Error_t benchCommand(Evi_t *evi)
+{
+    EvieResponse_t response;
+    return eviCommand(evi, "V 0", &response);
+}
+
+static Error_t benchGet(Evi_t *evi)
+{
+    char value[EVI_MAX_VALUE_LENGTH];
+    return eviGet(evi, INDEX_VERSION, value, sizeof(value));
+}
+
+static Error_t benchSet(Evi_t *evi)
+{
+    return eviSet(evi, INDEX_CURRENT_LED470_POWER, "128");
+}
+
+static Error_t benchMeasure(Evi_t *evi)
+{
+    SingleMeasurement_t measurement;
+    return eviFluorMeasure(evi, &measurement);
+}
+
+static Error_t benchFirstAir(Evi_t *evi)
+{
+    MeasurementFirstAir_t measurement;
+    return eviFluorMeasureFirstAir(evi, &measurement);
+}
+
+static const BenchCase_t benchCases[] = {
+    {"command", benchCommand},
+    {"get", benchGet},
+    {"set", benchSet},
+    {"measure", benchMeasure},
+    {"firstair", benchFirstAir},
+};
+
+// The nibble-wise implementation of library versions up to 0.2, the reference for the table
+static crc_t crcNibbleUpdate(crc_t crc, const void *data, size_t length)
+{
+    static const crc_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+    };
+    const unsigned char *d = (const unsigned char *)data;
+
+    while (length--)
+    {
+        crc = table[((crc >> 12) ^ (*d >> 4)) & 0x0f] ^ (crc << 4);
+        crc = table[((crc >> 12) ^ (*d >> 0)) & 0x0f] ^ (crc << 4);
+        d++;
+    }
+    return crc & 0xffff;
+}
+
+typedef struct
+{
+    const char *data;
+    crc_t crc;
+} CrcVector_t;
+
+static const CrcVector_t crcVectors[] = {
+    {"", 0x1d0f},
+    {"A", 0x9479},
+    {"123456789", 0xe5cc},
+    {"V 0", 0xcdd7},
+    {"M 12.345 2345.678 128 0 0 0", 0x7112},
+};
+
+static double crcThroughput(crc_t (*update)(crc_t, const void *, size_t), const unsigned char *data, size_t length, crc_t *crc)
+{
+    uint64_t start = nowNs();
+    *crc = crc_init();
+    for (size_t done = 0; done < BENCH_CRC_BYTES; done += length)
+    {
+        *crc = update(*crc, data, length);
+    }
+    return BENCH_CRC_BYTES / 1e6 / ((nowNs() - start) / 1e9);
+}
+
+// Test vectors, agreement with the reference for any split of the data, and throughput
+static cJSON *benchCrc(bool *passed)
+{
+    unsigned char data[EVI_MAX_LINE_LENGTH];
+    uint64_t random = 88172645463325252ull;
+    crc_t crcTable;
+    crc_t crcNibble;
+
+    cJSON *result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "name", "crc");
+    *passed = true;
+    cJSON *vectors = cJSON_AddArrayToObject(result, "vectors");
+    for (size_t i = 0; i < sizeof(crcVectors) / sizeof(crcVectors[0]); i++)
+    {
+        size_t length = strlen(crcVectors[i].data);
+        crc_t crc = crc_finalize(crc_update(crc_init(), crcVectors[i].data, length));
+        crc_t crcBytes = crc_init();
+        for (size_t j = 0; j < length; j++)
+        {
+            crcBytes = crc_update_byte(crcBytes, (unsigned char)crcVectors[i].data[j]);
+        }
+        bool ok = crc == crcVectors[i].crc && crcBytes == crcVectors[i].crc &&
+                  crcNibbleUpdate(crc_init(), crcVectors[i].data, length) == crcVectors[i].crc;
+        cJSON *vector = cJSON_CreateObject();
+        cJSON_AddStringToObject(vector, "data", crcVectors[i].data);
+        cJSON_AddNumberToObject(vector, "crc", (double)crc);
+        cJSON_AddBoolToObject(vector, "ok", ok);
+        cJSON_AddItemToArray(vectors, vector);
+        *passed = *passed && ok;
+    }
+
+    for (uint32_t i = 0; i < 10000 && *passed; i++)
+    {
+        size_t length;
+        size_t split;
+        for (size_t j = 0; j < sizeof(data); j++)
+        {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            data[j] = (unsigned char)random;
+        }
+        length = (size_t)(random % sizeof(data));
+        split = length > 0 ? (size_t)((random >> 16) % length) : 0;
+        crcTable = crc_update(crc_update(crc_init(), data, split), data + split, length - split);
+        *passed = crcTable == crcNibbleUpdate(crc_init(), data, length);
+    }
+    cJSON_AddBoolToObject(result, "passed", *passed);
+
+    // Throughput on frames of typical length
+    double tableMBps = crcThroughput(crc_update, data, 32, &crcTable);
+    double nibbleMBps = crcThroughput(crcNibbleUpdate, data, 32, &crcNibble);
+    cJSON_AddNumberToObject(result, "tableMBps", tableMBps);
+    cJSON_AddNumberToObject(result, "nibbleMBps", nibbleMBps);
+    cJSON_AddNumberToObject(result, "nsPerFrame32", 32 * 1e3 / tableMBps);
+    cJSON_AddBoolToObject(result, "sameResult", crcTable == crcNibble);
+    return result;
+}
+
+static int compareUInt64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentileUs(const uint64_t *sorted, uint32_t count, uint32_t percent)
+{
+    uint32_t rank = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+    return (double)sorted[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+static cJSON *benchRun(Evi_t *evi, BenchCounter_t *counter, const BenchCase_t *benchCase, uint32_t iterations)
+{
+    uint64_t *latencies = (uint64_t *)malloc(sizeof(uint64_t) * iterations);
+    uint32_t done = 0;
+
+    // The first call opens the session, it is not part of the measurement
+    Error_t ret = benchCase->execute(evi);
+
+    BenchCounter_t countStart = *counter;
+    unsigned long allocationsStart = allocationCount();
+    uint64_t start = nowNs();
+    for (; done < iterations && ret == ERROR_EVI_OK; done++)
+    {
+        uint64_t begin = nowNs();
+        ret = benchCase->execute(evi);
+        latencies[done] = nowNs() - begin;
+    }
+    uint64_t elapsed = nowNs() - start;
+    unsigned long allocated = allocationCount() - allocationsStart;
+    unsigned long commands = counter->commands - countStart.commands;
+    unsigned long roundTrips = counter->roundTrips - countStart.roundTrips;
+
+    cJSON *result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "name", benchCase->name);
+    cJSON_AddStringToObject(result, "result", eviError2String(ret));
+    cJSON_AddNumberToObject(result, "iterations", done);
+    if (done > 0)
+    {
+        qsort(latencies, done, sizeof(uint64_t), compareUInt64);
+        cJSON_AddNumberToObject(result, "commandsPerOp", (double)commands / done);
+        cJSON_AddNumberToObject(result, "roundTripsPerOp", (double)roundTrips / done);
+        cJSON_AddNumberToObject(result, "bytesPerOp", (double)(counter->bytesOut - countStart.bytesOut + counter->bytesIn - countStart.bytesIn) / done);
+        cJSON *latency = cJSON_AddObjectToObject(result, "latencyUs");
+        cJSON_AddNumberToObject(latency, "mean", (double)elapsed / 1000.0 / done);
+        cJSON_AddNumberToObject(latency, "p50", percentileUs(latencies, done, 50));
+        cJSON_AddNumberToObject(latency, "p95", percentileUs(latencies, done, 95));
+        cJSON_AddNumberToObject(latency, "p99", percentileUs(latencies, done, 99));
+        cJSON_AddNumberToObject(latency, "max", (double)latencies[done - 1] / 1000.0);
+        cJSON_AddNumberToObject(result, "opsPerSecond", done * 1e9 / (double)elapsed);
+        cJSON_AddNumberToObject(result, "commandsPerSecond", commands * 1e9 / (double)elapsed);
+        cJSON_AddNumberToObject(result, "usPerCommand", commands > 0 ? (double)elapsed / 1000.0 / commands : 0);
+#ifdef BENCH_COUNT_ALLOCATIONS
+        cJSON_AddNumberToObject(result, "allocsPerOp", (double)allocated / done);
+        cJSON_AddNumberToObject(result, "allocsPerCommand", commands > 0 ? (double)allocated / commands : 0);
+#else
+        (void)allocated;
+        cJSON_AddNullToObject(result, "allocsPerOp");
+        cJSON_AddNullToObject(result, "allocsPerCommand");
+#endif
+    }
+    free(latencies);
+    return result;
+}
+
+static const BenchCase_t *benchCaseByName(const char *name, size_t length)
+{
+    for (size_t i = 0; i < sizeof(benchCases) / sizeof(benchCases[0]); i++)
+    {
+        if (strlen(benchCases[i].name) == length && strncmp(benchCases[i].name, name, length) == 0)
+        {
+            return &benchCases[i];
+        }
+    }
+    return NULL;
+}
+
+static void usage()
+{
+    fprintf(stdout, "evifluor-bench %s\n", VERSION_BENCH);
+    fprintf(stdout, "Usage: evifluor-bench [--backend pty|memory] [--device PORT] [--transport NAME]\n");
+    fprintf(stdout, "                      [--operations LIST] [--iterations N] [--use-checksum] [--verbose]\n");
+    fprintf(stdout, "                      [DEVICE OPTIONS]\n");
+    fprintf(stdout, "       evifluor-bench --crc\n");
+    fprintf(stdout, "  Runs the protocol benchmarks and prints round trips, latency percentiles,\n");
+    fprintf(stdout, "  throughput and heap allocations per operation as JSON.\n\n");
+    fprintf(stdout, "  --backend pty       : built-in responder thread on a pseudo terminal (default)\n");
+    fprintf(stdout, "  --backend memory    : simulated module in the same thread, no system calls\n");
+    fprintf(stdout, "  --device PORT       : any port of the library, e.g. /dev/ttyACM0, SIMULATION,\n");
+    fprintf(stdout, "                        tcp:HOST:PORT or the terminal of evifluor-ptysim\n");
+    fprintf(stdout, "  --transport NAME    : tty, tcp or usb for --device\n");
+    fprintf(stdout, "  --operations LIST   : comma separated subset of command,get,set,measure,firstair\n");
+    fprintf(stdout, "  --iterations N      : calls per operation (default %d)\n", BENCH_ITERATIONS_DEFAULT);
+    fprintf(stdout, "  --crc               : checks the CRC against test vectors and the previous\n");
+    fprintf(stdout, "                        implementation and measures its throughput\n\n");
+    fprintf(stdout, "  The device options of evifluor-sim configure the memory backend, e.g. --error 0.01.\n");
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = BENCH_ITERATIONS_DEFAULT;
+    Evi_t evi = {0};
+    char portName[EVI_MAX_PORT_NAME_LENGTH];
+    const char *backend = "pty";
+    const char *device = NULL;
+    const char *operations = NULL;
+    const EviTransport_t *transport = NULL;
+    Responder_t responder;
+    pthread_t thread;
+    SimConfig_t simConfig;
+    SimDevice_t simDevice;
+    EviMemoryDevice_t memoryDevice = {.respond = memoryRespond, .user = &simDevice};
+    BenchCounter_t counter = {0};
+    EviTransport_t counting = {
+        .name   = "counting",
+        .open   = countingOpen,
+        .close  = countingClose,
+        .write  = countingWrite,
+        .poll   = countingPoll,
+        .read   = countingRead,
+    };
+
+    simConfigDefaults(&simConfig);
+    for (int i = 1; i < argc; i++)
+    {
+        int consumed;
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            char *endptr;
+            iterations = strtoul(argv[++i], &endptr, 10);
+            if (*endptr != '\0' || iterations == 0)
+            {
+                usage();
+                return ERROR_EVI_INVALID_NUMBER;
+            }
+        }
+        else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc)
+        {
+            backend = argv[++i];
+            if (strcmp(backend, "pty") != 0 && strcmp(backend, "memory") != 0)
+            {
+                usage();
+                return ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT;
+            }
+        }
+        else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+        {
+            device = argv[++i];
+        }
+        else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc)
+        {
+            transport = eviTransportByName(argv[++i]);
+            if (transport == NULL)
+            {
+                fprintf(stderr, "Unknown transport: %s\n", argv[i]);
+                return ERROR_EVI_INVALID_PARAMETER;
+            }
+        }
+        else if (strcmp(argv[i], "--operations") == 0 && i + 1 < argc)
+        {
+            operations = argv[++i];
+        }
+        else if (strcmp(argv[i], "--crc") == 0)
+        {
+            bool passed;
+            cJSON *report = benchCrc(&passed);
+            char *json = cJSON_Print(report);
+            fprintf(stdout, "%s\n", json);
+            cJSON_free(json);
+            cJSON_Delete(report);
+            return passed ? ERROR_EVI_OK : ERROR_EVI_PROTOCOL_ERROR;
+        }
+        else if (strcmp(argv[i], "--use-checksum") == 0)
+        {
+            evi.useChecksum = true;
+        }
+        else if (strcmp(argv[i], "--verbose") == 0)
+        {
+            evi.verbose = true;
+        }
+        else if ((consumed = simConfigOption(&simConfig, argc - i, argv + i)) > 0)
+        {
+            i += consumed - 1;
+        }
+        else
+        {
+            usage();
+            return ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT;
+        }
+    }
+
+    // Select the backend, the counting transport sits between the session and it
+    if (device != NULL)
+    {
+        const char *port;
+        counter.inner = transport ? transport : eviTransportForPort(device, &port);
+        if (transport)
+        {
+            size_t n = strlen(transport->name);
+            port = (strncmp(device, transport->name, n) == 0 && device[n] == ':') ? device + n + 1 : device;
+        }
+        strcpy_s(portName, sizeof(portName), port);
+        backend = counter.inner->name;
+    }
+    else if (strcmp(backend, "memory") == 0)
+    {
+        simConfig.timeScale = 0;
+        simDeviceInit(&simDevice, &simConfig);
+        counter.inner = &eviTransportMemory;
+        counter.innerUser = &memoryDevice;
+        portName[0] = '\0';
+    }
+    else
+    {
+        if (!responderStart(&responder, &thread, portName, sizeof(portName)))
+        {
+            fprintf(stderr, "Could not create pseudo terminal\n");
+            return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+        }
+        counter.inner = &eviTransportTty;
+    }
+    counting.discover = counter.inner->discover;
+    counting.serialNumber = counter.inner->serialNumber ? countingSerialNumber : NULL;
+    evi.transport = &counting;
+    evi.transportUser = &counter;
+    evi.portName = portName;
+
+    cJSON *report = cJSON_CreateObject();
+    cJSON_AddStringToObject(report, "library", eviVersion());
+    cJSON_AddStringToObject(report, "backend", backend);
+    if (device != NULL)
+    {
+        cJSON_AddStringToObject(report, "device", device);
+    }
+    cJSON_AddBoolToObject(report, "checksum", evi.useChecksum);
+    cJSON *results = cJSON_AddArrayToObject(report, "results");
+    if (operations == NULL)
+    {
+        for (size_t i = 0; i < sizeof(benchCases) / sizeof(benchCases[0]); i++)
+        {
+            cJSON_AddItemToArray(results, benchRun(&evi, &counter, &benchCases[i], iterations));
+        }
+    }
+    else
+    {
+        for (const char *name = operations; *name != '\0';)
+        {
+            size_t length = strcspn(name, ",");
+            const BenchCase_t *benchCase = benchCaseByName(name, length);
+            if (benchCase == NULL)
+            {
+                fprintf(stderr, "Unknown operation: %.*s\n", (int)length, name);
+                cJSON_Delete(report);
+                eviClose(&evi);
+                return ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT;
+            }
+            cJSON_AddItemToArray(results, benchRun(&evi, &counter, benchCase, iterations));
+            name += length;
+            name += *name == ',';
+        }
+    }
+
+    eviClose(&evi);
+    if (device == NULL && strcmp(backend, "memory") == 0)
+    {
+        simDeviceDestroy(&simDevice);
+    }
+    else if (device == NULL)
+    {
+        responderStop(&responder, thread);
+    }
+
+    char *json = cJSON_Print(report);
+    fprintf(stdout, "%s\n", json);
+    cJSON_free(json);
+    cJSON_Delete(report);
+    return ERROR_EVI_OK;
+}
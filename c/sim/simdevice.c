@@ -0,0 +1,716 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "simdevice.h"
+#include "crc-16-ccitt.h"
+#include "commonerror.h"
+#include "commonindex.h"
+#include "evifluorindex.h"
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *const loggingLines[] = {
+    "\"simulator started\"",
+    "\"selftest passed\"",
+};
+
+static const SimCurvePoint_t defaultCurve[] = {
+    {0, 0}, {100, 420}, {200, 800}, {400, 1460}, {600, 1980}, {800, 2360}, {1000, 2600},
+};
+
+void simConfigDefaults(SimConfig_t *config)
+{
+    memset(config, 0, sizeof(SimConfig_t));
+    config->latencyMs['V' - 'A'] = 2;
+    config->latencyMs['Q' - 'A'] = 2;
+    config->latencyMs['M' - 'A'] = 300;
+    config->latencyMs['X' - 'A'] = 300;
+    config->latencyMs['G' - 'A'] = 500;
+    config->latencyMs['Y' - 'A'] = 1500;
+    config->latencyMs['C' - 'A'] = 2000;
+    config->latencyMs['F' - 'A'] = 1000;
+    config->latencyMs['S' - 'A'] = 5;
+    config->latencyMs['R' - 'A'] = 100;
+    config->rebootMs     = 2000;
+    config->timeScale    = 1.0;
+    config->dark         = 12.0;
+    config->darkNoise    = 0.5;
+    config->valueNoise   = 0.005;
+    config->sample       = 1.0;
+    config->cuvetteEmpty = true;
+    config->curvePoints  = sizeof(defaultCurve) / sizeof(defaultCurve[0]);
+    memcpy(config->curve, defaultCurve, sizeof(defaultCurve));
+    config->seed         = 1;
+}
+
+static bool parseDouble(const char *s, double *value)
+{
+    char *end;
+    errno = 0;
+    *value = strtod(s, &end);
+    return end != s && *end == '\0' && errno == 0;
+}
+
+static bool parseProbability(const char *s, double *value)
+{
+    return parseDouble(s, value) && *value >= 0 && *value <= 1;
+}
+
+static bool parseUInt32(const char *s, uint32_t *value)
+{
+    char *end;
+    unsigned long v;
+    errno = 0;
+    v = strtoul(s, &end, 10);
+    *value = (uint32_t)v;
+    return end != s && *end == '\0' && errno == 0 && v <= UINT32_MAX && s[0] != '-';
+}
+
+static bool parseCurve(SimConfig_t *config, const char *s)
+{
+    char buffer[SIM_MAX_LINE_LENGTH];
+    char *save = NULL;
+    size_t n = 0;
+
+    snprintf(buffer, sizeof(buffer), "%s", s);
+    for (char *point = strtok_r(buffer, ",", &save); point != NULL; point = strtok_r(NULL, ",", &save))
+    {
+        char *separator = strchr(point, ':');
+        if (separator == NULL || n >= SIM_MAX_CURVE_POINTS)
+        {
+            return false;
+        }
+        *separator = 0;
+        if (!parseDouble(point, &config->curve[n].ledPower) || !parseDouble(separator + 1, &config->curve[n].signal) ||
+            (n > 0 && config->curve[n].ledPower <= config->curve[n - 1].ledPower))
+        {
+            return false;
+        }
+        n++;
+    }
+    config->curvePoints = n;
+    return n >= 2;
+}
+
+int simConfigOption(SimConfig_t *config, int argc, char **argv)
+{
+    const char *option = argv[0];
+    const char *value = argc > 1 ? argv[1] : NULL;
+
+    if (strcmp(option, "--verbose") == 0)
+    {
+        config->verbose = true;
+        return 1;
+    }
+    if (strcmp(option, "--not-empty") == 0)
+    {
+        config->cuvetteEmpty = false;
+        return 1;
+    }
+    if (value == NULL)
+    {
+        return 0;
+    }
+
+    if (strcmp(option, "--latency") == 0)
+    {
+        uint32_t ms;
+        if (!isupper((unsigned char)value[0]) || value[1] != '=' || !parseUInt32(value + 2, &ms))
+        {
+            return -1;
+        }
+        config->latencyMs[value[0] - 'A'] = ms;
+    }
+    else if (strcmp(option, "--jitter") == 0)
+    {
+        if (!parseUInt32(value, &config->jitterMs))
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--time-scale") == 0)
+    {
+        if (!parseDouble(value, &config->timeScale) || config->timeScale < 0)
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--dark") == 0)
+    {
+        if (!parseDouble(value, &config->dark))
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--dark-noise") == 0)
+    {
+        if (!parseDouble(value, &config->darkNoise) || config->darkNoise < 0)
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--value-noise") == 0)
+    {
+        if (!parseDouble(value, &config->valueNoise) || config->valueNoise < 0)
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--sample") == 0)
+    {
+        if (!parseDouble(value, &config->sample) || config->sample < 0)
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--curve") == 0)
+    {
+        if (!parseCurve(config, value))
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--reboot") == 0)
+    {
+        if (!parseUInt32(value, &config->rebootMs))
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--drop") == 0)
+    {
+        if (!parseProbability(value, &config->faults.drop))
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--corrupt") == 0)
+    {
+        if (!parseProbability(value, &config->faults.corrupt))
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--error") == 0)
+    {
+        if (!parseProbability(value, &config->faults.error))
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--disconnect") == 0)
+    {
+        if (!parseProbability(value, &config->faults.disconnect))
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--spike") == 0)
+    {
+        char probability[32];
+        const char *separator = strchr(value, ':');
+        if (separator == NULL || (size_t)(separator - value) >= sizeof(probability))
+        {
+            return -1;
+        }
+        memcpy(probability, value, separator - value);
+        probability[separator - value] = 0;
+        if (!parseProbability(probability, &config->faults.spike) || !parseUInt32(separator + 1, &config->faults.spikeMs))
+        {
+            return -1;
+        }
+    }
+    else if (strcmp(option, "--seed") == 0)
+    {
+        uint32_t seed;
+        if (!parseUInt32(value, &seed))
+        {
+            return -1;
+        }
+        config->seed = seed;
+    }
+    else
+    {
+        return 0;
+    }
+    return 2;
+}
+
+void simConfigHelp(FILE *stream)
+{
+    fprintf(stream, "Device options:\n");
+    fprintf(stream, "  --latency C=MS      : processing time of command letter C, e.g. M=300\n");
+    fprintf(stream, "  --jitter MS         : random extra latency up to MS\n");
+    fprintf(stream, "  --time-scale X      : factor for all latencies, 0 answers immediately (default 1)\n");
+    fprintf(stream, "  --dark D            : mean dark signal (default 12)\n");
+    fprintf(stream, "  --dark-noise SD     : standard deviation of the dark signal (default 0.5)\n");
+    fprintf(stream, "  --value-noise REL   : relative standard deviation of the signal (default 0.005)\n");
+    fprintf(stream, "  --sample F          : fluorescence of the sample, 0 for air (default 1)\n");
+    fprintf(stream, "  --not-empty         : the cuvette holder check X reports a cuvette\n");
+    fprintf(stream, "  --curve P:S,...     : LED power response curve, signal S at LED power P\n");
+    fprintf(stream, "  --reboot MS         : time the module is gone after R (default 2000)\n");
+    fprintf(stream, "  --drop P            : probability that a reply is lost\n");
+    fprintf(stream, "  --corrupt P         : probability that a reply is garbled\n");
+    fprintf(stream, "  --error P           : probability that a command fails with E 2\n");
+    fprintf(stream, "  --disconnect P      : probability that the connection is closed instead of answering\n");
+    fprintf(stream, "  --spike P:MS        : probability of an extra delay of MS\n");
+    fprintf(stream, "  --seed N            : seed of the random numbers (default 1)\n");
+    fprintf(stream, "  --verbose           : prints every command and reply\n");
+}
+
+void simDeviceInit(SimDevice_t *self, const SimConfig_t *config)
+{
+    memset(self, 0, sizeof(SimDevice_t));
+    self->config = *config;
+    self->random = config->seed != 0 ? config->seed : 1;
+    pthread_mutex_init(&self->lock, NULL);
+
+    snprintf(self->values[INDEX_VERSION], SIM_MAX_VALUE_LENGTH, "1.0.0");
+    snprintf(self->values[INDEX_SERIALNUMBER], SIM_MAX_VALUE_LENGTH, "SIM00001");
+    snprintf(self->values[INDEX_PRODUCTIONNUMBER], SIM_MAX_VALUE_LENGTH, "100001");
+    snprintf(self->values[INDEX_QC_MODE], SIM_MAX_VALUE_LENGTH, "0");
+    snprintf(self->values[INDEX_LASTMEASUREMENTCOUNT], SIM_MAX_VALUE_LENGTH, "0");
+    snprintf(self->values[INDEX_AUTOGAIN_DELTA], SIM_MAX_VALUE_LENGTH, "50");
+    snprintf(self->values[INDEX_CUVETTE_EMPTY_DELTA], SIM_MAX_VALUE_LENGTH, "100");
+    snprintf(self->values[INDEX_CUVETTE_EMPTY_LED_POWER], SIM_MAX_VALUE_LENGTH, "100");
+    snprintf(self->values[INDEX_CURRENT_LED470_POWER], SIM_MAX_VALUE_LENGTH, "200");
+    snprintf(self->values[INDEX_CURRENT_LED470_POWER_MIN], SIM_MAX_VALUE_LENGTH, "50");
+    snprintf(self->values[INDEX_CURRENT_LED470_POWER_MAX], SIM_MAX_VALUE_LENGTH, "1000");
+    snprintf(self->values[INDEX_CURRENT_LED625_POWER_MIN], SIM_MAX_VALUE_LENGTH, "50");
+    snprintf(self->values[INDEX_CURRENT_LED625_POWER_MAX], SIM_MAX_VALUE_LENGTH, "1000");
+    snprintf(self->values[INDEX_CURRENT_LED625_POWER], SIM_MAX_VALUE_LENGTH, "200");
+    snprintf(self->values[INDEX_SENSOR_LED], SIM_MAX_VALUE_LENGTH, "0");
+}
+
+void simDeviceDestroy(SimDevice_t *self)
+{
+    pthread_mutex_destroy(&self->lock);
+}
+
+static uint64_t simNowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+uint32_t simDeviceBooting(SimDevice_t *self)
+{
+    uint64_t now = simNowMs();
+    uint32_t remaining;
+
+    pthread_mutex_lock(&self->lock);
+    remaining = self->bootedAtMs > now ? (uint32_t)(self->bootedAtMs - now) : 0;
+    pthread_mutex_unlock(&self->lock);
+    return remaining;
+}
+
+// xorshift64*, good enough for noise and fault decisions and repeatable by seed
+static double simUniform(SimDevice_t *self)
+{
+    self->random ^= self->random >> 12;
+    self->random ^= self->random << 25;
+    self->random ^= self->random >> 27;
+    return (double)((self->random * 0x2545F4914F6CDD1Dull) >> 11) / (double)(1ull << 53);
+}
+
+static double simGauss(SimDevice_t *self, double mean, double sd)
+{
+    if (sd <= 0)
+    {
+        return mean;
+    }
+    double u1 = simUniform(self);
+    double u2 = simUniform(self);
+    if (u1 < 1e-300)
+    {
+        u1 = 1e-300;
+    }
+    return mean + sd * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static bool simChance(SimDevice_t *self, double probability)
+{
+    return probability > 0 && simUniform(self) < probability;
+}
+
+static double simSignal(const SimConfig_t *config, double ledPower)
+{
+    const SimCurvePoint_t *c = config->curve;
+    size_t n = config->curvePoints;
+
+    if (n == 0)
+    {
+        return 0;
+    }
+    if (ledPower <= c[0].ledPower)
+    {
+        return c[0].signal * config->sample;
+    }
+    for (size_t i = 1; i < n; i++)
+    {
+        if (ledPower <= c[i].ledPower)
+        {
+            double t = (ledPower - c[i - 1].ledPower) / (c[i].ledPower - c[i - 1].ledPower);
+            return (c[i - 1].signal + t * (c[i].signal - c[i - 1].signal)) * config->sample;
+        }
+    }
+    return c[n - 1].signal * config->sample;
+}
+
+static uint32_t simLedPower(const SimDevice_t *self)
+{
+    uint32_t ledPower = 0;
+    parseUInt32(self->values[INDEX_CURRENT_LED470_POWER], &ledPower);
+    return ledPower;
+}
+
+static int simMeasure(SimDevice_t *self, char *out, size_t size)
+{
+    double ledPower = simLedPower(self);
+    double dark = simGauss(self, self->config.dark, self->config.darkNoise);
+    double signal = simSignal(&self->config, ledPower);
+    double value = dark + simGauss(self, signal, signal * self->config.valueNoise);
+
+    memmove(self->stored[1], self->stored[0], sizeof(self->stored[0]) * (SIM_MAX_STORED - 1));
+    self->stored[0][0] = dark;
+    self->stored[0][1] = value;
+    self->stored[0][2] = ledPower;
+    if (self->storedCount < SIM_MAX_STORED)
+    {
+        self->storedCount++;
+    }
+    snprintf(self->values[INDEX_LASTMEASUREMENTCOUNT], SIM_MAX_VALUE_LENGTH, "%zu", self->storedCount);
+    return snprintf(out, size, "M %.3f %.3f %u 0 0 0", dark, value, (uint32_t)ledPower);
+}
+
+// Lowest LED power whose signal reaches the level, the firmware steps the LED the same way
+static int simAutogain(SimDevice_t *self, uint32_t level, char *out, size_t size)
+{
+    uint32_t minimum = 0;
+    uint32_t maximum = SIM_LED_POWER_MAX;
+    uint32_t delta = 0;
+    uint32_t ledPower;
+    bool found = false;
+
+    parseUInt32(self->values[INDEX_CURRENT_LED470_POWER_MIN], &minimum);
+    parseUInt32(self->values[INDEX_CURRENT_LED470_POWER_MAX], &maximum);
+    parseUInt32(self->values[INDEX_AUTOGAIN_DELTA], &delta);
+
+    for (ledPower = minimum; ledPower <= maximum; ledPower++)
+    {
+        if (self->config.dark + simSignal(&self->config, ledPower) + delta >= level)
+        {
+            found = true;
+            break;
+        }
+    }
+    if (!found)
+    {
+        ledPower = maximum;
+    }
+    snprintf(self->values[INDEX_CURRENT_LED470_POWER], SIM_MAX_VALUE_LENGTH, "%u", ledPower);
+    return snprintf(out, size, "C %d %u", found ? 1 : 0, ledPower);
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static Error_t simCheckRecord(const char *record)
+{
+    size_t length = strlen(record);
+    unsigned sum = 0;
+
+    if (length < 4 || record[0] != 'S' || !isdigit((unsigned char)record[1]) || (length % 2) != 0)
+    {
+        return ERROR_EVI_SREC_INVALID_STRING;
+    }
+    if (record[1] == '4' || record[1] == '6')
+    {
+        return ERROR_EVI_SREC_UNSUPPORTED_TYPE;
+    }
+    for (size_t i = 2; i < length; i += 2)
+    {
+        int high = hexValue(record[i]);
+        int low = hexValue(record[i + 1]);
+        if (high < 0 || low < 0)
+        {
+            return ERROR_EVI_SREC_INVALID_STRING;
+        }
+        sum += (unsigned)(high * 16 + low);
+    }
+    if ((size_t)(hexValue(record[2]) * 16 + hexValue(record[3])) != (length - 4) / 2)
+    {
+        return ERROR_EVI_SREC_INVALID_STRING;
+    }
+    // The byte count, the address, the data and the checksum add up to 0xff
+    return (sum & 0xff) == 0xff ? ERROR_EVI_OK : ERROR_EVI_SREC_INVALID_CRC;
+}
+
+// The S0 text is "name version", the version is its last word
+static void simRecordVersion(const char *record, char *version, size_t size)
+{
+    size_t count = (size_t)(hexValue(record[2]) * 16 + hexValue(record[3]));
+    char text[SIM_MAX_VALUE_LENGTH];
+    size_t length = 0;
+    char *word;
+
+    // Skips byte count and address, leaves out the checksum
+    for (size_t i = 8; count >= 3 && i + 2 < 4 + 2 * count && length + 1 < sizeof(text); i += 2)
+    {
+        char c = (char)(hexValue(record[i]) * 16 + hexValue(record[i + 1]));
+        if (c < ' ' || c > '~')
+        {
+            break;
+        }
+        text[length++] = c;
+    }
+    while (length > 0 && text[length - 1] == ' ')
+    {
+        length--;
+    }
+    text[length] = '\0';
+    word = strrchr(text, ' ');
+    snprintf(version, size, "%s", word != NULL ? word + 1 : text);
+}
+
+// Executes a command without framing, out receives the reply without framing.
+static int simCommand(SimDevice_t *self, char *command, char *out, size_t size, SimAction_t *action)
+{
+    char *argv[4] = {0};
+    int argc = 0;
+    char *save = NULL;
+
+    for (char *token = strtok_r(command, " ", &save); token != NULL && argc < 4; token = strtok_r(NULL, " ", &save))
+    {
+        argv[argc++] = token;
+    }
+    if (argc == 0 || argv[0][1] != '\0')
+    {
+        return snprintf(out, size, "E %d", ERROR_EVI_UNKNOWN_COMMAND);
+    }
+
+    switch (argv[0][0])
+    {
+    case 'V':
+    {
+        uint32_t index;
+        if (argc < 2 || argc > 3 || !parseUInt32(argv[1], &index) || index >= SIM_MAX_VALUES || self->values[index][0] == '\0')
+        {
+            break;
+        }
+        if (argc == 2)
+        {
+            return snprintf(out, size, "V %s", self->values[index]);
+        }
+        if (index == INDEX_VERSION || index == INDEX_SERIALNUMBER || index == INDEX_LASTMEASUREMENTCOUNT)
+        {
+            break;
+        }
+        if (index == INDEX_CURRENT_LED470_POWER || index == INDEX_CURRENT_LED625_POWER)
+        {
+            uint32_t ledPower;
+            if (!parseUInt32(argv[2], &ledPower) || ledPower > SIM_LED_POWER_MAX)
+            {
+                break;
+            }
+        }
+        snprintf(self->values[index], SIM_MAX_VALUE_LENGTH, "%s", argv[2]);
+        return snprintf(out, size, "V");
+    }
+    case 'M':
+    {
+        uint32_t n;
+        if (argc == 1)
+        {
+            return simMeasure(self, out, size);
+        }
+        if (argc != 2 || !parseUInt32(argv[1], &n) || n >= self->storedCount)
+        {
+            break;
+        }
+        return snprintf(out, size, "M %.3f %.3f %u 0 0 0", self->stored[n][0], self->stored[n][1], (uint32_t)self->stored[n][2]);
+    }
+    case 'C':
+    {
+        uint32_t level;
+        if (argc != 2 || !parseUInt32(argv[1], &level))
+        {
+            break;
+        }
+        return simAutogain(self, level, out, size);
+    }
+    case 'G':
+        // A baseline starts a new series of measurements
+        self->storedCount = 0;
+        snprintf(self->values[INDEX_LASTMEASUREMENTCOUNT], SIM_MAX_VALUE_LENGTH, "0");
+        return snprintf(out, size, "G");
+    case 'X':
+        return snprintf(out, size, "X %d", self->config.cuvetteEmpty ? 1 : 0);
+    case 'Y':
+        return snprintf(out, size, "Y 0");
+    case 'Q':
+        if (self->loggingLine >= sizeof(loggingLines) / sizeof(loggingLines[0]))
+        {
+            return snprintf(out, size, "E %d", ERROR_EVI_NO_MORE_LOGGING);
+        }
+        return snprintf(out, size, "Q %s", loggingLines[self->loggingLine++]);
+    case 'F':
+        self->updating = true;
+        self->imageVersion[0] = '\0';
+        return snprintf(out, size, "F");
+    case 'S':
+    {
+        Error_t e = (argc == 2 && self->updating) ? simCheckRecord(argv[1]) : ERROR_EVI_INVALID_PARAMETER;
+        if (e != ERROR_EVI_OK)
+        {
+            return snprintf(out, size, "E %d", e);
+        }
+        if (argv[1][1] == '0')
+        {
+            simRecordVersion(argv[1], self->imageVersion, sizeof(self->imageVersion));
+        }
+        return snprintf(out, size, "S");
+    }
+    case 'R':
+        // The module reboots and re-enumerates, the connection is gone
+        if (self->updating && self->imageVersion[0] != '\0')
+        {
+            snprintf(self->values[INDEX_VERSION], SIM_MAX_VALUE_LENGTH, "%s", self->imageVersion);
+        }
+        self->updating = false;
+        self->loggingLine = 0;
+        self->bootedAtMs = simNowMs() + (uint64_t)(self->config.rebootMs * self->config.timeScale);
+        *action = SIM_REPLY_DISCONNECT;
+        return snprintf(out, size, "R");
+    default:
+        return snprintf(out, size, "E %d", ERROR_EVI_UNKNOWN_COMMAND);
+    }
+    return snprintf(out, size, "E %d", ERROR_EVI_INVALID_PARAMETER);
+}
+
+static size_t simFrame(char *reply, size_t size, const char *body, bool useChecksum, bool corrupt)
+{
+    if (useChecksum)
+    {
+        crc_t crc = crc_finalize(crc_update(crc_init(), body, strlen(body)));
+        return (size_t)snprintf(reply, size, ";%s@%u\n", body, (unsigned)(corrupt ? crc ^ 0x5a5a : crc));
+    }
+    else
+    {
+        int n = snprintf(reply, size, ":%s\n", body);
+        if (corrupt && n > 3)
+        {
+            // Without checksum the garbled reply can only be caught by the parser
+            reply[n - 2] = '#';
+        }
+        return (size_t)n;
+    }
+}
+
+SimAction_t simDeviceExecute(SimDevice_t *self, const char *line, char *reply, size_t replySize, size_t *replyLength, uint32_t *delayMs)
+{
+    SimConfig_t *config = &self->config;
+    SimAction_t action = SIM_REPLY;
+    char command[SIM_MAX_LINE_LENGTH];
+    char body[SIM_MAX_LINE_LENGTH];
+    bool useChecksum = line[0] == ';';
+    char letter;
+    double delay;
+
+    *replyLength = 0;
+    *delayMs = 0;
+    if (line[0] != ':' && line[0] != ';')
+    {
+        // Noise between frames is ignored like by the firmware
+        return SIM_DROP;
+    }
+    snprintf(command, sizeof(command), "%s", line + 1);
+    letter = command[0];
+
+    pthread_mutex_lock(&self->lock);
+
+    if (config->verbose)
+    {
+        fprintf(stderr, "RX: %s\n", line);
+    }
+
+    if (useChecksum)
+    {
+        char *separator = strrchr(command, '@');
+        uint32_t crcReceived = 0;
+        crc_t crc = 0;
+        if (separator != NULL)
+        {
+            *separator = 0;
+            crc = crc_finalize(crc_update(crc_init(), command, strlen(command)));
+        }
+        if (separator == NULL || !parseUInt32(separator + 1, &crcReceived) || crcReceived != crc)
+        {
+            snprintf(body, sizeof(body), "E %d", ERROR_EVI_INVALID_PARAMETER);
+            letter = 0;
+        }
+    }
+
+    if (letter != 0)
+    {
+        if (simChance(self, config->faults.error))
+        {
+            snprintf(body, sizeof(body), "E %d", ERROR_EVI_INVALID_PARAMETER);
+        }
+        else
+        {
+            simCommand(self, command, body, sizeof(body), &action);
+        }
+    }
+
+    delay = (letter >= 'A' && letter <= 'Z') ? config->latencyMs[letter - 'A'] : 0;
+    if (config->jitterMs > 0)
+    {
+        delay += simUniform(self) * config->jitterMs;
+    }
+    if (simChance(self, config->faults.spike))
+    {
+        delay += config->faults.spikeMs;
+    }
+    *delayMs = (uint32_t)(delay * config->timeScale);
+
+    if (simChance(self, config->faults.disconnect))
+    {
+        action = SIM_DISCONNECT;
+    }
+    else if (simChance(self, config->faults.drop))
+    {
+        action = SIM_DROP;
+    }
+    else
+    {
+        *replyLength = simFrame(reply, replySize, body, useChecksum, simChance(self, config->faults.corrupt));
+    }
+
+    if (config->verbose)
+    {
+        fprintf(stderr, "TX: %s (%u ms%s)\n", body, *delayMs,
+                action == SIM_DROP ? ", dropped" : action == SIM_DISCONNECT ? ", disconnect" : "");
+    }
+
+    pthread_mutex_unlock(&self->lock);
+    return action;
+}
+
+void simSleepMs(uint32_t ms)
+{
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+    {
+    }
+}
@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/**
+ * @file simdevice.h
+ * @brief Simulated eviFluor module shared by the simulator front ends.
+ *
+ * The device answers one framed command line at a time, with or without
+ * checksum, and keeps its state (values, stored measurements, LED power)
+ * across connections. Latency, noise and faults follow a SimConfig_t.
+ */
+
+#define SIM_MAX_LINE_LENGTH 255
+#define SIM_MAX_VALUES 32
+#define SIM_MAX_VALUE_LENGTH 100
+#define SIM_MAX_STORED 10
+#define SIM_MAX_CURVE_POINTS 16
+#define SIM_LED_POWER_MAX 1000
+
+/**
+ * @struct SimCurvePoint_t
+ * @brief One point of the LED power response curve.
+ */
+typedef struct
+{
+    double ledPower; /**< LED power. */
+    double signal; /**< Signal above dark of a sample with factor 1 at this LED power. */
+} SimCurvePoint_t;
+
+/**
+ * @struct SimFaults_t
+ * @brief Probabilities (0..1) of injected faults per command.
+ */
+typedef struct
+{
+    double drop; /**< The command is not answered. */
+    double corrupt; /**< The reply has a wrong checksum or a garbled character. */
+    double error; /**< The reply is "E 2" instead of the real answer. */
+    double disconnect; /**< The connection is closed instead of answering. */
+    double spike; /**< The reply is delayed by spikeMs. */
+    uint32_t spikeMs; /**< Extra delay of a spike in milliseconds. */
+} SimFaults_t;
+
+/**
+ * @struct SimConfig_t
+ * @brief Behaviour of the simulated module.
+ */
+typedef struct
+{
+    uint32_t latencyMs[26]; /**< Processing time per command letter 'A'..'Z' in milliseconds. */
+    uint32_t jitterMs; /**< Uniformly distributed extra latency 0..jitterMs. */
+    double timeScale; /**< Factor for all latencies, 0 answers immediately. */
+    double dark; /**< Mean dark signal. */
+    double darkNoise; /**< Standard deviation of the dark signal. */
+    double valueNoise; /**< Standard deviation of the signal relative to its value, e.g. 0.01 for 1%. */
+    double sample; /**< Fluorescence of the sample in the cuvette, 0 for air. */
+    bool cuvetteEmpty; /**< Result of the cuvette holder check X. */
+    SimCurvePoint_t curve[SIM_MAX_CURVE_POINTS]; /**< LED power response curve, sorted by LED power. */
+    size_t curvePoints; /**< Number of points of curve. */
+    uint32_t rebootMs; /**< Time the module is gone after R. */
+    SimFaults_t faults; /**< Fault injection. */
+    uint64_t seed; /**< Seed of the random numbers, runs with the same seed are repeatable. */
+    bool verbose; /**< Prints every command and reply. */
+} SimConfig_t;
+
+/**
+ * @enum SimAction_t
+ * @brief What the front end does with a reply.
+ */
+typedef enum
+{
+    SIM_REPLY = 0, /**< Send the reply after the delay. */
+    SIM_DROP, /**< Send nothing. */
+    SIM_DISCONNECT, /**< Close the connection. */
+    SIM_REPLY_DISCONNECT, /**< Send the reply after the delay, then close the connection like a rebooting module. */
+} SimAction_t;
+
+/**
+ * @struct SimDevice_t
+ * @brief State of the simulated module.
+ */
+typedef struct
+{
+    SimConfig_t config; /**< Behaviour. */
+    pthread_mutex_t lock; /**< Serializes the commands of all connections. */
+    char values[SIM_MAX_VALUES][SIM_MAX_VALUE_LENGTH]; /**< Values of the V command by index. */
+    double stored[SIM_MAX_STORED][3]; /**< Last measurements: dark, value, LED power. Newest first. */
+    size_t storedCount; /**< Number of stored measurements. */
+    size_t loggingLine; /**< Next line of the Q command. */
+    bool updating; /**< True between F and R of a firmware update. */
+    char imageVersion[SIM_MAX_VALUE_LENGTH]; /**< Version in the S0 record of the image being written, the module runs it after R. */
+    uint64_t random; /**< State of the random number generator. */
+    uint64_t bootedAtMs; /**< Monotonic time at which a reboot is over. */
+} SimDevice_t;
+
+/**
+ * @brief Sets the default behaviour: realistic latencies, little noise, no faults.
+ *
+ * @param config The configuration to initialize.
+ */
+void simConfigDefaults(SimConfig_t *config);
+
+/**
+ * @brief Parses a command-line option of the simulator into a configuration.
+ *
+ * Understands --latency C=MS, --jitter MS, --time-scale X, --dark D,
+ * --dark-noise SD, --value-noise REL, --sample F, --not-empty, --curve P:S,...,
+ * --reboot MS, --drop P, --corrupt P, --error P, --disconnect P, --spike P:MS,
+ * --seed N and --verbose.
+ *
+ * @param config The configuration to change.
+ * @param argc Number of remaining arguments.
+ * @param argv Remaining arguments, argv[0] is the option.
+ * @return Number of arguments consumed, 0 if the option is unknown, -1 if its value is invalid.
+ */
+int simConfigOption(SimConfig_t *config, int argc, char **argv);
+
+/**
+ * @brief Prints the options of simConfigOption().
+ *
+ * @param stream Stream for the help text.
+ */
+void simConfigHelp(FILE *stream);
+
+/**
+ * @brief Initializes a device.
+ *
+ * @param self The device.
+ * @param config Behaviour of the device, copied.
+ */
+void simDeviceInit(SimDevice_t *self, const SimConfig_t *config);
+
+/**
+ * @brief Releases a device.
+ *
+ * @param self The device.
+ */
+void simDeviceDestroy(SimDevice_t *self);
+
+/**
+ * @brief Executes one command line and builds the framed reply.
+ *
+ * Safe to call from several threads.
+ *
+ * @param self The device.
+ * @param line The received line without stop character, e.g. ":V 0" or ";V 0@12345".
+ * @param reply Buffer for the framed reply including the stop character.
+ * @param replySize Size of the reply buffer.
+ * @param replyLength Pointer to store the length of the reply.
+ * @param delayMs Pointer to store the time the module needs before it answers.
+ * @return What to do with the reply.
+ */
+SimAction_t simDeviceExecute(SimDevice_t *self, const char *line, char *reply, size_t replySize, size_t *replyLength, uint32_t *delayMs);
+
+/**
+ * @brief Time until the module is back after R.
+ *
+ * While it reboots the front ends accept no connection and answer nothing.
+ *
+ * @param self The device.
+ * @return Remaining milliseconds of the reboot, 0 if the module is up.
+ */
+uint32_t simDeviceBooting(SimDevice_t *self);
+
+/**
+ * @brief Waits for the given time.
+ *
+ * @param ms Milliseconds.
+ */
+void simSleepMs(uint32_t ms);
@@ -0,0 +1,354 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+// Simulated eviFluor module behind a pseudo terminal. The slave side is used
+// like /dev/ttyACM0, so tcflush(), termios and the line discipline of the tty
+// path are exercised; the replies are paced like the bulk IN packets of a
+// USB-CDC module.
+
+#define _GNU_SOURCE
+#include "simdevice.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIM_PACKET_SIZE 64
+#define SIM_FRAME_US 1000
+
+typedef struct
+{
+    int master;
+    int slave;
+    char path[128];
+} SimPty_t;
+
+typedef struct
+{
+    size_t packetSize; // Bytes per bulk packet, 64 for a full-speed CDC module
+    uint32_t frameUs; // Time between bulk packets, 0 writes a reply at once
+    bool raw; // Slave without line discipline instead of the settings of a fresh ttyACM
+    const char *link; // Symbolic link to the slave, updated when the module re-enumerates
+} SimPtyOptions_t;
+
+static uint64_t nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void sleepUntilUs(uint64_t us)
+{
+    struct timespec ts = {.tv_sec = us / 1000000u, .tv_nsec = (long)(us % 1000000u) * 1000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+// Data crosses the bus only at the start of a USB frame
+static void waitForFrame(const SimPtyOptions_t *options)
+{
+    if (options->frameUs > 0)
+    {
+        uint64_t now = nowUs();
+        sleepUntilUs((now / options->frameUs + 1) * options->frameUs);
+    }
+}
+
+static void simPtyClose(SimPty_t *pty)
+{
+    if (pty->master >= 0)
+    {
+        close(pty->master);
+    }
+    if (pty->slave >= 0)
+    {
+        close(pty->slave);
+    }
+    pty->master = -1;
+    pty->slave = -1;
+}
+
+static bool simPtyOpen(SimPty_t *pty, const SimPtyOptions_t *options)
+{
+    struct termios tio;
+    const char *name;
+
+    pty->slave = -1;
+    pty->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty->master < 0 || grantpt(pty->master) != 0 || unlockpt(pty->master) != 0 || (name = ptsname(pty->master)) == NULL)
+    {
+        perror("posix_openpt");
+        simPtyClose(pty);
+        return false;
+    }
+    snprintf(pty->path, sizeof(pty->path), "%s", name);
+
+    // The emulator keeps the slave open, otherwise the master reads EIO between two clients
+    pty->slave = open(pty->path, O_RDWR | O_NOCTTY);
+    if (pty->slave < 0 || tcgetattr(pty->slave, &tio) != 0)
+    {
+        perror(pty->path);
+        simPtyClose(pty);
+        return false;
+    }
+    if (options->raw)
+    {
+        cfmakeraw(&tio);
+    }
+    else
+    {
+        // Like a fresh ttyACM the slave stays canonical with CR/NL mapping, but a
+        // module does not see its replies echoed back
+        tio.c_lflag &= ~(ECHO | ECHOE | ECHOK | ECHONL);
+    }
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tcsetattr(pty->slave, TCSANOW, &tio);
+
+    if (options->link != NULL)
+    {
+        unlink(options->link);
+        if (symlink(pty->path, options->link) != 0)
+        {
+            perror(options->link);
+        }
+    }
+    printf("%s\n", options->link != NULL ? options->link : pty->path);
+    fflush(stdout);
+    return true;
+}
+
+static bool writeAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static bool sendPaced(int fd, const char *reply, size_t length, const SimPtyOptions_t *options)
+{
+    while (length > 0)
+    {
+        size_t n = length < options->packetSize ? length : options->packetSize;
+        waitForFrame(options);
+        if (!writeAll(fd, reply, n))
+        {
+            return false;
+        }
+        reply += n;
+        length -= n;
+    }
+    return true;
+}
+
+// A hang up discards what the client did not read yet, the reply of R must get through first
+static void waitUntilRead(const SimPty_t *pty)
+{
+    uint64_t deadline = nowUs() + 1000000u;
+    int pending = 0;
+
+    // The pty hands written data to the slave asynchronously
+    tcdrain(pty->master);
+    simSleepMs(10);
+    while (ioctl(pty->slave, FIONREAD, &pending) == 0 && pending > 0 && nowUs() < deadline)
+    {
+        simSleepMs(1);
+    }
+}
+
+static void help(FILE *stream)
+{
+    fprintf(stream, "Usage: evifluor-ptysim [OPTIONS]\n\n");
+    fprintf(stream, "Simulates an eviFluor module behind a pseudo terminal and prints the path of\n");
+    fprintf(stream, "the terminal for --device.\n\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  --link PATH         : creates a symbolic link PATH to the terminal\n");
+    fprintf(stream, "  --packet-size N     : bytes per USB bulk packet (default %d)\n", SIM_PACKET_SIZE);
+    fprintf(stream, "  --frame-us N        : microseconds between packets, 0 disables the pacing (default %d)\n", SIM_FRAME_US);
+    fprintf(stream, "  --raw               : terminal without line discipline\n");
+    fprintf(stream, "  --help              : prints this help\n\n");
+    simConfigHelp(stream);
+}
+
+static bool parseNumber(const char *s, uint32_t *value)
+{
+    char *end;
+    unsigned long v = strtoul(s, &end, 10);
+    *value = (uint32_t)v;
+    return end != s && *end == '\0' && s[0] != '-' && v <= UINT32_MAX;
+}
+
+int main(int argc, char **argv)
+{
+    SimConfig_t config;
+    SimDevice_t device;
+    SimPtyOptions_t options = {.packetSize = SIM_PACKET_SIZE, .frameUs = SIM_FRAME_US};
+    SimPty_t pty;
+    char line[SIM_MAX_LINE_LENGTH + 1];
+    size_t length = 0;
+    bool overflow = false;
+
+    simConfigDefaults(&config);
+    for (int i = 1; i < argc; i++)
+    {
+        int consumed;
+        uint32_t number;
+        if (strcmp(argv[i], "--help") == 0)
+        {
+            help(stdout);
+            return 0;
+        }
+        if (strcmp(argv[i], "--raw") == 0)
+        {
+            options.raw = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--link") == 0 && i + 1 < argc)
+        {
+            options.link = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--packet-size") == 0 && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], &number) || number == 0)
+            {
+                fprintf(stderr, "Invalid packet size: %s\n", argv[i]);
+                return 1;
+            }
+            options.packetSize = number;
+            continue;
+        }
+        if (strcmp(argv[i], "--frame-us") == 0 && i + 1 < argc)
+        {
+            if (!parseNumber(argv[++i], &options.frameUs))
+            {
+                fprintf(stderr, "Invalid frame time: %s\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        consumed = simConfigOption(&config, argc - i, argv + i);
+        if (consumed <= 0)
+        {
+            fprintf(stderr, consumed < 0 ? "Invalid value of option %s\n" : "Unknown option %s\n", argv[i]);
+            help(stderr);
+            return 1;
+        }
+        i += consumed - 1;
+    }
+
+    if (!simPtyOpen(&pty, &options))
+    {
+        return 1;
+    }
+    simDeviceInit(&device, &config);
+
+    for (;;)
+    {
+        char buffer[512];
+        struct pollfd pfd = {.fd = pty.master, .events = POLLIN};
+        ssize_t n;
+
+        if (poll(&pfd, 1, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+        n = read(pty.master, buffer, sizeof(buffer));
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            perror("read");
+            break;
+        }
+
+        for (ssize_t i = 0; i < n; i++)
+        {
+            char c = buffer[i];
+            char reply[SIM_MAX_LINE_LENGTH + 16];
+            size_t replyLength;
+            uint32_t delayMs;
+            SimAction_t action;
+
+            if (c != '\n' && c != '\r')
+            {
+                if (length < SIM_MAX_LINE_LENGTH)
+                {
+                    line[length++] = c;
+                }
+                else
+                {
+                    overflow = true;
+                }
+                continue;
+            }
+            if (length == 0 || overflow)
+            {
+                length = 0;
+                overflow = false;
+                continue;
+            }
+            line[length] = 0;
+            length = 0;
+
+            // The command arrived with the bulk OUT packet of this frame
+            waitForFrame(&options);
+            action = simDeviceExecute(&device, line, reply, sizeof(reply), &replyLength, &delayMs);
+            simSleepMs(delayMs);
+            if (action == SIM_REPLY || action == SIM_REPLY_DISCONNECT)
+            {
+                sendPaced(pty.master, reply, replyLength, &options);
+            }
+            if (action == SIM_DISCONNECT || action == SIM_REPLY_DISCONNECT)
+            {
+                // The module re-enumerates: the open terminal hangs up and a new one appears
+                if (action == SIM_REPLY_DISCONNECT)
+                {
+                    waitUntilRead(&pty);
+                }
+                simPtyClose(&pty);
+                if (options.link != NULL)
+                {
+                    unlink(options.link);
+                }
+                simSleepMs(simDeviceBooting(&device));
+                if (!simPtyOpen(&pty, &options))
+                {
+                    simDeviceDestroy(&device);
+                    return 1;
+                }
+                break;
+            }
+        }
+    }
+
+    simPtyClose(&pty);
+    simDeviceDestroy(&device);
+    return 1;
+}
@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+// Reference simulator of an eviFluor module on a TCP port, the port
+// "SIMULATION" of the library connects to it.
+
+#include "simdevice.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SIM_DEFAULT_PORT 5000
+
+typedef struct
+{
+    SimDevice_t *device;
+    int fd;
+} SimConnection_t;
+
+static bool sendAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+// Serves one connection until the client closes it. The connection stays open
+// across commands like the serial port of a module.
+static void *simConnection(void *arg)
+{
+    SimConnection_t *connection = (SimConnection_t *)arg;
+    char line[SIM_MAX_LINE_LENGTH + 1];
+    size_t length = 0;
+    bool overflow = false;
+    bool open = true;
+
+    while (open)
+    {
+        char buffer[512];
+        ssize_t n = recv(connection->fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+
+        for (ssize_t i = 0; i < n && open; i++)
+        {
+            char c = buffer[i];
+            if (c != '\n' && c != '\r')
+            {
+                if (length < SIM_MAX_LINE_LENGTH)
+                {
+                    line[length++] = c;
+                }
+                else
+                {
+                    overflow = true;
+                }
+                continue;
+            }
+            if (length > 0 && !overflow && simDeviceBooting(connection->device) > 0)
+            {
+                // A module which reboots is not reachable
+                open = false;
+            }
+            else if (length > 0 && !overflow)
+            {
+                char reply[SIM_MAX_LINE_LENGTH + 16];
+                size_t replyLength;
+                uint32_t delayMs;
+                SimAction_t action;
+
+                line[length] = 0;
+                action = simDeviceExecute(connection->device, line, reply, sizeof(reply), &replyLength, &delayMs);
+                simSleepMs(delayMs);
+                if (action == SIM_REPLY || action == SIM_REPLY_DISCONNECT)
+                {
+                    open = sendAll(connection->fd, reply, replyLength);
+                }
+                if (action == SIM_DISCONNECT || action == SIM_REPLY_DISCONNECT)
+                {
+                    open = false;
+                }
+            }
+            length = 0;
+            overflow = false;
+        }
+    }
+
+    close(connection->fd);
+    free(connection);
+    return NULL;
+}
+
+static void help(FILE *stream)
+{
+    fprintf(stream, "Usage: evifluor-sim [OPTIONS]\n\n");
+    fprintf(stream, "Simulates an eviFluor module on a TCP port, connect with --device SIMULATION\n");
+    fprintf(stream, "or --device tcp:HOST:PORT.\n\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  --port N            : TCP port (default %d)\n", SIM_DEFAULT_PORT);
+    fprintf(stream, "  --any               : listens on all interfaces instead of 127.0.0.1\n");
+    fprintf(stream, "  --help              : prints this help\n\n");
+    simConfigHelp(stream);
+}
+
+int main(int argc, char **argv)
+{
+    SimConfig_t config;
+    SimDevice_t device;
+    struct sockaddr_in address;
+    uint32_t port = SIM_DEFAULT_PORT;
+    bool any = false;
+    int server;
+    int yes = 1;
+
+    simConfigDefaults(&config);
+    for (int i = 1; i < argc; i++)
+    {
+        int consumed;
+        if (strcmp(argv[i], "--help") == 0)
+        {
+            help(stdout);
+            return 0;
+        }
+        if (strcmp(argv[i], "--any") == 0)
+        {
+            any = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+        {
+            char *end;
+            port = (uint32_t)strtoul(argv[++i], &end, 10);
+            if (*end != '\0' || port == 0 || port > 65535)
+            {
+                fprintf(stderr, "Invalid port: %s\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        consumed = simConfigOption(&config, argc - i, argv + i);
+        if (consumed <= 0)
+        {
+            fprintf(stderr, consumed < 0 ? "Invalid value of option %s\n" : "Unknown option %s\n", argv[i]);
+            help(stderr);
+            return 1;
+        }
+        i += consumed - 1;
+    }
+
+    server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    address.sin_addr.s_addr = htonl(any ? INADDR_ANY : INADDR_LOOPBACK);
+    if (bind(server, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(server, 8) < 0)
+    {
+        perror("bind");
+        close(server);
+        return 1;
+    }
+
+    simDeviceInit(&device, &config);
+    fprintf(stderr, "Simulator listening on %s:%u\n", any ? "0.0.0.0" : "127.0.0.1", port);
+
+    for (;;)
+    {
+        SimConnection_t *connection;
+        pthread_t thread;
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        if (simDeviceBooting(&device) > 0)
+        {
+            close(fd);
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        connection = (SimConnection_t *)malloc(sizeof(SimConnection_t));
+        if (connection == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        connection->device = &device;
+        connection->fd = fd;
+        if (pthread_create(&thread, NULL, simConnection, connection) != 0)
+        {
+            close(fd);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(server);
+    simDeviceDestroy(&device);
+    return 1;
+}
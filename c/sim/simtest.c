@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+/**
+ * @file simtest.c
+ * @brief Protocol tests of the library against the simulated module in memory.
+ *
+ * Every test runs a session over eviTransportMemory with fault injection and
+ * checks that no value ends up at the wrong index. Exits with 0 if all tests
+ * pass.
+ */
+
+#include "evibase.h"
+#include "evifluor.h"
+#include "evitransport.h"
+#include "simdevice.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SIMTEST_ROUNDS 200
+
+// The simulated module answers in the calling thread, latencies are skipped
+static size_t simTestRespond(const char *request, size_t length, char *reply, size_t replySize, void *user)
+{
+    SimDevice_t *device = (SimDevice_t *)user;
+    char line[SIM_MAX_LINE_LENGTH];
+    size_t total = 0;
+    size_t n = 0;
+
+    // A pipelined write holds several frames
+    for (size_t i = 0; i < length; i++)
+    {
+        if (request[i] != EVI_STOP1 && request[i] != EVI_STOP2)
+        {
+            if (n < sizeof(line) - 1)
+            {
+                line[n++] = request[i];
+            }
+            continue;
+        }
+        if (n > 0)
+        {
+            size_t replyLength;
+            uint32_t delayMs;
+            line[n] = '\0';
+            // A reply which does not fit is lost like on a real line
+            if (simDeviceExecute(device, line, reply + total, replySize - total, &replyLength, &delayMs) == SIM_REPLY && replyLength < replySize - total)
+            {
+                total += replyLength;
+            }
+        }
+        n = 0;
+    }
+    return total;
+}
+
+// Garbled replies inside a burst must not shift the replies of the next burst
+static bool simTestCorruptBurst(void)
+{
+    SimConfig_t config;
+    SimDevice_t device;
+    EviMemoryDevice_t memoryDevice = {.respond = simTestRespond, .user = &device};
+    Evi_t evi = {0};
+    char portName[] = "";
+    EviValue_t values[SIM_MAX_VALUES];
+    size_t failed = 0;
+    size_t wrong = 0;
+
+    simConfigDefaults(&config);
+    config.timeScale = 0;
+    config.faults.corrupt = 0.1;
+    simDeviceInit(&device, &config);
+    // Every index answers with a value naming it, a shifted reply is obvious
+    for (uint32_t i = 0; i < SIM_MAX_VALUES; i++)
+    {
+        snprintf(device.values[i], SIM_MAX_VALUE_LENGTH, "value%u", i);
+    }
+
+    evi.transport = &eviTransportMemory;
+    evi.transportUser = &memoryDevice;
+    evi.portName = portName;
+    // Only the checksum catches every garbled reply
+    evi.useChecksum = true;
+
+    for (int round = 0; round < SIMTEST_ROUNDS; round++)
+    {
+        for (uint32_t i = 0; i < SIM_MAX_VALUES; i++)
+        {
+            values[i].index = i;
+        }
+        eviGetMany(&evi, values, SIM_MAX_VALUES);
+        for (uint32_t i = 0; i < SIM_MAX_VALUES; i++)
+        {
+            if (values[i].result != ERROR_EVI_OK)
+            {
+                failed++;
+            }
+            else if (strcmp(values[i].value, device.values[i]) != 0)
+            {
+                fprintf(stderr, "round %d index %u: expected %s, got %s\n", round, i, device.values[i], values[i].value);
+                wrong++;
+            }
+        }
+    }
+
+    eviClose(&evi);
+    simDeviceDestroy(&device);
+
+    // Without any failed value the faults were not injected and the test proves nothing
+    bool passed = wrong == 0 && failed > 0;
+    fprintf(stdout, "%-40s%s (%zu failed, %zu wrong)\n", "corrupt burst", passed ? "passed" : "FAILED", failed, wrong);
+    return passed;
+}
+
+// The readback of a module with fewer stored measurements than slots ignores the empty ones
+static bool simTestStoredReadback(void)
+{
+    SimConfig_t config;
+    SimDevice_t device;
+    EviMemoryDevice_t memoryDevice = {.respond = simTestRespond, .user = &device};
+    Evi_t evi = {0};
+    char portName[] = "";
+    SingleMeasurement_t measured[3];
+    SingleMeasurement_t measurements[EVI_FLUOR_MAX_STORED_MEASUREMENTS];
+    size_t count = 0;
+    size_t stored = 0;
+    bool passed = true;
+
+    simConfigDefaults(&config);
+    config.timeScale = 0;
+    simDeviceInit(&device, &config);
+    evi.transport = &eviTransportMemory;
+    evi.transportUser = &memoryDevice;
+    evi.portName = portName;
+    evi.useChecksum = true;
+
+    passed = eviFluorStoredMeasurements(&evi, measurements, EVI_FLUOR_MAX_STORED_MEASUREMENTS, &count, &stored) == ERROR_EVI_OK && count == 0 && stored == 0;
+    for (int i = 0; i < 3 && passed; i++)
+    {
+        passed = eviFluorMeasure(&evi, &measured[i]) == ERROR_EVI_OK;
+    }
+    passed = passed && eviFluorStoredMeasurements(&evi, measurements, EVI_FLUOR_MAX_STORED_MEASUREMENTS, &count, &stored) == ERROR_EVI_OK && count == 3 && stored == 3;
+    // The newest measurement comes first
+    for (size_t i = 0; i < 3 && passed; i++)
+    {
+        passed = measurements[i].channel470.dark == measured[2 - i].channel470.dark && measurements[i].channel470.value == measured[2 - i].channel470.value;
+    }
+    // A short array gets the newest measurements, stored still tells how many there are
+    passed = passed && eviFluorStoredMeasurements(&evi, measurements, 2, &count, &stored) == ERROR_EVI_OK && count == 2 && stored == 3;
+    passed = passed && measurements[0].channel470.value == measured[2].channel470.value;
+
+    eviClose(&evi);
+    simDeviceDestroy(&device);
+
+    fprintf(stdout, "%-40s%s\n", "stored readback", passed ? "passed" : "FAILED");
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    bool passed = true;
+
+    passed = simTestCorruptBurst() && passed;
+    passed = simTestStoredReadback() && passed;
+    return passed ? 0 : 1;
+}
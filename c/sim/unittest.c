@@ -0,0 +1,336 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+/**
+ * @file unittest.c
+ * @brief Tests of the host-side helpers of the library, no module is involved.
+ *
+ * Covers number decoding, the CRC, SREC validation and coalescing, replicate
+ * statistics and kinetic buckets. Exits with 0 if all tests pass.
+ */
+
+#include "crc-16-ccitt.h"
+#include "dict.h"
+#include "evibase.h"
+#include "eviparse.h"
+#include "evisrec.h"
+#include "evifluorkinetic.h"
+#include "replicates.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNITTEST_DOUBLE_ROUNDS 100000
+
+static size_t unitTestFailures;
+
+static void unitTestCheck(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "  %s\n", what);
+        unitTestFailures++;
+    }
+}
+
+static bool unitTestReport(const char *name, size_t failuresBefore)
+{
+    bool passed = unitTestFailures == failuresBefore;
+    fprintf(stdout, "%-40s%s\n", name, passed ? "passed" : "FAILED");
+    return passed;
+}
+
+static bool unitTestParseInteger(void)
+{
+    size_t before = unitTestFailures;
+    uint32_t u = 7;
+    int32_t i = 7;
+
+    unitTestCheck(eviParseUInt32("0", &u) && u == 0, "UInt32 0");
+    unitTestCheck(eviParseUInt32("+42", &u) && u == 42, "UInt32 +42");
+    unitTestCheck(eviParseUInt32("4294967295", &u) && u == UINT32_MAX, "UInt32 maximum");
+    u = 7;
+    unitTestCheck(!eviParseUInt32("4294967296", &u) && u == 7, "UInt32 overflow is rejected and leaves the value");
+    unitTestCheck(!eviParseUInt32("99999999999", &u), "UInt32 long overflow");
+    unitTestCheck(!eviParseUInt32("12a", &u), "UInt32 trailing garbage");
+    unitTestCheck(!eviParseUInt32("12 ", &u), "UInt32 trailing space");
+    unitTestCheck(!eviParseUInt32("", &u), "UInt32 empty");
+    unitTestCheck(!eviParseUInt32("-1", &u), "UInt32 negative");
+
+    unitTestCheck(eviParseInt32("-2147483648", &i) && i == INT32_MIN, "Int32 minimum");
+    unitTestCheck(eviParseInt32("2147483647", &i) && i == INT32_MAX, "Int32 maximum");
+    unitTestCheck(eviParseInt32("-17", &i) && i == -17, "Int32 -17");
+    i = 7;
+    unitTestCheck(!eviParseInt32("2147483648", &i) && i == 7, "Int32 overflow is rejected and leaves the value");
+    unitTestCheck(!eviParseInt32("-2147483649", &i), "Int32 underflow");
+    unitTestCheck(!eviParseInt32("-", &i), "Int32 sign only");
+    unitTestCheck(!eviParseInt32("5x", &i), "Int32 trailing garbage");
+
+    return unitTestReport("parse integer", before);
+}
+
+static bool unitTestParseDouble(void)
+{
+    size_t before = unitTestFailures;
+    double d = 7;
+    char s[64];
+
+    unitTestCheck(eviParseDouble("810.564", &d) && d == 810.564, "Double 810.564");
+    unitTestCheck(eviParseDouble("-0.5", &d) && d == -0.5, "Double -0.5");
+    unitTestCheck(eviParseDouble("1e3", &d) && d == 1000, "Double exponent notation");
+    unitTestCheck(eviParseDouble("1234567890.12345678", &d) && d == strtod("1234567890.12345678", NULL), "Double with more than 15 digits");
+    d = 7;
+    unitTestCheck(!eviParseDouble("1.5x", &d) && d == 7, "Double trailing garbage is rejected and leaves the value");
+    unitTestCheck(!eviParseDouble("1.5 ", &d), "Double trailing space");
+    unitTestCheck(!eviParseDouble("", &d), "Double empty");
+    unitTestCheck(!eviParseDouble(".", &d), "Double without digits");
+    unitTestCheck(!eviParseDouble("1e400", &d), "Double overflow");
+    unitTestCheck(!eviParseDouble("inf", &d), "Double infinity");
+
+    // Numbers the fast path converts must match strtod() bit by bit
+    srand(1);
+    for (int round = 0; round < UNITTEST_DOUBLE_ROUNDS; round++)
+    {
+        int digits = 1 + rand() % 15;
+        int point = rand() % (digits + 1);
+        int n = 0;
+        double expected;
+
+        if (rand() % 2)
+        {
+            s[n++] = '-';
+        }
+        for (int k = 0; k < digits; k++)
+        {
+            if (k == point && k > 0)
+            {
+                s[n++] = '.';
+            }
+            s[n++] = (char)('0' + (k == 0 ? 1 + rand() % 9 : rand() % 10));
+        }
+        s[n] = '\0';
+        expected = strtod(s, NULL);
+        if (!eviParseDouble(s, &d) || memcmp(&d, &expected, sizeof(double)) != 0)
+        {
+            fprintf(stderr, "  %s: expected %.17g, got %.17g\n", s, expected, d);
+            unitTestFailures++;
+            break;
+        }
+    }
+
+    return unitTestReport("parse double", before);
+}
+
+static bool unitTestCrc(void)
+{
+    size_t before = unitTestFailures;
+    const char *check = "123456789";
+    crc_t crc = crc_init();
+    Evi_t evi = {.useChecksum = true};
+    char frame[EVI_MAX_LINE_LENGTH];
+
+    // CRC-16/AUG-CCITT: polynomial 0x1021, initial value 0x1d0f
+    unitTestCheck(crc_finalize(crc_update(crc_init(), "", 0)) == 0x1d0f, "CRC of nothing");
+    unitTestCheck(crc_finalize(crc_update(crc_init(), check, strlen(check))) == 0xe5cc, "CRC check value");
+    for (const char *c = check; *c != '\0'; c++)
+    {
+        crc = crc_update_byte(crc, (unsigned char)*c);
+    }
+    unitTestCheck(crc_finalize(crc) == 0xe5cc, "CRC byte by byte");
+    unitTestCheck(eviFrameCommand(&evi, "V 1", frame, sizeof(frame)) == 11 && strcmp(frame, ";V 1@56822\n") == 0, "frame of a command with checksum");
+
+    return unitTestReport("crc", before);
+}
+
+// Appends a record with a correct checksum to text
+static void unitTestSrecRecord(char *text, unsigned type, uint32_t address, size_t addressLength, const uint8_t *data, size_t length)
+{
+    char *out = text + strlen(text);
+    unsigned sum = (unsigned)(addressLength + length + 1);
+
+    out += sprintf(out, "S%u%02X", type, sum);
+    for (size_t i = addressLength; i > 0; i--)
+    {
+        uint8_t byte = (uint8_t)(address >> (8 * (i - 1)));
+        out += sprintf(out, "%02X", byte);
+        sum += byte;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        out += sprintf(out, "%02X", data[i]);
+        sum += data[i];
+    }
+    sprintf(out, "%02X\n", (uint8_t)~sum);
+}
+
+static bool unitTestSrecErrors(void)
+{
+    size_t before = unitTestFailures;
+    uint8_t data[16] = {0};
+    char text[1024] = "";
+    EviSrecImage_t image;
+    size_t line;
+    char *last;
+
+    unitTestSrecRecord(text, 0, 0, 2, (const uint8_t *)"evi 2.0.0", 9);
+    unitTestSrecRecord(text, 1, 0x0000, 2, data, sizeof(data));
+    unitTestSrecRecord(text, 1, 0x0010, 2, data, sizeof(data));
+    unitTestCheck(eviSrecParse(text, strlen(text), false, 0, &image, &line) == ERROR_EVI_OK && line == 0, "valid image");
+    unitTestCheck(strcmp(image.version, "2.0.0") == 0, "version of S0");
+    unitTestCheck(image.count == 3 && image.sourceRecords == 3 && image.dataBytes == 32, "records of a valid image");
+    eviSrecFree(&image);
+
+    // The checksum of the last record is broken
+    last = text + strlen(text) - 2;
+    *last = *last == '0' ? '1' : '0';
+    unitTestCheck(eviSrecParse(text, strlen(text), false, 0, &image, &line) == ERROR_EVI_SREC_INVALID_CRC && line == 3, "bad checksum in line 3");
+    unitTestCheck(image.records == NULL && image.count == 0, "a rejected image is empty");
+
+    strcpy(text, "");
+    unitTestSrecRecord(text, 1, 0x0000, 2, data, sizeof(data));
+    unitTestSrecRecord(text, 4, 0x0010, 2, data, sizeof(data));
+    unitTestCheck(eviSrecParse(text, strlen(text), false, 0, &image, &line) == ERROR_EVI_SREC_UNSUPPORTED_TYPE && line == 2, "S4 in line 2");
+
+    strcpy(text, "S1130000ZZ\n");
+    unitTestCheck(eviSrecParse(text, strlen(text), false, 0, &image, &line) == ERROR_EVI_SREC_INVALID_STRING && line == 1, "invalid hex digits in line 1");
+
+    return unitTestReport("srec errors", before);
+}
+
+static bool unitTestSrecCoalesce(void)
+{
+    size_t before = unitTestFailures;
+    uint8_t data[32];
+    uint8_t count[2] = {0};
+    char text[2048] = "";
+    char expected[64] = "";
+    EviSrecImage_t image;
+    size_t line;
+
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)i;
+    }
+    // One long record sets the default length, then a run of short ones with a gap at 0x50
+    unitTestSrecRecord(text, 1, 0x0000, 2, data, 32);
+    unitTestSrecRecord(text, 1, 0x0020, 2, data, 16);
+    unitTestSrecRecord(text, 1, 0x0030, 2, data, 16);
+    unitTestSrecRecord(text, 1, 0x0040, 2, data, 16);
+    unitTestSrecRecord(text, 1, 0x0060, 2, data, 16);
+    unitTestSrecRecord(text, 1, 0x0070, 2, data, 16);
+    // The count of S5 is the one of the file, 6
+    unitTestSrecRecord(text, 5, 6, 2, count, 0);
+
+    unitTestCheck(eviSrecParse(text, strlen(text), false, 0, &image, &line) == ERROR_EVI_OK && image.count == 7, "without coalescing every record is kept");
+    eviSrecFree(&image);
+
+    unitTestCheck(eviSrecParse(text, strlen(text), true, 0, &image, &line) == ERROR_EVI_OK, "coalesced image");
+    // 0x00 (32), 0x20 + 0x30 (32), 0x40 (16, the next is 0x60), 0x60 + 0x70 (32), S5
+    unitTestCheck(image.count == 5 && image.sourceRecords == 7 && image.dataBytes == 112, "records of the coalesced image");
+    for (size_t i = 0; i < image.count; i++)
+    {
+        unitTestCheck(strlen(image.records[i]) <= 74, "no record is longer than the longest of the file");
+    }
+    unitTestCheck(image.count == 5 && strncmp(image.records[2], "S1130040", 8) == 0, "the gap at 0x50 ends a record");
+    unitTestSrecRecord(expected, 5, 4, 2, count, 0);
+    expected[strlen(expected) - 1] = '\0';
+    unitTestCheck(image.count == 5 && strcmp(image.records[4], expected) == 0, "S5 counts the records sent");
+    eviSrecFree(&image);
+
+    // A longer limit joins the whole run up to the gap
+    unitTestCheck(eviSrecParse(text, strlen(text), true, EVI_SREC_MAX_RECORD_LENGTH, &image, &line) == ERROR_EVI_OK && image.count == 3, "coalesced up to EVI_SREC_MAX_RECORD_LENGTH");
+    unitTestCheck(image.count == 3 && strlen(image.records[0]) == 4 + 2 * (2 + 80 + 1), "the first run holds 80 bytes");
+    eviSrecFree(&image);
+
+    // A limit below the shortest record joins nothing
+    unitTestCheck(eviSrecParse(text, strlen(text), true, 20, &image, &line) == ERROR_EVI_OK && image.count == 7, "coalescing limited to 20 characters");
+    eviSrecFree(&image);
+
+    return unitTestReport("srec coalesce", before);
+}
+
+static bool unitTestReplicates(void)
+{
+    size_t before = unitTestFailures;
+    const double sample[] = {2, 4, 4, 4, 5, 5, 7, 9};
+    RunningStatistic_t statistic = {0};
+    Replicates_t replicates = {0};
+    SingleMeasurement_t measurement;
+    cJSON *json;
+    cJSON *delta;
+
+    unitTestCheck(runningStatistic_sd(&statistic) == 0 && runningStatistic_cv(&statistic) == 0, "empty series");
+    for (size_t i = 0; i < sizeof(sample) / sizeof(sample[0]); i++)
+    {
+        runningStatistic_add(&statistic, sample[i]);
+    }
+    // Mean 5, sum of squared deviations 32 over 7 degrees of freedom
+    unitTestCheck(statistic.count == 8 && fabs(statistic.mean - 5) < 1e-12, "mean");
+    unitTestCheck(fabs(runningStatistic_sd(&statistic) - sqrt(32.0 / 7)) < 1e-12, "standard deviation");
+    unitTestCheck(fabs(runningStatistic_cv(&statistic) - sqrt(32.0 / 7) / 5) < 1e-12, "coefficient of variation");
+
+    // Deltas of -1 and 1 have a mean of 0 with spread, so no CV
+    measurement = singleMeasurement_init(channel_init(1, 0, 200));
+    replicates_add(&replicates, &measurement);
+    measurement = singleMeasurement_init(channel_init(0, 1, 200));
+    replicates_add(&replicates, &measurement);
+    unitTestCheck(!isfinite(runningStatistic_cv(&replicates.delta)), "CV of a mean of 0 with spread");
+    json = replicates_toJson(&replicates);
+    delta = cJSON_GetObjectItem(json, DICT_DELTA);
+    unitTestCheck(delta != NULL && cJSON_GetObjectItem(delta, DICT_SD) != NULL && cJSON_GetObjectItem(delta, DICT_CV) == NULL, "an infinite CV is left out of the JSON");
+    unitTestCheck(cJSON_GetObjectItem(cJSON_GetObjectItem(json, DICT_DARK), DICT_CV) != NULL, "a finite CV is in the JSON");
+    cJSON_Delete(json);
+
+    return unitTestReport("replicates", before);
+}
+
+static EviFluorReading_t unitTestReading(uint64_t timeMs, double delta)
+{
+    EviFluorReading_t reading = {.timeUs = timeMs * 1000, .measurement = singleMeasurement_init(channel_init(10, 10 + delta, 200))};
+    return reading;
+}
+
+static bool unitTestBuckets(void)
+{
+    size_t before = unitTestFailures;
+    EviFluorBucket_t bucket = {0};
+    EviFluorBucket_t closed = {0};
+    EviFluorReading_t reading;
+
+    // Buckets of 100 ms aligned to the start, the first reading is at 150 ms
+    reading = unitTestReading(150, 2);
+    unitTestCheck(!eviFluorBucketAdd(&bucket, 100, &reading, &closed), "the first reading opens a bucket");
+    reading = unitTestReading(160, 5);
+    unitTestCheck(!eviFluorBucketAdd(&bucket, 100, &reading, &closed), "a reading in the same bucket");
+    reading = unitTestReading(199, 1);
+    unitTestCheck(!eviFluorBucketAdd(&bucket, 100, &reading, &closed), "the last millisecond of the bucket");
+    reading = unitTestReading(200, 7);
+    unitTestCheck(eviFluorBucketAdd(&bucket, 100, &reading, &closed), "the next bucket closes the first one");
+    unitTestCheck(closed.timeUs == 150000 && closed.replicates.dark.count == 3, "time and count of the closed bucket");
+    unitTestCheck(closed.deltaMin == 1 && closed.deltaMax == 5 && fabs(closed.replicates.delta.mean - 8.0 / 3) < 1e-12, "delta of the closed bucket");
+    unitTestCheck(bucket.timeUs == 200000 && bucket.replicates.dark.count == 1 && bucket.deltaMin == 7 && bucket.deltaMax == 7, "the reading starts the next bucket");
+
+    // Without a bucket length every reading closes the previous one
+    memset(&bucket, 0, sizeof(bucket));
+    reading = unitTestReading(0, 1);
+    unitTestCheck(!eviFluorBucketAdd(&bucket, 0, &reading, &closed), "single readings, first");
+    reading = unitTestReading(0, 2);
+    unitTestCheck(eviFluorBucketAdd(&bucket, 0, &reading, &closed) && closed.replicates.dark.count == 1 && closed.deltaMax == 1, "single readings, second");
+
+    return unitTestReport("kinetic buckets", before);
+}
+
+int main(int argc, char **argv)
+{
+    bool passed = true;
+
+    passed = unitTestParseInteger() && passed;
+    passed = unitTestParseDouble() && passed;
+    passed = unitTestCrc() && passed;
+    passed = unitTestSrecErrors() && passed;
+    passed = unitTestSrecCoalesce() && passed;
+    passed = unitTestReplicates() && passed;
+    passed = unitTestBuckets() && passed;
+    return passed ? 0 : 1;
+}
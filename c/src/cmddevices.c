@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "cmddevices.h"
+#include "cmdfwupdate.h"
+#include "evifanout.h"
+#include "evifluor.h"
+#include "printerror.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+Error_t cmdDevices(Evi_t *self)
+{
+    size_t count = 0;
+    EviDeviceInfo_t *devices = calloc(EVI_MAX_DEVICES, sizeof(EviDeviceInfo_t));
+    Error_t ret = devices != NULL ? eviEnumerateDevices(devices, EVI_MAX_DEVICES, &count, self->verbose) : ERROR_EVI_OUT_OF_MEMORY;
+
+    if (ret == ERROR_EVI_OK)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            fprintf_s(stdout, "%s\t%s\n", devices[i].serialNumber, devices[i].port);
+        }
+    }
+    else
+    {
+        printError(ret, NULL);
+    }
+
+    free(devices);
+    return ret;
+}
+
+static void printModuleError(const EviDeviceInfo_t *device, Error_t error)
+{
+    fprintf_s(stderr, "%s: ", device->serialNumber[0] ? device->serialNumber : device->port);
+    printError(error, NULL);
+}
+
+static Error_t allMeasure(Evi_t *sessions, const EviDeviceInfo_t *devices, size_t count, Error_t *results)
+{
+    SingleMeasurement_t *measurements = calloc(count, sizeof(SingleMeasurement_t));
+    if (measurements == NULL)
+    {
+        return printError(ERROR_EVI_OUT_OF_MEMORY, NULL);
+    }
+    Error_t ret = eviFluorMeasureAll(sessions, count, measurements, results);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (results[i] == ERROR_EVI_OK)
+        {
+            fprintf_s(stdout, "%s\t%.03f %.03f %d\n", devices[i].serialNumber, measurements[i].channel470.dark, measurements[i].channel470.value, measurements[i].channel470.ledPower);
+        }
+        else
+        {
+            printModuleError(&devices[i], results[i]);
+        }
+    }
+
+    free(measurements);
+    return ret;
+}
+
+static Error_t allSelftest(Evi_t *sessions, const EviDeviceInfo_t *devices, size_t count, Error_t *results)
+{
+    uint32_t *selftests = calloc(count, sizeof(uint32_t));
+    if (selftests == NULL)
+    {
+        return printError(ERROR_EVI_OUT_OF_MEMORY, NULL);
+    }
+    Error_t ret = eviSelftestAll(sessions, count, selftests, results);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (results[i] == ERROR_EVI_OK)
+        {
+            fprintf_s(stdout, "%s\t%s\n", devices[i].serialNumber, selftests[i] == 0 ? "Selftest passed." : "Selftest failed:");
+        }
+        else
+        {
+            printModuleError(&devices[i], results[i]);
+        }
+    }
+
+    free(selftests);
+    return ret;
+}
+
+static Error_t allGet(Evi_t *sessions, const EviDeviceInfo_t *devices, size_t count, Error_t *results, int indexCount, char **sIndices)
+{
+    EviValue_t *values = calloc(count * indexCount, sizeof(EviValue_t));
+    if (values == NULL)
+    {
+        return printError(ERROR_EVI_OUT_OF_MEMORY, NULL);
+    }
+    Error_t ret = ERROR_EVI_OK;
+
+    for (int j = 0; j < indexCount && ret == ERROR_EVI_OK; j++)
+    {
+        char *endptr;
+        uint32_t index = strtol(sIndices[j], &endptr, 10);
+        if (*endptr != '\0')
+        {
+            ret = printError(ERROR_EVI_INVALID_NUMBER, "'%s' is not a valid number.", sIndices[j]);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            values[i * indexCount + j].index = index;
+        }
+    }
+
+    if (ret == ERROR_EVI_OK)
+    {
+        ret = eviGetManyAll(sessions, count, values, indexCount, results);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (results[i] == ERROR_EVI_OK)
+            {
+                fprintf_s(stdout, "%s", devices[i].serialNumber);
+                for (int j = 0; j < indexCount; j++)
+                {
+                    fprintf_s(stdout, "\t%s", values[i * indexCount + j].value);
+                }
+                fprintf_s(stdout, "\n");
+            }
+            else
+            {
+                printModuleError(&devices[i], results[i]);
+            }
+        }
+    }
+
+    free(values);
+    return ret;
+}
+
+Error_t cmdAll(Evi_t *self, int argcCmd, char **argvCmd)
+{
+    size_t count = 0;
+    EviDeviceInfo_t *devices = calloc(EVI_MAX_DEVICES, sizeof(EviDeviceInfo_t));
+    Evi_t *sessions = calloc(EVI_MAX_DEVICES, sizeof(Evi_t));
+    Error_t *results = calloc(EVI_MAX_DEVICES, sizeof(Error_t));
+    Error_t ret = ERROR_EVI_OUT_OF_MEMORY;
+
+    // The cleanup at the end frees whatever was allocated
+    if (devices != NULL && sessions != NULL && results != NULL)
+    {
+        ret = eviEnumerateDevices(devices, EVI_MAX_DEVICES, &count, self->verbose);
+    }
+
+    if (ret == ERROR_EVI_OK && count == 0)
+    {
+        ret = printError(ERROR_EVI_INSTRUMENT_NOT_FOUND, NULL);
+    }
+    else if (ret == ERROR_EVI_OK)
+    {
+        eviSessionsFromDevices(self, devices, count, sessions);
+
+        if (strcmp(argvCmd[0], "measure") == 0 && argcCmd == 1)
+        {
+            ret = allMeasure(sessions, devices, count, results);
+        }
+        else if (strcmp(argvCmd[0], "selftest") == 0 && argcCmd == 1)
+        {
+            ret = allSelftest(sessions, devices, count, results);
+        }
+        else if (strcmp(argvCmd[0], "get") == 0 && argcCmd >= 2)
+        {
+            ret = allGet(sessions, devices, count, results, argcCmd - 1, argvCmd + 1);
+        }
+        else if (strcmp(argvCmd[0], "fwupdate") == 0)
+        {
+            ret = cmdFwUpdateAll(sessions, devices, count, results, argcCmd, argvCmd);
+        }
+        else
+        {
+            ret = printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, "'%s' can't be executed on all modules. See 'evifluor --help'.", argvCmd[0]);
+        }
+
+        eviCloseAll(sessions, count);
+    }
+    else
+    {
+        printError(ret, NULL);
+    }
+
+    free(results);
+    free(sessions);
+    free(devices);
+    return ret;
+}
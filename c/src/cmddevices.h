@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @brief Handles the `devices` CLI command that lists all attached modules.
+ *
+ * @param self Runtime context providing the options.
+ * @return Error code describing the operation outcome.
+ */
+Error_t cmdDevices(Evi_t * self);
+
+/**
+ * @brief Executes `measure`, `selftest`, `get` or `fwupdate` on all attached modules concurrently.
+ *
+ * Prints one line per module, starting with its serial number.
+ *
+ * @param self Runtime context providing the options for all modules.
+ * @param argcCmd Number of command arguments.
+ * @param argvCmd Command arguments, starting with the command.
+ * @return Error code of the first module that failed.
+ */
+Error_t cmdAll(Evi_t * self, int argcCmd, char ** argvCmd);
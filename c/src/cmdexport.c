@@ -48,12 +48,17 @@ void exportRaw(ExportOptions_t * options, cJSON *object, FILE * csv)
 {
     cJSON *iterator = NULL;
     cJSON *oComment = cJSON_GetObjectItem(object, DICT_COMMENT);
-
-    fprintf_s(csv, "%s%c", oComment ? cJSON_GetStringValue(oComment) : "", options->delimiter);
-
     cJSON *oValues = cJSON_GetObjectItem(object, DICT_VALUES);
     bool first = true;
 
+    // Replicate statistics and kinetic traces hold no single measurements, so they have no raw line
+    if (cJSON_GetObjectItem(object, DICT_REPLICATES) != NULL || cJSON_GetObjectItem(object, DICT_KINETIC) != NULL)
+    {
+        return;
+    }
+
+    fprintf_s(csv, "%s%c", oComment ? cJSON_GetStringValue(oComment) : "", options->delimiter);
+
     cJSON_ArrayForEach(iterator, oValues)
     {
         if(!first)
@@ -2,18 +2,226 @@
 // SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
 
 #include "cmdfwupdate.h"
+#include "evifanout.h"
+#include "evisrec.h"
 #include "printerror.h"
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-Error_t cmdFwUpdate(Evi_t *self, const char * file)
+typedef struct
+{
+    const char *name; // Serial number of the module with --all, otherwise NULL
+    int percent;
+    bool skipped;
+    char version[EVI_MAX_VALUE_LENGTH]; // Version the module reports after the update
+} FwProgress;
+
+// One line per call, so the lines of concurrent updates don't interleave
+static void cmdFwPrint(const FwProgress *p, const char *format, ...)
+{
+    char line[256];
+    int n = 0;
+    va_list args;
+
+    if (p->name != NULL)
+    {
+        n = snprintf(line, sizeof(line), "%s: ", p->name);
+    }
+    va_start(args, format);
+    vsnprintf(line + n, sizeof(line) - n, format, args);
+    va_end(args);
+    fputs(line, stderr);
+}
+
+// Prints a line per phase and per 10% of the records on stderr
+static void cmdFwProgress(EviFwPhase_t phase, size_t done, size_t total, void *user)
+{
+    FwProgress *p = (FwProgress *)user;
+    switch (phase)
+    {
+    case EVI_FW_PHASE_ERASE:
+        cmdFwPrint(p, "Erasing\n");
+        break;
+    case EVI_FW_PHASE_WRITE:
+    {
+        int percent = total > 0 ? (int)(done * 100 / total) : 100;
+        if (percent / 10 != p->percent / 10)
+        {
+            cmdFwPrint(p, "Writing %3d%% (%zu/%zu records)\n", percent, done, total);
+        }
+        p->percent = percent;
+        break;
+    }
+    case EVI_FW_PHASE_REBOOT:
+        cmdFwPrint(p, "Rebooting\n");
+        break;
+    case EVI_FW_PHASE_SKIP:
+        p->skipped = true;
+        cmdFwPrint(p, "The module already runs this version, use --force to flash anyway\n");
+        break;
+    }
+}
+
+// Parses the options in front of the file, jobs is NULL if --jobs is not allowed
+static Error_t cmdFwOptions(int argcCmd, char **argvCmd, EviFwOptions_t *options, size_t *jobs, const char **file)
+{
+    int i = 1;
+
+    options->force = false;
+    options->coalesce = false;
+    options->coalesceLength = 0;
+    while (i < argcCmd && strncmp(argvCmd[i], "-", 1) == 0)
+    {
+        if (strcmp(argvCmd[i], "--force") == 0)
+        {
+            options->force = true;
+        }
+        else if (strcmp(argvCmd[i], "--coalesce") == 0)
+        {
+            options->coalesce = true;
+        }
+        else if (strcmp(argvCmd[i], "--coalesce-length") == 0 && i + 1 < argcCmd)
+        {
+            char *endptr;
+            i++;
+            options->coalesce = true;
+            options->coalesceLength = strtoul(argvCmd[i], &endptr, 10);
+            if (*endptr != '\0' || argvCmd[i][0] == '-' || options->coalesceLength > EVI_SREC_MAX_RECORD_LENGTH)
+            {
+                return printError(ERROR_EVI_INVALID_NUMBER, "'%s' is not a valid record length (at most %d characters).\n", argvCmd[i], EVI_SREC_MAX_RECORD_LENGTH);
+            }
+        }
+        else if (strcmp(argvCmd[i], "--jobs") == 0 && jobs != NULL && i + 1 < argcCmd)
+        {
+            char *endptr;
+            i++;
+            *jobs = strtoul(argvCmd[i], &endptr, 10);
+            if (*endptr != '\0' || argvCmd[i][0] == '-')
+            {
+                return printError(ERROR_EVI_INVALID_NUMBER, "'%s' is not a valid number of jobs.\n", argvCmd[i]);
+            }
+        }
+        else
+        {
+            return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_OPTION, "Unknown option: %s\n", argvCmd[i]);
+        }
+        i++;
+    }
+    if (argcCmd - i != 1)
+    {
+        return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, NULL);
+    }
+    *file = argvCmd[i];
+    return ERROR_EVI_OK;
+}
+
+Error_t cmdFwUpdate(Evi_t *self, int argcCmd, char **argvCmd)
 {
     Error_t ret;
-    ret = eviFwUpdate(self, file);
+    FwProgress progress = {0};
+    EviFwOptions_t options = {.progress = cmdFwProgress, .user = &progress};
+    const char *file;
+
+    ret = cmdFwOptions(argcCmd, argvCmd, &options, NULL, &file);
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
 
+    ret = eviFwUpdateEx(self, file, &options);
     if (ret != ERROR_EVI_OK)
     {
         printError(ret, NULL);
     }
     return ret;
 }
+
+Error_t cmdFwUpdateAll(Evi_t *sessions, const EviDeviceInfo_t *devices, size_t count, Error_t *results, int argcCmd, char **argvCmd)
+{
+    Error_t ret;
+    EviFwOptions_t common = {0};
+    EviFwOptions_t *options = NULL;
+    FwProgress *progress = NULL;
+    EviSrecImage_t image;
+    size_t jobs = 0;
+    size_t line;
+    size_t updated = 0;
+    size_t mismatched = 0;
+    size_t skipped = 0;
+    const char *file;
+
+    ret = cmdFwOptions(argcCmd, argvCmd, &common, &jobs, &file);
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+
+    // The image is validated once, all modules get the same records
+    ret = eviSrecLoad(file, common.coalesce, common.coalesceLength, &image, &line);
+    if (ret != ERROR_EVI_OK)
+    {
+        if (line > 0)
+        {
+            fprintf(stderr, "%s:%zu: invalid record\n", file, line);
+        }
+        return printError(ret, NULL);
+    }
+    if (image.dataBytes == 0)
+    {
+        eviSrecFree(&image);
+        return printError(ERROR_EVI_SREC_INVALID_STRING, "%s: no data records\n", file);
+    }
+
+    options = calloc(count, sizeof(EviFwOptions_t));
+    progress = calloc(count, sizeof(FwProgress));
+    if (options == NULL || progress == NULL)
+    {
+        free(progress);
+        free(options);
+        eviSrecFree(&image);
+        return printError(ERROR_EVI_OUT_OF_MEMORY, NULL);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        progress[i].name = devices[i].serialNumber[0] ? devices[i].serialNumber : devices[i].port;
+        options[i] = common;
+        options[i].progress = cmdFwProgress;
+        options[i].user = &progress[i];
+        options[i].version = progress[i].version;
+        options[i].versionSize = sizeof(progress[i].version);
+    }
+
+    ret = eviFwUpdateAll(sessions, count, &image, options, jobs, results);
+
+    // The report lists every module with the version it reports, also the ones which failed
+    for (size_t i = 0; i < count; i++)
+    {
+        if (results[i] != ERROR_EVI_OK)
+        {
+            fprintf_s(stdout, "%s\tfailed\tError (%d): %s\n", progress[i].name, results[i], eviError2String(results[i]));
+        }
+        else if (progress[i].skipped)
+        {
+            fprintf_s(stdout, "%s\tskipped\t%s\n", progress[i].name, progress[i].version);
+            skipped++;
+        }
+        else if (image.version[0] != '\0' && strcmp(progress[i].version, image.version) != 0)
+        {
+            fprintf_s(stdout, "%s\tmismatch\t%s\n", progress[i].name, progress[i].version);
+            mismatched++;
+        }
+        else
+        {
+            fprintf_s(stdout, "%s\tupdated\t%s\n", progress[i].name, progress[i].version);
+            updated++;
+        }
+    }
+    fprintf_s(stderr, "%zu updated, %zu with another version, %zu skipped, %zu failed\n", updated, mismatched, skipped, count - updated - mismatched - skipped);
+
+    free(progress);
+    free(options);
+    eviSrecFree(&image);
+    return ret;
+}
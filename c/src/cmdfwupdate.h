@@ -5,4 +5,20 @@
 
 #include "evibase.h"
 
-Error_t cmdFwUpdate(Evi_t * self, const char * file);
+Error_t cmdFwUpdate(Evi_t * self, int argcCmd, char ** argvCmd);
+
+/**
+ * @brief Updates the firmware of all attached modules, see eviFwUpdateAll().
+ *
+ * Prints the progress of every module on stderr and one line per module with
+ * its serial number and the result on stdout.
+ *
+ * @param sessions One session per module.
+ * @param devices The modules of the sessions.
+ * @param count Number of modules.
+ * @param results Array of count results.
+ * @param argcCmd Number of command arguments.
+ * @param argvCmd Command arguments, starting with the command.
+ * @return Error code of the first module that failed.
+ */
+Error_t cmdFwUpdateAll(Evi_t * sessions, const EviDeviceInfo_t * devices, size_t count, Error_t * results, int argcCmd, char ** argvCmd);
@@ -6,33 +6,39 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-Error_t cmdGet(Evi_t *self, const char *sIndex)
+Error_t cmdGet(Evi_t *self, int count, char **sIndices)
 {
-    char value[EVI_MAX_LINE_LENGTH];
-    uint32_t valueSize = EVI_MAX_LINE_LENGTH;
-    char *endptr;
-    long index = strtol(sIndex, &endptr, 10);
+    EviValue_t *values = calloc(count, sizeof(EviValue_t));
+    Error_t ret = ERROR_EVI_OK;
 
-    Error_t ret;
-
-    if (*endptr == '\0')
+    for (int i = 0; i < count && ret == ERROR_EVI_OK; i++)
     {
-        ret = eviGet(self, index, value, valueSize);
-
-        if (ret == ERROR_EVI_OK)
-        {
-            fprintf_s(stdout, "%s\n", value);
-        }
-        else
+        char *endptr;
+        values[i].index = strtol(sIndices[i], &endptr, 10);
+        if (*endptr != '\0')
         {
-            printError(ret, NULL);
+            ret = ERROR_EVI_INVALID_NUMBER;
+            printError(ret, "'%s' is not a valid number.", sIndices[i]);
         }
     }
-    else
+
+    if (ret == ERROR_EVI_OK)
     {
-        ret = ERROR_EVI_INVALID_NUMBER;
-        printError(ret, "'%s' is not a valid number.", sIndex);
+        ret = eviGetMany(self, values, count);
+
+        for (int i = 0; i < count; i++)
+        {
+            if (values[i].result == ERROR_EVI_OK)
+            {
+                fprintf_s(stdout, "%s\n", values[i].value);
+            }
+            else
+            {
+                printError(values[i].result, NULL);
+            }
+        }
     }
 
+    free(values);
     return ret;
 }
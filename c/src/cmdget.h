@@ -5,4 +5,12 @@
 
 #include "evibase.h"
 
-Error_t cmdGet(Evi_t * self, const char * sIndex);
+/**
+ * @brief Handles the `get` CLI command, all indices are read in one pipelined exchange.
+ *
+ * @param self Runtime context with active device connection.
+ * @param count Number of indices.
+ * @param sIndices Indices as strings.
+ * @return Error code describing the result.
+ */
+Error_t cmdGet(Evi_t * self, int count, char ** sIndices);
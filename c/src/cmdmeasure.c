@@ -2,22 +2,157 @@
 // SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
 
 #include "cmdmeasure.h"
+#include "cmdsave.h"
+#include "evifluorkinetic.h"
+#include "eviparse.h"
+#include "json.h"
+#include "dict.h"
 #include "printerror.h"
+#include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 typedef enum
 {
     MEASUREMENT_TYPE_MEASURE,
     MEASUREMENT_TYPE_FIRST_AIR,
     MEASUREMENT_TYPE_FIRST_SAMPLE,
+    MEASUREMENT_TYPE_REPLICATES,
+    MEASUREMENT_TYPE_CONTINUOUS,
 } MeasurementType_t;
 
 typedef struct
 {
     MeasurementType_t measurementType;
+    uint32_t replicates;
+    double cvTarget;
+    EviFluorKineticOptions_t kinetic;
+    uint32_t durationS;
+    uint32_t bucketMs;
+    char * filename;
+    char * comment;
 } Options_t;
 
+static volatile sig_atomic_t interrupted = 0;
+
+static void measureInterrupt(int signal)
+{
+    interrupted = 1;
+}
+
+// Appends item as member key of a new entry to the JSON data file
+static void saveEntry(Evi_t * self, const Options_t * options, const char * key, cJSON * item)
+{
+    cJSON* json = dataLoadJson(self, options->filename, true);
+    cJSON* obj = cJSON_CreateObject();
+
+    if (options->comment != NULL)
+    {
+        cJSON_AddItemToObject(obj, DICT_COMMENT, cJSON_CreateString(options->comment));
+    }
+    cJSON_AddItemToObject(obj, key, item);
+    cJSON_AddItemToArray(cJSON_GetObjectItem(json, DICT_MEASUREMENTS), obj);
+    json_saveToFile(options->filename, json);
+    cJSON_Delete(json);
+}
+
+// Prints a bucket as "time count dark value ledPower delta-min delta-mean delta-max" and adds it to points
+static void measureBucket(const EviFluorBucket_t * bucket, cJSON * points)
+{
+    const Replicates_t * r = &bucket->replicates;
+    double timeS = bucket->timeUs / 1e6;
+
+    fprintf_s(stdout, "%.03f %u %.03f %.03f %u %.03f %.03f %.03f\n", timeS, r->dark.count, r->dark.mean, r->value.mean, r->ledPower, bucket->deltaMin, r->delta.mean, bucket->deltaMax);
+    fflush(stdout);
+
+    if (points != NULL)
+    {
+        cJSON* obj = cJSON_CreateObject();
+        cJSON* delta = cJSON_CreateObject();
+        cJSON_AddItemToObject(obj, DICT_TIME, cJSON_CreateNumber(timeS));
+        cJSON_AddItemToObject(obj, DICT_COUNT, cJSON_CreateNumber(r->dark.count));
+        cJSON_AddItemToObject(obj, DICT_DARK, cJSON_CreateNumber(r->dark.mean));
+        cJSON_AddItemToObject(obj, DICT_VALUE, cJSON_CreateNumber(r->value.mean));
+        cJSON_AddItemToObject(obj, DICT_LED_POWER, cJSON_CreateNumber(r->ledPower));
+        cJSON_AddItemToObject(delta, DICT_MIN, cJSON_CreateNumber(bucket->deltaMin));
+        cJSON_AddItemToObject(delta, DICT_MEAN, cJSON_CreateNumber(r->delta.mean));
+        cJSON_AddItemToObject(delta, DICT_MAX, cJSON_CreateNumber(bucket->deltaMax));
+        cJSON_AddItemToObject(obj, DICT_DELTA, delta);
+        cJSON_AddItemToArray(points, obj);
+    }
+}
+
+// Drains the acquisition until the count or duration is reached or Ctrl+C is pressed
+static Error_t measureContinuous(Evi_t * self, const Options_t * options)
+{
+    Error_t ret;
+    EviFluorKinetic_t * kinetic = (EviFluorKinetic_t *)malloc(sizeof(EviFluorKinetic_t));
+    EviFluorReading_t readings[32];
+    EviFluorBucket_t bucket = {0};
+    EviFluorBucket_t closed;
+    cJSON * points = options->filename != NULL ? cJSON_CreateArray() : NULL;
+    uint64_t endUs = eviMonotonicUs() + (uint64_t)options->durationS * 1000000;
+    bool stopped = false;
+
+    if (kinetic == NULL)
+    {
+        cJSON_Delete(points);
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+
+    interrupted = 0;
+    signal(SIGINT, measureInterrupt);
+
+    ret = eviFluorKineticStart(kinetic, self, &options->kinetic);
+    if (ret == ERROR_EVI_OK)
+    {
+        // Every reading is taken out of the ring, also after a stop or an error
+        // ended the acquisition; its result is only looked at afterwards.
+        while (!eviFluorKineticDone(kinetic))
+        {
+            size_t count = eviFluorKineticRead(kinetic, readings, sizeof(readings) / sizeof(readings[0]), 100);
+            for (size_t i = 0; i < count; i++)
+            {
+                if (eviFluorBucketAdd(&bucket, options->bucketMs, &readings[i], &closed))
+                {
+                    measureBucket(&closed, points);
+                }
+            }
+            if (!stopped && (interrupted || (options->durationS > 0 && eviMonotonicUs() >= endUs)))
+            {
+                ret = eviFluorKineticStop(kinetic);
+                stopped = true;
+            }
+        }
+        if (!stopped)
+        {
+            ret = eviFluorKineticStop(kinetic);
+        }
+    }
+    signal(SIGINT, SIG_DFL);
+
+    if (bucket.replicates.dark.count > 0)
+    {
+        measureBucket(&bucket, points);
+    }
+    if (kinetic->overruns > 0 || kinetic->errors > 0)
+    {
+        fprintf_s(stderr, "%zu readings dropped, %zu readings failed\n", kinetic->overruns, kinetic->errors);
+    }
+
+    if (points != NULL)
+    {
+        cJSON* obj = cJSON_CreateObject();
+        cJSON_AddItemToObject(obj, DICT_INTERVAL, cJSON_CreateNumber(options->kinetic.intervalMs));
+        cJSON_AddItemToObject(obj, DICT_BUCKET, cJSON_CreateNumber(options->bucketMs));
+        cJSON_AddItemToObject(obj, DICT_POINTS, points);
+        saveEntry(self, options, DICT_KINETIC, obj);
+    }
+    free(kinetic);
+    return ret;
+}
+
 Error_t cmdMeasure(Evi_t * self, int argcCmd, char** argvCmd)
 {
     Error_t ret  = ERROR_EVI_OK;
@@ -44,6 +179,73 @@ Error_t cmdMeasure(Evi_t * self, int argcCmd, char** argvCmd)
             {
                 options.measurementType = MEASUREMENT_TYPE_FIRST_SAMPLE;
             }
+            else if (strcmp(argvCmd[i], "--replicates") == 0 && i + 1 < argcCmd)
+            {
+                char *endptr;
+                i++;
+                options.measurementType = MEASUREMENT_TYPE_REPLICATES;
+                options.replicates = strtoul(argvCmd[i], &endptr, 10);
+                if (*endptr != '\0' || argvCmd[i][0] == '-' || options.replicates == 0)
+                {
+                    ret = printError(ERROR_EVI_INVALID_NUMBER, "'%s' is not a valid number of replicates.\n", argvCmd[i]);
+                    goto exit;
+                }
+            }
+            else if (strcmp(argvCmd[i], "--cv") == 0 && i + 1 < argcCmd)
+            {
+                char *endptr;
+                i++;
+                options.cvTarget = strtod(argvCmd[i], &endptr) / 100;
+                if (*endptr != '\0' || options.cvTarget <= 0)
+                {
+                    ret = printError(ERROR_EVI_INVALID_NUMBER, "'%s' is not a valid CV in percent.\n", argvCmd[i]);
+                    goto exit;
+                }
+            }
+            else if (strcmp(argvCmd[i], "--continuous") == 0)
+            {
+                options.measurementType = MEASUREMENT_TYPE_CONTINUOUS;
+            }
+            else if ((strcmp(argvCmd[i], "--interval") == 0 || strcmp(argvCmd[i], "--count") == 0 || strcmp(argvCmd[i], "--duration") == 0 ||
+                      strcmp(argvCmd[i], "--bucket") == 0 || strcmp(argvCmd[i], "--led-power") == 0) && i + 1 < argcCmd)
+            {
+                uint32_t value;
+                if (!eviParseUInt32(argvCmd[i + 1], &value))
+                {
+                    ret = printError(ERROR_EVI_INVALID_NUMBER, "'%s' is not a valid number for %s.\n", argvCmd[i + 1], argvCmd[i]);
+                    goto exit;
+                }
+                if (strcmp(argvCmd[i], "--interval") == 0)
+                {
+                    options.kinetic.intervalMs = value;
+                }
+                else if (strcmp(argvCmd[i], "--count") == 0)
+                {
+                    options.kinetic.count = value;
+                }
+                else if (strcmp(argvCmd[i], "--duration") == 0)
+                {
+                    options.durationS = value;
+                }
+                else if (strcmp(argvCmd[i], "--bucket") == 0)
+                {
+                    options.bucketMs = value;
+                }
+                else
+                {
+                    options.kinetic.setLedPower = true;
+                    options.kinetic.ledPower = value;
+                }
+                i++;
+            }
+            else if (strcmp(argvCmd[i], "--save") == 0 && i + 1 < argcCmd)
+            {
+                options.filename = argvCmd[++i];
+            }
+            else if (strcmp(argvCmd[i], "--comment") == 0 && i + 1 < argcCmd)
+            {
+                options.comment = argvCmd[++i];
+            }
             else
             {
                 ret = printError(ERROR_EVI_UNKOWN_COMMAND_LINE_OPTION, "Unknown option: %s\n", argvCmd[i]);
@@ -57,6 +259,22 @@ Error_t cmdMeasure(Evi_t * self, int argcCmd, char** argvCmd)
         }
     }
 
+    if (options.measurementType != MEASUREMENT_TYPE_REPLICATES && options.cvTarget > 0)
+    {
+        ret = printError(ERROR_EVI_UNKOWN_COMMAND_LINE_OPTION, "--cv needs --replicates\n");
+        goto exit;
+    }
+    if (options.measurementType != MEASUREMENT_TYPE_REPLICATES && options.measurementType != MEASUREMENT_TYPE_CONTINUOUS && (options.filename != NULL || options.comment != NULL))
+    {
+        ret = printError(ERROR_EVI_UNKOWN_COMMAND_LINE_OPTION, "--save and --comment need --replicates or --continuous\n");
+        goto exit;
+    }
+    if (options.measurementType != MEASUREMENT_TYPE_CONTINUOUS && (options.kinetic.intervalMs > 0 || options.kinetic.count > 0 || options.durationS > 0 || options.bucketMs > 0 || options.kinetic.setLedPower))
+    {
+        ret = printError(ERROR_EVI_UNKOWN_COMMAND_LINE_OPTION, "--interval, --count, --duration, --bucket and --led-power need --continuous\n");
+        goto exit;
+    }
+
     switch(options.measurementType)
     {
         case MEASUREMENT_TYPE_MEASURE:
@@ -77,8 +295,61 @@ Error_t cmdMeasure(Evi_t * self, int argcCmd, char** argvCmd)
         case MEASUREMENT_TYPE_FIRST_AIR:
         {
             MeasurementFirstAir_t measurement;
-            ret = eviFluorMeasureFirstAir(self, &measurement);
-            fprintf_s(stdout, "%.03f %.03f %d %.03f %.03f %d\n", measurement.min.channel470.dark, measurement.min.channel470.value, measurement.min.channel470.ledPower, measurement.max.channel470.dark, measurement.max.channel470.value, measurement.max.channel470.ledPower);
+            Error_t results[EVI_FLUOR_FIRST_AIR_STEPS];
+            ret = eviFluorMeasureFirstAirEx(self, &measurement, results);
+            if (ret == ERROR_EVI_OK)
+            {
+                fprintf_s(stdout, "%.03f %.03f %d %.03f %.03f %d\n", measurement.min.channel470.dark, measurement.min.channel470.value, measurement.min.channel470.ledPower, measurement.max.channel470.dark, measurement.max.channel470.value, measurement.max.channel470.ledPower);
+            }
+            else
+            {
+                for (int step = 0; step < EVI_FLUOR_FIRST_AIR_STEPS; step++)
+                {
+                    if (results[step] != ERROR_EVI_OK)
+                    {
+                        fprintf_s(stderr, "Failed %s: %s\n", eviFluorFirstAirStep2String((EviFluorFirstAirStep_t)step), eviError2String(results[step]));
+                    }
+                    // Without the limits nothing else was sent
+                    if (step == EVI_FLUOR_FIRST_AIR_LIMITS && results[step] != ERROR_EVI_OK)
+                    {
+                        break;
+                    }
+                }
+                printError(ret, NULL);
+            }
+        }
+        break;
+
+        case MEASUREMENT_TYPE_REPLICATES:
+        {
+            Replicates_t replicates;
+            ret = eviFluorMeasureReplicates(self, options.replicates, options.cvTarget, &replicates);
+            if (ret == ERROR_EVI_OK)
+            {
+                replicates_print(&replicates, stdout);
+                if (options.cvTarget > 0 && runningStatistic_cv(&replicates.delta) > options.cvTarget)
+                {
+                    fprintf_s(stderr, "The CV target of %.02f%% was not met with %u readings\n", 100 * options.cvTarget, options.replicates);
+                }
+                if (options.filename != NULL)
+                {
+                    saveEntry(self, &options, DICT_REPLICATES, replicates_toJson(&replicates));
+                }
+            }
+            else
+            {
+                printError(ret, NULL);
+            }
+        }
+        break;
+
+        case MEASUREMENT_TYPE_CONTINUOUS:
+        {
+            ret = measureContinuous(self, &options);
+            if (ret != ERROR_EVI_OK)
+            {
+                printError(ret, NULL);
+            }
         }
         break;
 
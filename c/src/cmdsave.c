@@ -3,7 +3,6 @@
 
 #include "cmdsave.h"
 #include "commonindex.h"
-#include "evifluorindex.h"
 #include "cJSON.h"
 #include "json.h"
 #include "dict.h"
@@ -21,29 +20,26 @@ typedef struct
     char * comment;
 } Options_t;
 
-static cJSON * singleMeasurement(Evi_t* self, int index)
+static Error_t addMeasurement(Evi_t* self, Options_t * options, cJSON* json)
 {
-    Error_t  ret = ERROR_EVI_OK;
-    SingleMeasurement_t measurement;
+    Error_t ret = ERROR_EVI_OK;
+    SingleMeasurement_t measurements[EVI_FLUOR_MAX_STORED_MEASUREMENTS];
+    size_t count;
+    size_t stored;
 
-    ret = eviFluorLastMeasurements(self, index, &measurement);
-    if (ret == ERROR_EVI_OK)
+    cJSON* oMeasurements = cJSON_GetObjectItem(json, DICT_MEASUREMENTS);
+
+    // The count and all stored measurements are read in one exchange
+    ret = eviFluorStoredMeasurements(self, measurements, EVI_FLUOR_MAX_STORED_MEASUREMENTS, &count, &stored);
+    if (ret != ERROR_EVI_OK)
     {
-        return singleMeasurement_toJson(&measurement);
+        printError(ret, "Could not read the stored measurements");
+        return ret;
     }
-    else
+    if (stored > count)
     {
-        printError(ret, "Could not read measurement");
-        return NULL;
+        fprintf_s(stderr, "Warning: the module reports %zu stored measurements, only the last %zu are saved.\n", stored, count);
     }
-}
-
-static Error_t addMeasurement(Evi_t* self, Options_t * options, cJSON* json)
-{
-    Error_t ret = ERROR_EVI_OK;
-    char    value[20];
-
-    cJSON* oMeasurements = cJSON_GetObjectItem(json, DICT_MEASUREMENTS);
 
     cJSON* obj = cJSON_CreateObject();
 
@@ -52,26 +48,17 @@ static Error_t addMeasurement(Evi_t* self, Options_t * options, cJSON* json)
         cJSON_AddItemToObject(obj, DICT_COMMENT, cJSON_CreateString(options->comment));
     }
 
-    ret = eviGet(self, INDEX_LASTMEASUREMENTCOUNT, value, sizeof(value));
-    if (ret != ERROR_EVI_OK)
+    if(count == 2 && options->raw == false)
     {
-        printError(ret, "Could not read measurement count");
-        return ret;
-    }
-
-    int lastMeasurementsCount = atoi(value);
-
-    if(lastMeasurementsCount == 2 && options->raw == false)
-    {
-        cJSON_AddItemToObject(obj, DICT_AIR, singleMeasurement(self, 1));
-        cJSON_AddItemToObject(obj, DICT_SAMPLE, singleMeasurement(self, 0));
+        cJSON_AddItemToObject(obj, DICT_AIR, singleMeasurement_toJson(&measurements[1]));
+        cJSON_AddItemToObject(obj, DICT_SAMPLE, singleMeasurement_toJson(&measurements[0]));
     }
     else
     {
         cJSON* arr = cJSON_CreateArray();
-        for(int i = lastMeasurementsCount-1; i>=0; i--)
+        for(size_t i = count; i > 0; i--)
         {
-            cJSON_AddItemToArray(arr, singleMeasurement(self, i));
+            cJSON_AddItemToArray(arr, singleMeasurement_toJson(&measurements[i - 1]));
         }
         cJSON_AddItemToObject(obj, DICT_VALUES, arr);
     }
@@ -92,21 +79,20 @@ cJSON* dataLoadJson(Evi_t* self, const char * filename, bool append)
     // create new JSON file
     if (json == NULL)
     {
-        Error_t ret = ERROR_EVI_OK;
-        char    value[100];
+        EviValue_t values[] = { { .index = INDEX_SERIALNUMBER }, { .index = INDEX_VERSION } };
 
         json = cJSON_CreateObject();
 
-        ret = eviGet(self, INDEX_SERIALNUMBER, value, sizeof(value));
-        if (ret == ERROR_EVI_OK)
+        eviGetMany(self, values, sizeof(values) / sizeof(values[0]));
+
+        if (values[0].result == ERROR_EVI_OK)
         {
-            cJSON_AddItemToObject(json, DICT_SERIALNUMBER, cJSON_CreateString(value));
+            cJSON_AddItemToObject(json, DICT_SERIALNUMBER, cJSON_CreateString(values[0].value));
         }
 
-        ret = eviGet(self, INDEX_VERSION, value, sizeof(value));
-        if (ret == ERROR_EVI_OK)
+        if (values[1].result == ERROR_EVI_OK)
         {
-            cJSON_AddItemToObject(json, DICT_FIRMWAREVERSION, cJSON_CreateString(value));
+            cJSON_AddItemToObject(json, DICT_FIRMWAREVERSION, cJSON_CreateString(values[1].value));
         }
 
         cJSON_AddItemToObject(json, DICT_MEASUREMENTS, cJSON_CreateArray());
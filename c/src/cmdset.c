@@ -6,25 +6,37 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-Error_t cmdSet(Evi_t *self, const char *sIndex, const char *sValue)
+Error_t cmdSet(Evi_t *self, int count, char **sIndicesValues)
 {
-    char *endptr;
-    long index = strtol(sIndex, &endptr, 10);
-    Error_t ret;
+    EviValue_t *values = calloc(count, sizeof(EviValue_t));
+    Error_t ret = ERROR_EVI_OK;
 
-    if (*endptr == '\0')
+    for (int i = 0; i < count && ret == ERROR_EVI_OK; i++)
     {
-        ret = eviSet(self, index, sValue);
-
-        if (ret != ERROR_EVI_OK)
+        char *endptr;
+        const char *sIndex = sIndicesValues[2 * i];
+        values[i].index = strtol(sIndex, &endptr, 10);
+        strcpy_s(values[i].value, sizeof(values[i].value), sIndicesValues[2 * i + 1]);
+        if (*endptr != '\0')
         {
-            printError(ret, NULL);
+            ret = ERROR_EVI_INVALID_NUMBER;
+            printError(ret, "'%s' is not a valid number.", sIndex);
         }
     }
-    else
+
+    if (ret == ERROR_EVI_OK)
     {
-        ret = ERROR_EVI_INVALID_NUMBER;
-        printError(ret, "'%s' is not a valid number.", sIndex);
+        ret = eviSetMany(self, values, count);
+
+        for (int i = 0; i < count; i++)
+        {
+            if (values[i].result != ERROR_EVI_OK)
+            {
+                printError(values[i].result, NULL);
+            }
+        }
     }
+
+    free(values);
     return ret;
 }
@@ -5,4 +5,12 @@
 
 #include "evibase.h"
 
-Error_t cmdSet(Evi_t * self, const char * sIndex, const char * sValue);
+/**
+ * @brief Handles the `set` CLI command, all values are written in one pipelined exchange.
+ *
+ * @param self Runtime context with active device connection.
+ * @param count Number of index/value pairs.
+ * @param sIndicesValues Index/value pairs as strings.
+ * @return Error code describing the result.
+ */
+Error_t cmdSet(Evi_t * self, int count, char ** sIndicesValues);
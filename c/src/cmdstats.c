@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "cmdstats.h"
+#include "commonindex.h"
+#include "printerror.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#define STATS_PROBE_COUNT 100
+
+void cmdPrintStats(FILE *stream, const EviStats_t *stats)
+{
+    size_t first = EVI_STATS_LATENCY_BUCKETS;
+    size_t last = 0;
+
+    fprintf_s(stream, "commands        %llu\n", (unsigned long long)stats->commands);
+    fprintf_s(stream, "responses       %llu\n", (unsigned long long)stats->responses);
+    fprintf_s(stream, "bytes tx        %llu\n", (unsigned long long)stats->bytesTx);
+    fprintf_s(stream, "bytes rx        %llu\n", (unsigned long long)stats->bytesRx);
+    fprintf_s(stream, "round trips     %llu\n", (unsigned long long)stats->roundTrips);
+    fprintf_s(stream, "crc errors      %llu\n", (unsigned long long)stats->crcErrors);
+    fprintf_s(stream, "write errors    %llu\n", (unsigned long long)stats->writeErrors);
+    fprintf_s(stream, "timeouts        %llu\n", (unsigned long long)stats->timeouts);
+    fprintf_s(stream, "disconnects     %llu\n", (unsigned long long)stats->disconnects);
+    fprintf_s(stream, "retries         %llu\n", (unsigned long long)stats->retries);
+    fprintf_s(stream, "device errors   %llu\n", (unsigned long long)stats->deviceErrors);
+    if (stats->latencyCount == 0)
+    {
+        return;
+    }
+    fprintf_s(stream, "latency mean    %.3f ms\n", (double)stats->latencySumUs / stats->latencyCount / 1000.0);
+    fprintf_s(stream, "latency max     %.3f ms\n", stats->latencyMaxUs / 1000.0);
+
+    // Only the range of buckets which counted something
+    for (size_t i = 0; i < EVI_STATS_LATENCY_BUCKETS; i++)
+    {
+        if (stats->latency[i] > 0)
+        {
+            first = first < i ? first : i;
+            last = i;
+        }
+    }
+    for (size_t i = first; i <= last; i++)
+    {
+        char label[32];
+        uint64_t limit = eviStatsBucketLimitUs(i);
+        if (limit == UINT64_MAX)
+        {
+            snprintf(label, sizeof(label), "latency >= %g ms", eviStatsBucketLimitUs(i - 1) / 1000.0);
+        }
+        else
+        {
+            snprintf(label, sizeof(label), "latency < %g ms", limit / 1000.0);
+        }
+        fprintf_s(stream, "%-20s%llu\n", label, (unsigned long long)stats->latency[i]);
+    }
+}
+
+Error_t cmdStats(Evi_t *self, int argcCmd, char **argvCmd)
+{
+    Error_t ret = ERROR_EVI_OK;
+    unsigned long count = STATS_PROBE_COUNT;
+    unsigned long failed = 0;
+    char value[EVI_MAX_VALUE_LENGTH];
+    EviStats_t stats;
+
+    if (argcCmd == 2)
+    {
+        char *endptr;
+        count = strtoul(argvCmd[1], &endptr, 10);
+        if (*endptr != '\0' || count == 0)
+        {
+            return printError(ERROR_EVI_INVALID_NUMBER, "'%s' is not a valid number.", argvCmd[1]);
+        }
+    }
+    else if (argcCmd > 2)
+    {
+        return printError(ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT, NULL);
+    }
+
+    // Every read waits for its answer, so the latencies are those of the link and the firmware.
+    // A failed read is counted and the probe goes on, only a missing module ends it.
+    for (unsigned long i = 0; i < count; i++)
+    {
+        Error_t e = eviGetUncached(self, INDEX_VERSION, value, sizeof(value));
+        if (e != ERROR_EVI_OK)
+        {
+            failed++;
+            ret = ret != ERROR_EVI_OK ? ret : e;
+            if (e == ERROR_EVI_INSTRUMENT_NOT_FOUND)
+            {
+                break;
+            }
+        }
+    }
+    if (ret != ERROR_EVI_OK)
+    {
+        printError(ret, NULL);
+    }
+
+    eviGetStats(self, &stats);
+    fprintf_s(stdout, "failed reads    %lu\n", failed);
+    cmdPrintStats(stdout, &stats);
+    return ret;
+}
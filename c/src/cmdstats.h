@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @brief Prints the link counters of a session, one per line.
+ *
+ * @param stream Stream for the counters.
+ * @param stats The counters, see eviGetStats().
+ */
+void cmdPrintStats(FILE * stream, const EviStats_t * stats);
+
+/**
+ * @brief Handles the `stats` CLI command that probes the link with COUNT version reads.
+ *
+ * @param self Runtime context of the module.
+ * @param argcCmd Number of command arguments.
+ * @param argvCmd Command arguments, starting with the command.
+ * @return Error code describing the operation outcome.
+ */
+Error_t cmdStats(Evi_t * self, int argcCmd, char ** argvCmd);
@@ -29,6 +29,9 @@ typedef enum Errors
     ERROR_EVI_INVALID_NUMBER                        = 55, //|  -  |  -  |  x    |
     ERROR_EVI_FILE_IO_ERROR                         = 56, //|  -  |  -  |  x    |
     ERROR_EVI_CUVETTE_GUIDE_NOT_EMPTY               = 57, //|  -  |  -  |  x    |
+    ERROR_EVI_QUEUE_FULL                            = 58, //|  -  |  -  |  x    |
+    ERROR_EVI_THREAD_ERROR                          = 59, //|  -  |  -  |  x    |
+    ERROR_EVI_OUT_OF_MEMORY                         = 60, //|  -  |  -  |  x    |
     
     ERROR_EVI_USER                                  = 100,//|     |     |       |
 } Error_t;
@@ -12,6 +12,7 @@
  *  - XorOut        = 0x0000
  *  - ReflectOut    = False
  *  - Algorithm     = table-driven
+ *  - TableIdxWidth = 8
  *
  * This file defines the functions crc_init(), crc_update() and crc_finalize().
  *
@@ -87,6 +88,25 @@ static inline crc_t crc_init(void)
 crc_t crc_update(crc_t crc, const void *data, size_t data_len);
 
 
+/**
+ * Lookup table of crc_update_byte(), one entry per byte value.
+ */
+extern const crc_t crc_table[256];
+
+
+/**
+ * Update the crc value with one byte, e.g. while a frame is received.
+ *
+ * \param[in] crc  The current crc value.
+ * \param[in] c    The next byte.
+ * \return     The updated crc value.
+ */
+static inline crc_t crc_update_byte(crc_t crc, unsigned char c)
+{
+    return (crc_table[((crc >> 8) ^ c) & 0xff] ^ (crc << 8)) & 0xffff;
+}
+
+
 /**
  * Calculate the final crc value.
  *
@@ -35,3 +35,20 @@
 /** @name Calculated result fields */
 #define DICT_CALCULATED      "results"       /**< Root node for calculated values. */
 #define DICT_CONCENTRATION   "concentration" /**< Calculated concentration entry. */
+
+/** @name Replicate statistics */
+#define DICT_REPLICATES      "replicates" /**< Statistics of replicate readings. */
+#define DICT_COUNT           "count"      /**< Number of readings. */
+#define DICT_MEAN            "mean"       /**< Mean of the readings. */
+#define DICT_SD              "sd"         /**< Sample standard deviation. */
+#define DICT_CV              "cv"         /**< Coefficient of variation as a fraction. */
+#define DICT_DELTA           "delta"      /**< Value minus dark of each reading. */
+
+/** @name Kinetic traces */
+#define DICT_KINETIC         "kinetic"  /**< Trace of a continuous acquisition. */
+#define DICT_INTERVAL        "interval" /**< Target interval between readings in ms. */
+#define DICT_BUCKET          "bucket"   /**< Length of a bucket in ms, 0 for single readings. */
+#define DICT_POINTS          "points"   /**< One entry per bucket. */
+#define DICT_TIME            "time"     /**< First reading of the bucket in s since the start. */
+#define DICT_MIN             "min"      /**< Smallest reading. */
+#define DICT_MAX             "max"      /**< Largest reading. */
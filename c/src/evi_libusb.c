@@ -0,0 +1,386 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evitransport.h"
+#include <stdio.h>
+
+#ifdef EVI_WITH_LIBUSB
+
+#include "eviconfig.h"
+#include <libusb.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EVI_USB_TRANSFER_SIZE 512
+#define EVI_USB_PENDING_SIZE 4096
+#define EVI_USB_CONTROL_TIMEOUT_MS 1000
+#define EVI_USB_WRITE_TIMEOUT_MS 1000
+
+// CDC class requests, see USB CDC PSTN subclass specification
+#define CDC_SET_LINE_CODING 0x20
+#define CDC_SET_CONTROL_LINE_STATE 0x22
+#define CDC_CONTROL_LINE_DTR 0x01
+#define CDC_CONTROL_LINE_RTS 0x02
+
+typedef struct
+{
+    libusb_context *context;
+    libusb_device_handle *handle;
+    int controlInterface;
+    int dataInterface;
+    unsigned char endpointIn;
+    unsigned char endpointOut;
+    struct libusb_transfer *transfer;
+    unsigned char transferBuffer[EVI_USB_TRANSFER_SIZE];
+    char pending[EVI_USB_PENDING_SIZE];
+    size_t pendingLength;
+    char serialNumber[EVI_MAX_SERIAL_NUMBER_LENGTH];
+    bool posted;
+    bool gone;
+    bool verbose;
+} EviUsb_t;
+
+static bool eviUsbPost(EviUsb_t *usb)
+{
+    int ret = libusb_submit_transfer(usb->transfer);
+    if (ret != LIBUSB_SUCCESS)
+    {
+        if (usb->verbose)
+        {
+            fprintf(stderr, "USB: could not post transfer: %s\n", libusb_error_name(ret));
+        }
+        usb->gone = (ret == LIBUSB_ERROR_NO_DEVICE);
+        return false;
+    }
+    usb->posted = true;
+    return true;
+}
+
+static void LIBUSB_CALL eviUsbReceived(struct libusb_transfer *transfer)
+{
+    EviUsb_t *usb = (EviUsb_t *)transfer->user_data;
+    usb->posted = false;
+
+    switch (transfer->status)
+    {
+    case LIBUSB_TRANSFER_COMPLETED:
+    {
+        size_t length = transfer->actual_length;
+        if (length > EVI_USB_PENDING_SIZE - usb->pendingLength)
+        {
+            length = EVI_USB_PENDING_SIZE - usb->pendingLength;
+        }
+        memcpy(usb->pending + usb->pendingLength, transfer->buffer, length);
+        usb->pendingLength += length;
+
+        // Keep a read posted as long as a full transfer still fits, eviUsbRead() reposts otherwise
+        if (EVI_USB_PENDING_SIZE - usb->pendingLength >= EVI_USB_TRANSFER_SIZE)
+        {
+            eviUsbPost(usb);
+        }
+        break;
+    }
+    case LIBUSB_TRANSFER_CANCELLED:
+        break;
+    case LIBUSB_TRANSFER_NO_DEVICE:
+    case LIBUSB_TRANSFER_ERROR:
+        usb->gone = true;
+        break;
+    default:
+        // Timed out, stalled or overflow, try again
+        eviUsbPost(usb);
+        break;
+    }
+}
+
+static bool eviUsbFindInterfaces(EviUsb_t *usb, libusb_device *device)
+{
+    struct libusb_config_descriptor *config;
+    bool found = false;
+
+    usb->controlInterface = -1;
+    usb->dataInterface = -1;
+
+    if (libusb_get_active_config_descriptor(device, &config) != LIBUSB_SUCCESS)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < config->bNumInterfaces; i++)
+    {
+        const struct libusb_interface_descriptor *interface = &config->interface[i].altsetting[0];
+        if (interface->bInterfaceClass == LIBUSB_CLASS_COMM && usb->controlInterface == -1)
+        {
+            usb->controlInterface = interface->bInterfaceNumber;
+        }
+        else if (interface->bInterfaceClass == LIBUSB_CLASS_DATA && usb->dataInterface == -1)
+        {
+            usb->endpointIn = 0;
+            usb->endpointOut = 0;
+            for (int e = 0; e < interface->bNumEndpoints; e++)
+            {
+                const struct libusb_endpoint_descriptor *endpoint = &interface->endpoint[e];
+                if ((endpoint->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) == LIBUSB_TRANSFER_TYPE_BULK)
+                {
+                    if (endpoint->bEndpointAddress & LIBUSB_ENDPOINT_IN)
+                    {
+                        usb->endpointIn = endpoint->bEndpointAddress;
+                    }
+                    else
+                    {
+                        usb->endpointOut = endpoint->bEndpointAddress;
+                    }
+                }
+            }
+            if (usb->endpointIn != 0 && usb->endpointOut != 0)
+            {
+                usb->dataInterface = interface->bInterfaceNumber;
+            }
+        }
+    }
+    found = usb->dataInterface != -1;
+
+    libusb_free_config_descriptor(config);
+    return found;
+}
+
+static libusb_device_handle *eviUsbOpenDevice(EviUsb_t *usb, const char *serialNumber)
+{
+    libusb_device **list;
+    libusb_device_handle *handle = NULL;
+    ssize_t count = libusb_get_device_list(usb->context, &list);
+
+    for (ssize_t i = 0; i < count && handle == NULL; i++)
+    {
+        struct libusb_device_descriptor descriptor;
+        char serial[EVI_MAX_SERIAL_NUMBER_LENGTH] = {0};
+
+        if (libusb_get_device_descriptor(list[i], &descriptor) != LIBUSB_SUCCESS ||
+            descriptor.idVendor != EVI_COMMON_VID || descriptor.idProduct != EVI_COMMON_PID)
+        {
+            continue;
+        }
+
+        if (libusb_open(list[i], &handle) != LIBUSB_SUCCESS)
+        {
+            handle = NULL;
+            continue;
+        }
+
+        if (descriptor.iSerialNumber != 0)
+        {
+            libusb_get_string_descriptor_ascii(handle, descriptor.iSerialNumber, (unsigned char *)serial, sizeof(serial));
+        }
+
+        if ((serialNumber != NULL && strcmp(serialNumber, serial) != 0) || !eviUsbFindInterfaces(usb, list[i]))
+        {
+            libusb_close(handle);
+            handle = NULL;
+            continue;
+        }
+
+        strcpy_s(usb->serialNumber, sizeof(usb->serialNumber), serial);
+        if (usb->verbose)
+        {
+            fprintf(stderr, "DEVICE: usb %s, interfaces %d/%d, endpoints 0x%02x/0x%02x\n", serial, usb->controlInterface, usb->dataInterface, usb->endpointIn, usb->endpointOut);
+        }
+    }
+
+    if (count >= 0)
+    {
+        libusb_free_device_list(list, 1);
+    }
+    return handle;
+}
+
+static void eviUsbSetLineState(EviUsb_t *usb)
+{
+    // 115200 baud 8N1, CDC ACM firmware usually ignores it but some hosts expect it
+    unsigned char lineCoding[7] = {0x00, 0xc2, 0x01, 0x00, 0, 0, 8};
+    int interface = usb->controlInterface != -1 ? usb->controlInterface : usb->dataInterface;
+
+    libusb_control_transfer(usb->handle, LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE | LIBUSB_ENDPOINT_OUT,
+                            CDC_SET_LINE_CODING, 0, interface, lineCoding, sizeof(lineCoding), EVI_USB_CONTROL_TIMEOUT_MS);
+    libusb_control_transfer(usb->handle, LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE | LIBUSB_ENDPOINT_OUT,
+                            CDC_SET_CONTROL_LINE_STATE, CDC_CONTROL_LINE_DTR | CDC_CONTROL_LINE_RTS, interface, NULL, 0, EVI_USB_CONTROL_TIMEOUT_MS);
+}
+
+static void eviUsbClose(void *connection);
+
+static void *eviUsbOpen(const char *serialNumber, void *user, bool verbose)
+{
+    EviUsb_t *usb = (EviUsb_t *)calloc(1, sizeof(EviUsb_t));
+    if (usb == NULL)
+    {
+        return NULL;
+    }
+    usb->verbose = verbose;
+
+    if (libusb_init(&usb->context) != LIBUSB_SUCCESS)
+    {
+        fprintf(stderr, "Could not initialize libusb\n");
+        free(usb);
+        return NULL;
+    }
+
+    usb->handle = eviUsbOpenDevice(usb, serialNumber[0] != 0 ? serialNumber : NULL);
+    if (usb->handle == NULL)
+    {
+        fprintf(stderr, "Could not open USB device %s\n", serialNumber);
+        libusb_exit(usb->context);
+        free(usb);
+        return NULL;
+    }
+
+    // The kernel's cdc_acm driver owns the interfaces while the tty exists
+    libusb_set_auto_detach_kernel_driver(usb->handle, 1);
+    if ((usb->controlInterface != -1 && libusb_claim_interface(usb->handle, usb->controlInterface) != LIBUSB_SUCCESS) ||
+        libusb_claim_interface(usb->handle, usb->dataInterface) != LIBUSB_SUCCESS)
+    {
+        fprintf(stderr, "Could not claim USB interfaces\n");
+        eviUsbClose(usb);
+        return NULL;
+    }
+    eviUsbSetLineState(usb);
+
+    usb->transfer = libusb_alloc_transfer(0);
+    if (usb->transfer == NULL)
+    {
+        eviUsbClose(usb);
+        return NULL;
+    }
+    libusb_fill_bulk_transfer(usb->transfer, usb->handle, usb->endpointIn, usb->transferBuffer, sizeof(usb->transferBuffer), eviUsbReceived, usb, 0);
+    if (!eviUsbPost(usb))
+    {
+        eviUsbClose(usb);
+        return NULL;
+    }
+    return usb;
+}
+
+static void eviUsbClose(void *connection)
+{
+    EviUsb_t *usb = (EviUsb_t *)connection;
+
+    if (usb->transfer)
+    {
+        if (usb->posted && libusb_cancel_transfer(usb->transfer) == LIBUSB_SUCCESS)
+        {
+            struct timeval tv = {0, 100000};
+            while (usb->posted)
+            {
+                if (libusb_handle_events_timeout_completed(usb->context, &tv, NULL) != LIBUSB_SUCCESS)
+                {
+                    break;
+                }
+            }
+        }
+        libusb_free_transfer(usb->transfer);
+    }
+    if (usb->handle)
+    {
+        if (usb->dataInterface != -1)
+        {
+            libusb_release_interface(usb->handle, usb->dataInterface);
+        }
+        if (usb->controlInterface != -1)
+        {
+            libusb_release_interface(usb->handle, usb->controlInterface);
+        }
+        libusb_close(usb->handle);
+    }
+    libusb_exit(usb->context);
+    free(usb);
+}
+
+static bool eviUsbWrite(void *connection, const char *data, size_t size)
+{
+    EviUsb_t *usb = (EviUsb_t *)connection;
+    int transferred = 0;
+    int ret = libusb_bulk_transfer(usb->handle, usb->endpointOut, (unsigned char *)data, (int)size, &transferred, EVI_USB_WRITE_TIMEOUT_MS);
+    if (ret != LIBUSB_SUCCESS || (size_t)transferred != size)
+    {
+        fprintf(stderr, "Could not write to USB device: %s\n", libusb_error_name(ret));
+        usb->gone = (ret == LIBUSB_ERROR_NO_DEVICE);
+        return false;
+    }
+    return true;
+}
+
+static int eviUsbPoll(void *connection, uint32_t timeoutMs)
+{
+    EviUsb_t *usb = (EviUsb_t *)connection;
+    uint64_t deadline = eviMonotonicMs() + timeoutMs;
+
+    while (usb->pendingLength == 0 && !usb->gone)
+    {
+        uint64_t now = eviMonotonicMs();
+        if (now >= deadline)
+        {
+            return 0;
+        }
+        if (!usb->posted && !eviUsbPost(usb))
+        {
+            return -1;
+        }
+
+        struct timeval tv = {(time_t)((deadline - now) / 1000), (suseconds_t)(((deadline - now) % 1000) * 1000)};
+        int ret = libusb_handle_events_timeout_completed(usb->context, &tv, NULL);
+        if (ret != LIBUSB_SUCCESS && ret != LIBUSB_ERROR_INTERRUPTED)
+        {
+            return -1;
+        }
+    }
+    return usb->pendingLength > 0 ? 1 : -1;
+}
+
+static int eviUsbRead(void *connection, char *data, size_t size)
+{
+    EviUsb_t *usb = (EviUsb_t *)connection;
+    size_t length = usb->pendingLength < size ? usb->pendingLength : size;
+
+    if (length == 0)
+    {
+        return usb->gone ? -1 : 0;
+    }
+    memcpy(data, usb->pending, length);
+    memmove(usb->pending, usb->pending + length, usb->pendingLength - length);
+    usb->pendingLength -= length;
+
+    if (!usb->posted && !usb->gone)
+    {
+        eviUsbPost(usb);
+    }
+    return (int)length;
+}
+
+static bool eviUsbSerialNumber(void *connection, char *serialNumber, size_t size)
+{
+    strcpy_s(serialNumber, size, ((EviUsb_t *)connection)->serialNumber);
+    return true;
+}
+
+const EviTransport_t eviTransportUsb = {
+    .name         = "usb",
+    .open         = eviUsbOpen,
+    .close        = eviUsbClose,
+    .write        = eviUsbWrite,
+    .poll         = eviUsbPoll,
+    .read         = eviUsbRead,
+    .serialNumber = eviUsbSerialNumber,
+};
+
+#else
+
+static void *eviUsbOpen(const char *serialNumber, void *user, bool verbose)
+{
+    fprintf(stderr, "USB transport not available, the library was built without libusb\n");
+    return NULL;
+}
+
+const EviTransport_t eviTransportUsb = {
+    .name = "usb",
+    .open = eviUsbOpen,
+};
+
+#endif
@@ -3,14 +3,18 @@
 
 #include "evibase.h"
 #include "eviconfig.h"
-#include "crc-16-ccitt.h"
+#include "evitransport.h"
 #include <stdio.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <termios.h>
+#include <poll.h>
+#include <time.h>
 #include <dirent.h>
+#include <stdlib.h>
 #include <sys/socket.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -54,7 +58,8 @@ int findTty(const char * name, int maxDepth, int currentDepth, char * devicePath
 
     while ((entry = readdir(dir)) != NULL && ret != 0)
     {
-        if (entry->d_type == DT_DIR || entry->d_type == DT_LNK)
+        // Only descend into real directories, links like 'driver' or 'subsystem' lead to other devices.
+        if (entry->d_type == DT_DIR)
         {
             char path[1024] = {0};
             if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
@@ -98,9 +103,27 @@ int getDeviceVidPid(const char *dev_path, uint16_t *vid, uint16_t *pid)
     return 0;
 }
 
-int listDir(const char *name, int maxDepth, int currentDepth, char * devicePath, int devicePathLength)
+int getDeviceSerialNumber(const char *dev_path, char *serialNumber, size_t serialNumberSize)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/serial", dev_path);
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    if (fgets(serialNumber, serialNumberSize, f) == NULL)
+    {
+        serialNumber[0] = 0;
+    }
+    serialNumber[strcspn(serialNumber, "\r\n")] = 0;
+    fclose(f);
+
+    return 0;
+}
+
+int listDir(const char *name, int maxDepth, int currentDepth, EviDeviceInfo_t *devices, size_t maxDevices, size_t *count)
 {
-    int ret = -1;
     DIR *dir;
     struct dirent *entry;
 
@@ -110,7 +133,7 @@ int listDir(const char *name, int maxDepth, int currentDepth, char * devicePath,
     if (!(dir = opendir(name)))
         return -1;
 
-    while ((entry = readdir(dir)) != NULL && ret != 0)
+    while ((entry = readdir(dir)) != NULL && *count < maxDevices)
     {
         if (entry->d_type == DT_DIR || entry->d_type == DT_LNK)
         {
@@ -126,71 +149,84 @@ int listDir(const char *name, int maxDepth, int currentDepth, char * devicePath,
             {
                 if(devVid == EVI_COMMON_VID && devPid == EVI_COMMON_PID)
                 {
-                    ret = findTty(name, 4, 0, devicePath, devicePathLength);
-                    if(ret == 0)
+                    char serial[EVI_MAX_SERIAL_NUMBER_LENGTH] = {0};
+                    char tty[64] = {0};
+                    getDeviceSerialNumber(path, serial, sizeof(serial));
+
+                    if(findTty(path, 4, 0, tty, sizeof(tty)) == 0)
                     {
-                        break;
+                        char port[sizeof(tty) + 5];
+                        snprintf(port, sizeof(port), "/dev/%s", tty);
+                        // The same device is reachable through several paths, the list ignores duplicates
+                        eviDeviceListAdd(devices, maxDevices, count, port, serial);
+                        continue;
                     }
                 }
             }
 
-            ret = listDir(path, maxDepth, currentDepth + 1, devicePath, devicePathLength);
+            listDir(path, maxDepth, currentDepth + 1, devices, maxDevices, count);
         }
     }
     closedir(dir);
-    return ret;
+    return 0;
 }
 
-
-Error_t eviFindDevice(char *portName, size_t *portNameSize, bool verbose)
+Error_t eviEnumerateDevices(EviDeviceInfo_t *devices, size_t maxDevices, size_t *count, bool verbose)
 {
-    char path[64] = {0};
-    int found = listDir("/sys/bus/usb/devices", 4, 0, path, sizeof(path));
-    
-    if(found == 0)
-    {
-        *portNameSize = snprintf(portName, *portNameSize, "/dev/%s", path);
-        return ERROR_EVI_OK;
-    }
-    else
+    *count = 0;
+    listDir("/sys/bus/usb/devices", 4, 0, devices, maxDevices, count);
+
+    if(verbose)
     {
-        return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+        for(size_t i = 0; i < *count; i++)
+        {
+            fprintf(stderr, "DEVICES: %s %s\n", devices[i].serialNumber, devices[i].port);
+        }
     }
+    return ERROR_EVI_OK;
 }
 
-int eviPortOpen(char *portName)
+bool eviPortExists(const char *portName)
 {
-    int hComm;
-    {
-        if(strcmp(portName, "SIMULATION") == 0)
-        {
-            struct sockaddr_in servaddr;
+    return access(portName, F_OK) == 0;
+}
 
-            // socket create and varification
-            hComm = socket(AF_INET, SOCK_STREAM, 0);
-            if (hComm == -1)
-            {
-                fprintf(stderr, "Could not open socket %s\n", portName);
-                return -1;
-            }
+bool eviPortSerialNumber(const char *portName, char *serialNumber, size_t serialNumberSize)
+{
+    char path[1024];
+    const char *tty = strrchr(portName, '/');
 
-            bzero(&servaddr, sizeof(servaddr));
-            servaddr.sin_family = AF_INET;
-            servaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-            servaddr.sin_port = htons(5000);
+    // /sys/class/tty/ttyACMx/device is the CDC interface, its parent the USB device
+    snprintf(path, sizeof(path), "/sys/class/tty/%s/device/..", tty ? tty + 1 : portName);
+    return getDeviceSerialNumber(path, serialNumber, serialNumberSize) == 0;
+}
 
-            if (connect(hComm, (struct sockaddr*)&servaddr, sizeof(servaddr)) != 0)
-            {
-                printf("connection with the server failed...\n");
-                exit(0);
-            }
-            return hComm;
-        }
-        else
-        {
-            hComm = open(portName, O_RDWR | O_NOCTTY);
-        }
+typedef struct
+{
+    int fd;
+} FdConnection;
+
+static void *eviFdConnection(int fd)
+{
+    FdConnection *connection;
+
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    connection = (FdConnection *)malloc(sizeof(FdConnection));
+    if (connection == NULL)
+    {
+        close(fd);
+        return NULL;
     }
+    connection->fd = fd;
+    return connection;
+}
+
+static int eviTtyOpenFd(const char *portName)
+{
+    int hComm = open(portName, O_RDWR | O_NOCTTY);
 
     if (hComm == -1)
     {
@@ -205,11 +241,11 @@ int eviPortOpen(char *portName)
         return -1;
     }
 
-    // Configure read and write operations to time out after 100 ms.
+    // Reads never block, eviReceive() waits with poll() until data arrives.
     struct termios options;
     tcgetattr(hComm, &options);
     options.c_cc[VMIN] = 0;
-    options.c_cc[VTIME] = 1;
+    options.c_cc[VTIME] = 0;
 
     if (tcsetattr(hComm, TCSANOW, &options) == -1)
     {
@@ -237,25 +273,71 @@ int eviPortOpen(char *portName)
     return hComm;
 }
 
-void eviPortClose(int hComm)
+static void *eviTtyOpen(const char *port, void *user, bool verbose)
 {
-    if (hComm != -1)
-    {
-        close(hComm);
-    }
+    return eviFdConnection(eviTtyOpenFd(port));
 }
 
-bool eviPortWrite(int hComm, char *buffer, bool verbose)
+static int eviTcpOpenFd(const char *port)
 {
-    ssize_t written;
-    size_t size = strlen(buffer);
+    char host[EVI_MAX_PORT_NAME_LENGTH];
+    const char *service;
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addresses;
+    int fd = -1;
+
+    strcpy_s(host, sizeof(host), port[0] != 0 ? port : EVI_TCP_DEFAULT_PORT);
+    char *separator = strrchr(host, ':');
+    if (separator == NULL)
+    {
+        fprintf(stderr, "Port %s is not host:port\n", port);
+        return -1;
+    }
+    *separator = 0;
+    service = separator + 1;
+
+    if (getaddrinfo(host, service, &hints, &addresses) != 0)
+    {
+        fprintf(stderr, "Could not resolve %s\n", host);
+        return -1;
+    }
+    for (struct addrinfo *a = addresses; a != NULL && fd == -1; a = a->ai_next)
+    {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd != -1 && connect(fd, a->ai_addr, a->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
 
-    if (verbose)
+    if (fd == -1)
     {
-        fprintf(stderr, "TX: %s\n", buffer);
+        fprintf(stderr, "Could not connect to %s:%s\n", host, service);
+        return -1;
     }
 
-    written = write(hComm, buffer, size);
+    // Every command is a small write waiting for its answer, don't let Nagle delay it
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return fd;
+}
+
+static void *eviTcpOpen(const char *port, void *user, bool verbose)
+{
+    return eviFdConnection(eviTcpOpenFd(port));
+}
+
+static void eviFdClose(void *connection)
+{
+    close(((FdConnection *)connection)->fd);
+    free(connection);
+}
+
+static bool eviFdWrite(void *connection, const char *data, size_t size)
+{
+    ssize_t written = write(((FdConnection *)connection)->fd, data, size);
 
     if (written == -1)
     {
@@ -272,83 +354,74 @@ bool eviPortWrite(int hComm, char *buffer, bool verbose)
     return true;
 }
 
-uint32_t eviPortRead(int hComm, char *buffer, size_t size, bool verbose)
+static int eviFdPoll(void *connection, uint32_t timeoutMs)
 {
-    ssize_t received;
-    size_t count = 0;
-    char rx[EVI_MAX_LINE_LENGTH];
-    bool waitForStart = true;
-    bool done = false;
-    bool useChecksum = false;
-    int checkSumSeparator = -1;
-
-    do
+    struct pollfd fds = {.fd = ((FdConnection *)connection)->fd, .events = POLLIN};
+    uint64_t deadline = eviMonotonicMs() + timeoutMs;
+    int ready;
+
+    // A signal (e.g. SIGINT of a continuous measurement) interrupts the wait,
+    // it is not an answer: wait again for the rest of the time.
+    while ((ready = poll(&fds, 1, (int)timeoutMs)) == -1 && errno == EINTR)
     {
-        memset(rx, 0, EVI_MAX_LINE_LENGTH);
-        received = read(hComm, rx, EVI_MAX_LINE_LENGTH);
-        if (received == -1)
+        uint64_t now = eviMonotonicMs();
+        if (now >= deadline)
         {
-            fprintf(stderr, "Could not read from port\n");
             return 0;
         }
+        timeoutMs = (uint32_t)(deadline - now);
+    }
+    if (ready <= 0)
+    {
+        return ready;
+    }
+    // Only data or a hang-up may be read, read() would block or see nothing otherwise
+    return (fds.revents & (POLLIN | POLLHUP)) != 0 ? 1 : -1;
+}
 
-        if (verbose && received > 0)
-        {
-            fprintf(stderr, "RX: %s\n", rx);
-        }
-
-        for (size_t i = 0; i < (size_t)received && !done; i++)
-        {
-            if (waitForStart)
-            {
-                if (rx[i] == EVI_START_NO_CHK || rx[i] == EVI_START_WITH_CHK)
-                {
-                    waitForStart = false;
-                    if (rx[i] == EVI_START_WITH_CHK)
-                    {
-                        useChecksum = true;
-                    }
-                }
-            }
-            else
-            {
-                if (rx[i] == EVI_STOP1 || rx[i] == EVI_STOP2)
-                {
-                    done = true;
-                    buffer[count] = 0;
-                }
-                else
-                {
-                    buffer[count] = rx[i];
-                    if (buffer[count] == EVI_CHECKSUM_SEPARATOR)
-                    {
-                        checkSumSeparator = count;
-                    }
-                    count++;
-                }
-            }
-        }
-    } while (!done);
-
-    if (useChecksum)
+static int eviFdRead(void *connection, char *data, size_t size)
+{
+    // Only called after poll(). Data, hang-up and errors all make the port
+    // readable, nothing to read means the other side is gone.
+    ssize_t received = read(((FdConnection *)connection)->fd, data, size);
+    if (received == -1 && errno == EINTR)
     {
-        crc_t crcReceived;
-        crc_t crc = crc_init();
-        crc = crc_update(crc, buffer, checkSumSeparator);
-        crc = crc_finalize(crc);
-        crcReceived = atoi(buffer + checkSumSeparator + 1);
-        if (crc == crcReceived)
-        {
-            buffer[checkSumSeparator] = 0;
-        }
-        else
-        {
-            fprintf(stderr, "CRC differ: received message %s, calculated crc=%i", buffer, (uint32_t)crcReceived);
-            return 0;
-        }
+        return 0;
     }
+    return received > 0 ? (int)received : -1;
+}
 
-    return count;
+const EviTransport_t eviTransportTty = {
+    .name     = "tty",
+    .discover = true,
+    .open     = eviTtyOpen,
+    .close    = eviFdClose,
+    .write    = eviFdWrite,
+    .poll     = eviFdPoll,
+    .read     = eviFdRead,
+};
+
+const EviTransport_t eviTransportTcp = {
+    .name   = "tcp",
+    .open   = eviTcpOpen,
+    .close  = eviFdClose,
+    .write  = eviFdWrite,
+    .poll   = eviFdPoll,
+    .read   = eviFdRead,
+};
+
+uint64_t eviMonotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t eviMonotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
 
 errno_t strncat_s(char *restrict dest, rsize_t destsz, const char *restrict src, rsize_t count)
@@ -402,5 +475,8 @@ int sprintf_s(char *str, size_t snprintf, const char *format, ...)
 
 void Sleep(uint32_t dwMilliseconds)
 {
-    sleep(dwMilliseconds);
+    struct timespec ts = {.tv_sec = dwMilliseconds / 1000, .tv_nsec = (dwMilliseconds % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+    {
+    }
 }
@@ -3,7 +3,7 @@
 
 #include "evibase.h"
 #include "eviconfig.h"
-#include "crc-16-ccitt.h"
+#include "evitransport.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -16,8 +16,11 @@
 #include <WinDef.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
 
 #pragma comment(lib, "Setupapi.lib")
+
+#define EVI_READ_SLICE_MS 100
 // This is the GUID for the USB device class
 DEFINE_GUID(GUID_DEVINTERFACE_USB_DEVICE, 0xA5DCBF10L, 0x6530, 0x11D2, 0x90, 0x1F, 0x00, 0xC0, 0x4F, 0xB9, 0x51, 0xED);
 DEFINE_GUID(GUID_DEVINTERFACE_MODEM, 0x2c7089aa, 0x2e0e, 0x11d1, 0xb1, 0x14, 0x00, 0xc0, 0x4f, 0xc2, 0xaa, 0xe4);
@@ -132,7 +135,27 @@ static uint16_t deviceProductIdentifier(char * instanceIdentifier, bool * ok)
     return result;
 }
 
-Error_t eviFindDevice(char * portName, size_t * portNameSize, bool verbose)
+static void deviceSerialNumber(DEVINST deviceInstanceNumber, char * serialNumber, size_t serialNumberSize)
+{
+    char * instanceIdentifier = deviceInstanceIdentifier(deviceInstanceNumber);
+
+    // The serial number is part of the USB device's identifier, not of the identifier of its interfaces
+    if (strstr(instanceIdentifier, "&MI_") != NULL)
+    {
+        DEVINST parent;
+        if (CM_Get_Parent(&parent, deviceInstanceNumber, 0) == CR_SUCCESS)
+        {
+            free(instanceIdentifier);
+            instanceIdentifier = deviceInstanceIdentifier(parent);
+        }
+    }
+
+    char * s = strrchr(instanceIdentifier, '\\');
+    strcpy_s(serialNumber, serialNumberSize, s ? s + 1 : "");
+    free(instanceIdentifier);
+}
+
+Error_t eviEnumerateDevices(EviDeviceInfo_t *devices, size_t maxDevices, size_t *count, bool verbose)
 {
     SetupTokens_t setupTokens[] = { {GUID_DEVCLASS_PORTS, DIGCF_PRESENT },
         { GUID_DEVCLASS_MODEM, DIGCF_PRESENT },
@@ -141,14 +164,14 @@ Error_t eviFindDevice(char * portName, size_t * portNameSize, bool verbose)
     };
 
     int setupTokensCount = sizeof(setupTokens) / sizeof(setupTokens[0]);
-    bool found = false;
+    *count = 0;
 
-    for (int i = 0; i < setupTokensCount && !found ; ++i)
+    for (int i = 0; i < setupTokensCount && *count < maxDevices; ++i)
     {
         HDEVINFO deviceInfoSet = SetupDiGetClassDevs(&setupTokens[i].guid, NULL, NULL, setupTokens[i].flags);
         if (deviceInfoSet == INVALID_HANDLE_VALUE)
         {
-            return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+            continue;
         }
 
         SP_DEVINFO_DATA deviceInfoData;
@@ -156,7 +179,7 @@ Error_t eviFindDevice(char * portName, size_t * portNameSize, bool verbose)
         deviceInfoData.cbSize = sizeof(deviceInfoData);
 
         DWORD index = 0;
-        while (SetupDiEnumDeviceInfo(deviceInfoSet, index++, &deviceInfoData)) 
+        while (SetupDiEnumDeviceInfo(deviceInfoSet, index++, &deviceInfoData) && *count < maxDevices)
         {
             bool ok;
             uint16_t vid;
@@ -176,91 +199,95 @@ Error_t eviFindDevice(char * portName, size_t * portNameSize, bool verbose)
 
             if(vid == EVI_COMMON_VID && pid == EVI_COMMON_PID)
             {
-                if(devicePortName(deviceInfoSet, &deviceInfoData, portName, portNameSize))
+                char serial[EVI_MAX_SERIAL_NUMBER_LENGTH] = {0};
+                char port[EVI_MAX_PORT_NAME_LENGTH] = {0};
+                size_t portSize = sizeof(port);
+                deviceSerialNumber(deviceInfoData.DevInst, serial, sizeof(serial));
+
+                if(devicePortName(deviceInfoSet, &deviceInfoData, port, &portSize))
                 {
-                    found = true;
-                    break;
+                    // Ports and interface classes list the same device, the list ignores duplicates
+                    eviDeviceListAdd(devices, maxDevices, count, port, serial);
                 }
             }
         }
-        SetupDiDestroyDeviceInfoList(deviceInfoSet);		
+        SetupDiDestroyDeviceInfoList(deviceInfoSet);
     }
 
-    return found ? ERROR_EVI_OK : ERROR_EVI_INSTRUMENT_NOT_FOUND;
+    return ERROR_EVI_OK;
 }
 
-EVI_HANDLE eviPortOpen(char * portName)
+bool eviPortExists(const char *portName)
 {
-    EVI_HANDLE hComm = {};
+    char target[MAX_PATH];
+    return QueryDosDevice(portName, target, sizeof(target)) != 0;
+}
 
-    if(strcmp(portName, "SIMULATION") == 0)
-    {
-        SOCKADDR_IN addr;
-        hComm.isSocket = true;
-        WSAStartup(MAKEWORD(2, 0), &hComm.wsa_data);
-        hComm.socket = socket(AF_INET, SOCK_STREAM, 0);
-        InetPton(AF_INET, "127.0.0.1", &addr.sin_addr.s_addr);
+bool eviPortSerialNumber(const char *portName, char *serialNumber, size_t serialNumberSize)
+{
+    // A COM port name can't be mapped back to the USB device without enumerating
+    return false;
+}
 
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons(5000);
+typedef struct
+{
+    HANDLE handle;
+} ComConnection;
 
-        connect(hComm.socket, (SOCKADDR *)(&addr), sizeof(addr));
-        return hComm;
-    }
-    else
-    {
-        LPTSTR dn = "\\\\.\\";
-        DWORD deviceSize = strlen(portName) + strlen(dn) + 1;
-        LPTSTR device = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, deviceSize);
-        strcat_s(device, deviceSize, dn);
-        strcat_s(device, deviceSize, portName);
-
-        hComm.handle = CreateFile(device,						 // port name
-                                  GENERIC_READ | GENERIC_WRITE, // Read/Write
-                                  0,							 // No Sharing
-                                  NULL,						 // No Security
-                                  OPEN_EXISTING,				 // Open existing port only
-                                  0,							 // Non Overlapped I/O
-                                  NULL);						 // Null for Comm Devices
-
-        HeapFree(GetProcessHeap(), 0, device);
-    }
+typedef struct
+{
+    WSADATA wsa_data;
+    SOCKET socket;
+} SocketConnection;
 
-    if (hComm.handle == INVALID_HANDLE_VALUE)
+static void *eviTtyOpen(const char *portName, void *user, bool verbose)
+{
+    ComConnection *hComm;
+    LPTSTR dn = "\\\\.\\";
+    DWORD deviceSize = strlen(portName) + strlen(dn) + 1;
+    LPTSTR device = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, deviceSize);
+    strcat_s(device, deviceSize, dn);
+    strcat_s(device, deviceSize, portName);
+
+    HANDLE handle = CreateFile(device,						 // port name
+                              GENERIC_READ | GENERIC_WRITE, // Read/Write
+                              0,							 // No Sharing
+                              NULL,						 // No Security
+                              OPEN_EXISTING,				 // Open existing port only
+                              0,							 // Non Overlapped I/O
+                              NULL);						 // Null for Comm Devices
+
+    HeapFree(GetProcessHeap(), 0, device);
+
+    if (handle == INVALID_HANDLE_VALUE)
     {
         fprintf(stderr, "could not open port %s\n", portName);
-        hComm.valid = false;
-        return hComm;
-    }
-    else
-    {
-        hComm.valid = true;
+        return NULL;
     }
 
-    BOOL success = FlushFileBuffers(hComm.handle);
+    BOOL success = FlushFileBuffers(handle);
     if (!success)
     {
         fprintf(stderr, "could not flush buffers\n");
-        CloseHandle(hComm.handle);
-        hComm.valid = false;
-        return hComm;
+        CloseHandle(handle);
+        return NULL;
     }
 
-    // Configure read and write operations to time out after 100 ms.
+    // A read returns as soon as at least one byte arrived, or empty after
+    // EVI_READ_SLICE_MS. eviReceive() keeps the deadline of the whole line.
     COMMTIMEOUTS timeouts = {0};
-    timeouts.ReadIntervalTimeout = 0;
-    timeouts.ReadTotalTimeoutConstant = 1;
-    timeouts.ReadTotalTimeoutMultiplier = 0;
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutConstant = EVI_READ_SLICE_MS;
+    timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
     timeouts.WriteTotalTimeoutConstant = 1;
     timeouts.WriteTotalTimeoutMultiplier = 0;
 
-    success = SetCommTimeouts(hComm.handle, &timeouts);
+    success = SetCommTimeouts(handle, &timeouts);
     if (!success)
     {
         fprintf(stderr, "could not timeouts\n");
-        CloseHandle(hComm.handle);
-        hComm.valid = false;
-        return hComm;
+        CloseHandle(handle);
+        return NULL;
     }
 
     // Set the baud rate and other options.
@@ -270,151 +297,186 @@ EVI_HANDLE eviPortOpen(char * portName)
     state.ByteSize = 8;
     state.Parity = NOPARITY;
     state.StopBits = ONESTOPBIT;
-    success = SetCommState(hComm.handle, &state);
+    success = SetCommState(handle, &state);
     if (!success)
     {
         fprintf(stderr, "could not set serial settings\n");
-        CloseHandle(hComm.handle);
-        hComm.valid = false;
-        return hComm;
+        CloseHandle(handle);
+        return NULL;
     }
 
+    hComm = (ComConnection *)malloc(sizeof(ComConnection));
+    if (hComm == NULL)
+    {
+        CloseHandle(handle);
+        return NULL;
+    }
+    hComm->handle = handle;
     return hComm;
 }
 
-void eviPortClose(EVI_HANDLE hComm)
+static void eviTtyClose(void *connection)
 {
-    if(hComm.isSocket)
+    CloseHandle(((ComConnection *)connection)->handle); // Closing the Serial Port
+    free(connection);
+}
+
+static bool eviTtyWrite(void *connection, const char *buffer, size_t size)
+{
+    DWORD written;
+    BOOL success = WriteFile(((ComConnection *)connection)->handle, buffer, (DWORD)size, &written, NULL);
+    if (!success)
     {
-        closesocket(hComm.socket);
-        WSACleanup();
+        fprintf(stderr, "could not write to port\n");
+        return false;
     }
-    else
+    if (written != size)
     {
-        if (hComm.handle != INVALID_HANDLE_VALUE)
-        {
-            CloseHandle(hComm.handle); // Closing the Serial Port
-        }
+        fprintf(stderr, "could not all bytes to port\n");
+        return false;
     }
+    return true;
 }
 
-bool eviPortWrite(EVI_HANDLE hComm, LPTSTR buffer, bool verbose)
+static int eviTtyPoll(void *connection, uint32_t timeoutMs)
 {
-    DWORD written;
-    DWORD size = strlen(buffer);
+    // ReadFile() itself waits up to EVI_READ_SLICE_MS for the first byte
+    return 1;
+}
 
-    if(verbose)
+static int eviTtyRead(void *connection, char *data, size_t size)
+{
+    DWORD received;
+    BOOL success = ReadFile(((ComConnection *)connection)->handle, data, (DWORD)size, &received, NULL);
+    if (!success)
     {
-        fprintf(stderr, "TX: %s\n", buffer);
+        return -1;
     }
+    return (int)received;
+}
 
-    if(hComm.isSocket)
+static void *eviTcpOpen(const char *port, void *user, bool verbose)
+{
+    char host[EVI_MAX_PORT_NAME_LENGTH];
+    ADDRINFOA hints = {0};
+    ADDRINFOA *addresses;
+    SocketConnection *hComm = (SocketConnection *)calloc(1, sizeof(SocketConnection));
+
+    if (hComm == NULL)
     {
-        send(hComm.socket, buffer, size, 0);
+        return NULL;
     }
-    else
+
+    strcpy_s(host, sizeof(host), port[0] != 0 ? port : EVI_TCP_DEFAULT_PORT);
+    char *separator = strrchr(host, ':');
+    if (separator == NULL)
     {
-        BOOL success = WriteFile(hComm.handle, buffer, size, &written, NULL);
-        if (!success)
-        {
-            fprintf(stderr, "could not write to port\n");
-            return false;
-        }
-        if (written != size)
-        {
-            fprintf(stderr, "could not all bytes to port\n");
-            return false;
-        }
+        fprintf(stderr, "port %s is not host:port\n", port);
+        free(hComm);
+        return NULL;
     }
-    return true;
-}
+    *separator = 0;
 
-uint32_t eviPortRead(EVI_HANDLE hComm, LPTSTR buffer, size_t size, bool verbose)
-{
-    DWORD received;
-    DWORD count = 0;
-    char rx[EVI_MAX_LINE_LENGTH];
-    bool waitForStart = true;
-    bool done = false;
-    bool useChecksum = false;
-    int checkSumSeparator = -1;
-
-    do
+    WSAStartup(MAKEWORD(2, 0), &hComm->wsa_data);
+    hComm->socket = INVALID_SOCKET;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, separator + 1, &hints, &addresses) == 0)
     {
-        memset(rx, 0, EVI_MAX_LINE_LENGTH);
-        if(hComm.isSocket)
+        for (ADDRINFOA *a = addresses; a != NULL && hComm->socket == INVALID_SOCKET; a = a->ai_next)
         {
-            received = recv(hComm.socket, rx, EVI_MAX_LINE_LENGTH, 0);
-            if(received <= 0)
+            hComm->socket = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (hComm->socket != INVALID_SOCKET && connect(hComm->socket, a->ai_addr, (int)a->ai_addrlen) != 0)
             {
-                return -1;
-            }
-        }
-        else
-        {
-            BOOL success = ReadFile(hComm.handle, rx, EVI_MAX_LINE_LENGTH, &received, NULL);
-            if (!success)
-            {
-                fprintf(stderr, "could not read from port\n");
-                return -1;
+                closesocket(hComm->socket);
+                hComm->socket = INVALID_SOCKET;
             }
         }
+        freeaddrinfo(addresses);
+    }
 
-        if(verbose && received > 0)
-        {
-            fprintf(stderr, "RX: %s\n", rx);
-        }		
+    if (hComm->socket == INVALID_SOCKET)
+    {
+        fprintf(stderr, "could not connect to %s:%s\n", host, separator + 1);
+        WSACleanup();
+        free(hComm);
+        return NULL;
+    }
 
-        for (DWORD i = 0; i < received && !done; i++)
-        {
-            if (waitForStart)
-            {
-                if (rx[i] == EVI_START_NO_CHK || rx[i] == EVI_START_WITH_CHK)
-                {
-                    waitForStart = false;
-                    if(rx[i] == EVI_START_WITH_CHK)
-                    {
-                        useChecksum = true;
-                    }
-                }
-            }
-            else
-            {
-                if (rx[i] == EVI_STOP1 || rx[i] == EVI_STOP2)
-                {
-                    done = true;
-                    buffer[count] = 0;
-                }
-                else
-                {
-                    buffer[count] = rx[i];
-                    if(buffer[count] == EVI_CHECKSUM_SEPARATOR)
-                    {
-                        checkSumSeparator = count;
-                    }
-                    count++;
-                }
-            }
-        }
-    } while (!done);
+    // Every command is a small write waiting for its answer, don't let Nagle delay it
+    BOOL noDelay = TRUE;
+    setsockopt(hComm->socket, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+    return hComm;
+}
 
-    if(useChecksum)
+static void eviTcpClose(void *connection)
+{
+    closesocket(((SocketConnection *)connection)->socket);
+    WSACleanup();
+    free(connection);
+}
+
+static bool eviTcpWrite(void *connection, const char *buffer, size_t size)
+{
+    if (send(((SocketConnection *)connection)->socket, buffer, (int)size, 0) != (int)size)
     {
-        crc_t crcReceived;
-        crc_t crc = crc_init();
-        crc = crc_update(crc, buffer, checkSumSeparator);
-        crc = crc_finalize(crc);
-        crcReceived = atoi(buffer+checkSumSeparator+1);
-        if(crc == crcReceived)
-        {
-            buffer[checkSumSeparator] = 0;
-        }
-        else
-        {
-            fprintf(stderr, "CRC differ: received message %s, calculated crc=%i", buffer, crcReceived);
-            return 0;
-        }
+        fprintf(stderr, "could not write to socket\n");
+        return false;
     }
+    return true;
+}
+
+static int eviTcpPoll(void *connection, uint32_t timeoutMs)
+{
+    fd_set fds;
+    struct timeval tv;
+    FD_ZERO(&fds);
+    FD_SET(((SocketConnection *)connection)->socket, &fds);
+    tv.tv_sec = (long)(timeoutMs / 1000);
+    tv.tv_usec = (long)(timeoutMs % 1000) * 1000;
+
+    int ready = select(0, &fds, NULL, NULL, &tv);
+    return ready == SOCKET_ERROR ? -1 : ready;
+}
+
+static int eviTcpRead(void *connection, char *data, size_t size)
+{
+    int r = recv(((SocketConnection *)connection)->socket, data, (int)size, 0);
+    return r > 0 ? r : -1;
+}
 
-    return count;
+const EviTransport_t eviTransportTty = {
+    .name     = "tty",
+    .discover = true,
+    .open     = eviTtyOpen,
+    .close    = eviTtyClose,
+    .write    = eviTtyWrite,
+    .poll     = eviTtyPoll,
+    .read     = eviTtyRead,
+};
+
+const EviTransport_t eviTransportTcp = {
+    .name   = "tcp",
+    .open   = eviTcpOpen,
+    .close  = eviTcpClose,
+    .write  = eviTcpWrite,
+    .poll   = eviTcpPoll,
+    .read   = eviTcpRead,
+};
+
+uint64_t eviMonotonicMs()
+{
+    return GetTickCount64();
+}
+
+uint64_t eviMonotonicUs()
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
 }
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "eviasync.h"
+#include <string.h>
+
+static EVI_THREAD_RESULT eviAsyncRun(void *arg)
+{
+    EviAsync_t *self = (EviAsync_t *)arg;
+
+    for (;;)
+    {
+        eviSemaphoreWait(&self->submitted, UINT32_MAX);
+
+        size_t head = self->submissionHead;
+        while (head != eviAtomicLoad(&self->submissionTail))
+        {
+            EviSubmission_t *submission = &self->submissions[head % EVI_ASYNC_QUEUE_SIZE];
+            Error_t result = submission->operation(self->evi, submission->args);
+
+            if (submission->callback)
+            {
+                submission->callback(submission->id, result, submission->user);
+            }
+            else
+            {
+                // eviAsyncSubmit() keeps the pending completions below EVI_ASYNC_QUEUE_SIZE
+                size_t tail = self->completionTail;
+                EviCompletion_t *completion = &self->completions[tail % EVI_ASYNC_QUEUE_SIZE];
+                completion->id     = submission->id;
+                completion->result = result;
+                completion->user   = submission->user;
+                eviAtomicStore(&self->completionTail, tail + 1);
+                eviSemaphorePost(&self->completed);
+            }
+
+            eviAtomicStore(&self->submissionHead, ++head);
+        }
+
+        if (eviAtomicLoad(&self->stop))
+        {
+            break;
+        }
+    }
+    EVI_THREAD_RETURN;
+}
+
+Error_t eviAsyncStart(EviAsync_t *self, Evi_t *evi)
+{
+    memset(self, 0, sizeof(EviAsync_t));
+    self->evi = evi;
+
+    if (!eviSemaphoreInit(&self->submitted))
+    {
+        return ERROR_EVI_THREAD_ERROR;
+    }
+    if (!eviSemaphoreInit(&self->completed))
+    {
+        eviSemaphoreDestroy(&self->submitted);
+        return ERROR_EVI_THREAD_ERROR;
+    }
+    if (!eviThreadCreate(&self->thread, eviAsyncRun, self))
+    {
+        eviSemaphoreDestroy(&self->completed);
+        eviSemaphoreDestroy(&self->submitted);
+        return ERROR_EVI_THREAD_ERROR;
+    }
+    return ERROR_EVI_OK;
+}
+
+void eviAsyncStop(EviAsync_t *self)
+{
+    eviAtomicStore(&self->stop, 1);
+    eviSemaphorePost(&self->submitted);
+    eviThreadJoin(self->thread);
+    eviSemaphoreDestroy(&self->completed);
+    eviSemaphoreDestroy(&self->submitted);
+}
+
+Error_t eviAsyncSubmit(EviAsync_t *self, EviAsyncOperation_t operation, const void *args, size_t argsSize, EviAsyncCallback_t callback, void *user, uint32_t *id)
+{
+    size_t tail = self->submissionTail;
+
+    if (argsSize > EVI_ASYNC_MAX_ARGS_SIZE)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
+    if (tail - eviAtomicLoad(&self->submissionHead) >= EVI_ASYNC_QUEUE_SIZE ||
+        (callback == NULL && self->pending >= EVI_ASYNC_QUEUE_SIZE))
+    {
+        return ERROR_EVI_QUEUE_FULL;
+    }
+
+    EviSubmission_t *submission = &self->submissions[tail % EVI_ASYNC_QUEUE_SIZE];
+    submission->id        = self->nextId++;
+    submission->operation = operation;
+    submission->callback  = callback;
+    submission->user      = user;
+    if (argsSize > 0)
+    {
+        memcpy(submission->args, args, argsSize);
+    }
+    if (id)
+    {
+        *id = submission->id;
+    }
+    if (callback == NULL)
+    {
+        self->pending++;
+    }
+
+    eviAtomicStore(&self->submissionTail, tail + 1);
+    eviSemaphorePost(&self->submitted);
+    return ERROR_EVI_OK;
+}
+
+bool eviAsyncPoll(EviAsync_t *self, EviCompletion_t *completion)
+{
+    size_t head = self->completionHead;
+
+    if (head == eviAtomicLoad(&self->completionTail))
+    {
+        return false;
+    }
+
+    *completion = self->completions[head % EVI_ASYNC_QUEUE_SIZE];
+    eviAtomicStore(&self->completionHead, head + 1);
+    self->pending--;
+    return true;
+}
+
+Error_t eviAsyncWait(EviAsync_t *self, EviCompletion_t *completion, uint32_t timeoutMs)
+{
+    // The semaphore may count completions already taken by eviAsyncPoll(),
+    // so it is only a wake-up and the queue is checked again.
+    while (!eviAsyncPoll(self, completion))
+    {
+        if (!eviSemaphoreWait(&self->completed, timeoutMs))
+        {
+            return ERROR_EVI_TIMEOUT;
+        }
+    }
+    return ERROR_EVI_OK;
+}
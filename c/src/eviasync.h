@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+#include "evithread.h"
+
+/**
+ * @file eviasync.h
+ * @brief Executes commands of a session on a separate I/O thread.
+ *
+ * The caller submits operations through a lock-free single-producer,
+ * single-consumer queue and continues while the I/O thread talks to the
+ * device. A finished operation is either reported to its callback on the
+ * I/O thread or put into the completion queue, see eviAsyncPoll() and
+ * eviAsyncWait().
+ *
+ * Submitting, polling and waiting must all be done by the same thread. While
+ * the I/O thread runs, the session must not be used directly.
+ */
+
+#define EVI_ASYNC_QUEUE_SIZE 32
+#define EVI_ASYNC_MAX_ARGS_SIZE 32
+
+/**
+ * @brief Operation executed on the I/O thread.
+ *
+ * @param evi The session.
+ * @param args Copy of the arguments given to eviAsyncSubmit().
+ * @return An error code indicating the result of the operation.
+ */
+typedef Error_t (*EviAsyncOperation_t)(Evi_t *evi, void *args);
+
+/**
+ * @brief Callback for a finished operation, called on the I/O thread.
+ *
+ * @param id Id of the operation, see eviAsyncSubmit().
+ * @param result Result of the operation.
+ * @param user User-defined data given to eviAsyncSubmit().
+ */
+typedef void (*EviAsyncCallback_t)(uint32_t id, Error_t result, void *user);
+
+/**
+ * @struct EviCompletion_t
+ * @brief A finished operation.
+ */
+typedef struct
+{
+    uint32_t id; /**< Id of the operation, see eviAsyncSubmit(). */
+    Error_t result; /**< Result of the operation. */
+    void *user; /**< User-defined data given to eviAsyncSubmit(). */
+} EviCompletion_t;
+
+/**
+ * @struct EviSubmission_t
+ * @brief A submitted operation waiting for the I/O thread.
+ */
+typedef struct
+{
+    uint32_t id; /**< Id of the operation. */
+    EviAsyncOperation_t operation; /**< Operation to execute. */
+    uint64_t args[EVI_ASYNC_MAX_ARGS_SIZE / sizeof(uint64_t)]; /**< Copy of the arguments. */
+    EviAsyncCallback_t callback; /**< Callback or NULL for the completion queue. */
+    void *user; /**< User-defined data. */
+} EviSubmission_t;
+
+/**
+ * @struct EviAsync_t
+ * @brief I/O thread of a session.
+ */
+typedef struct
+{
+    Evi_t *evi; /**< The session driven by the I/O thread. */
+    EviThread_t thread; /**< The I/O thread. */
+    EviSemaphore_t submitted; /**< Posted for every submission and on stop. */
+    EviSemaphore_t completed; /**< Posted for every entry of the completion queue. */
+    EviSubmission_t submissions[EVI_ASYNC_QUEUE_SIZE]; /**< Submission queue, written by the caller. */
+    volatile size_t submissionHead; /**< Next submission to execute, written by the I/O thread. */
+    volatile size_t submissionTail; /**< Next free submission, written by the caller. */
+    EviCompletion_t completions[EVI_ASYNC_QUEUE_SIZE]; /**< Completion queue, written by the I/O thread. */
+    volatile size_t completionHead; /**< Next completion to deliver, written by the caller. */
+    volatile size_t completionTail; /**< Next free completion, written by the I/O thread. */
+    size_t pending; /**< Submissions without callback not yet delivered by eviAsyncPoll() or eviAsyncWait(). */
+    uint32_t nextId; /**< Id of the next submission. */
+    volatile size_t stop; /**< Set to stop the I/O thread. */
+} EviAsync_t;
+
+/**
+ * @brief Starts the I/O thread of a session.
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param evi The session, it must stay valid until eviAsyncStop().
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviAsyncStart(EviAsync_t *self, Evi_t *evi);
+
+/**
+ * @brief Executes the submitted operations and stops the I/O thread.
+ *
+ * Completions not yet delivered are dropped.
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ */
+DLLEXPORT void eviAsyncStop(EviAsync_t *self);
+
+/**
+ * @brief Submits an operation to the I/O thread.
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param operation The operation.
+ * @param args Arguments of the operation, they are copied.
+ * @param argsSize Size of args, at most EVI_ASYNC_MAX_ARGS_SIZE.
+ * @param callback Called on the I/O thread when the operation is done, NULL to use the completion queue.
+ * @param user User-defined data passed to the callback or the completion.
+ * @param id Pointer to store the id of the operation, may be NULL.
+ * @return ERROR_EVI_OK or ERROR_EVI_QUEUE_FULL if EVI_ASYNC_QUEUE_SIZE operations are outstanding.
+ */
+DLLEXPORT Error_t eviAsyncSubmit(EviAsync_t *self, EviAsyncOperation_t operation, const void *args, size_t argsSize, EviAsyncCallback_t callback, void *user, uint32_t *id);
+
+/**
+ * @brief Takes a finished operation from the completion queue without waiting.
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param completion Pointer to store the finished operation.
+ * @return True if an operation was finished.
+ */
+DLLEXPORT bool eviAsyncPoll(EviAsync_t *self, EviCompletion_t *completion);
+
+/**
+ * @brief Waits for a finished operation in the completion queue.
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param completion Pointer to store the finished operation.
+ * @param timeoutMs Maximal time to wait in milliseconds, UINT32_MAX waits forever.
+ * @return ERROR_EVI_OK or ERROR_EVI_TIMEOUT.
+ */
+DLLEXPORT Error_t eviAsyncWait(EviAsync_t *self, EviCompletion_t *completion, uint32_t timeoutMs);
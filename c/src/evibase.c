@@ -2,10 +2,14 @@
 // SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
 
 #include "evibase.h"
+#include "evicache.h"
+#include "evisrec.h"
+#include "evitransport.h"
+#include "eviparse.h"
+#include "commonindex.h"
 #include "crc-16-ccitt.h"
 #include <stdio.h>
 #include <stdint.h>
-#include <stdio.h>
 #include <stdarg.h>
 
 #define VERSION_DLL "0.2.0"
@@ -53,6 +57,12 @@ const char * eviError2String(Error_t e)
         return "File not found";
     case ERROR_EVI_UNKOWN_COMMAND_LINE_ARGUMENT:
         return "Unknown command line argument";
+    case ERROR_EVI_QUEUE_FULL:
+        return "Queue full";
+    case ERROR_EVI_THREAD_ERROR:
+        return "Could not start thread";
+    case ERROR_EVI_OUT_OF_MEMORY:
+        return "Out of memory";
     default:
         return "?";
     }
@@ -69,346 +79,1366 @@ void eviFreeResponse(EvieResponse_t *response)
     free(response);
 }
 
-Error_t eviCommandComm(Evi_t *self, EVI_HANDLE hComm, const char * command, EvieResponse_t *response)
+size_t eviFrameCommand(const Evi_t *self, const char * command, char * tx, size_t txSize)
 {
-    Error_t ret = ERROR_EVI_OK;
+    // start + command + separator + 5 digit crc + stop + terminator
+    const size_t reserve = 1 + 1 + 5 + 1 + 1;
+    size_t n = 0;
 
-    uint32_t txSize = EVI_MAX_LINE_LENGTH;
-    char * tx = (char *)calloc(1, txSize);
-    char s[20] = {0};
-    if(self->useChecksum)
-    {
-        s[0] = EVI_START_WITH_CHK;
-        strncat_s(tx, txSize, s, 1);
-        strncat_s(tx, txSize, command, strlen(command));
-        s[0] = EVI_CHECKSUM_SEPARATOR;
-        strncat_s(tx, txSize, s, 1);
-        crc_t crc = crc_init();
-        crc = crc_update(crc, command, strlen(command));
-        crc = crc_finalize(crc);
-        snprintf(s, sizeof(s), "%d", (uint32_t)crc);
-        strncat_s(tx, txSize, s, strlen(s));
+    if (txSize < reserve)
+    {
+        return 0;
     }
-    else
+
+    tx[n++] = self->useChecksum ? EVI_START_WITH_CHK : EVI_START_NO_CHK;
+    // The checksum is computed in the same pass as the copy
+    crc_t crc = crc_init();
+    while (*command != '\0' && n < txSize - reserve + 1)
     {
-        s[0] = EVI_START_NO_CHK;
-        strncat_s(tx, txSize, s, 1);
-        strncat_s(tx, txSize, command, strlen(command));
+        crc = crc_update_byte(crc, (unsigned char)*command);
+        tx[n++] = *command++;
     }
-    strncat_s(tx, txSize, "\n", 1);
 
-    eviPortWrite(hComm, tx, self->verbose);
-    if (eviPortRead(hComm, response->response, EVI_MAX_LINE_LENGTH, self->verbose) > 0)
+    if (self->useChecksum)
     {
-        for (int i = 0; i < EVI_MAX_ARGS; i++)
+        char digits[5];
+        int d = 0;
+        crc = crc_finalize(crc);
+
+        tx[n++] = EVI_CHECKSUM_SEPARATOR;
+        do
         {
-            response->argv[i] = 0;
+            digits[d++] = '0' + (crc % 10);
+            crc /= 10;
         }
-        response->argc = 0;
-        int i = 0;
-        int inQuotes = 0;
-        char quoteChar = 0;
-        bool inToken = false;
-        char *d = response->response;
-        while ((d[i] != '\0') && (i < EVI_MAX_LINE_LENGTH) && (response->argc < EVI_MAX_ARGS))
+        while (crc != 0);
+        while (d > 0)
         {
-            if (!inQuotes && (d[i] == '\'' || d[i] == '"'))
-            {
-                inQuotes = 1;
-                quoteChar = d[i];
-                response->argv[response->argc++] = &d[i + 1];  // Start after the opening quote
-                inToken = true;
-            }
-            else if (inQuotes && d[i] == quoteChar)
-            {
-                d[i] = '\0';  // Terminate the quoted string
-                inQuotes = 0;
-                inToken = false;
-            }
-            else if (!inQuotes && isspace(d[i]))
-            {
-                d[i] = '\0';
-                inToken = false;
-            }
-            else if (!inQuotes && !inToken)
-            {
-                response->argv[response->argc++] = &d[i];
-                inToken = true;
-            }
-            i++;
+            tx[n++] = digits[--d];
         }
-        ret = ERROR_EVI_OK;
+    }
+    tx[n++] = '\n';
+    tx[n] = '\0';
+    return n;
+}
+
+static bool eviSend(Evi_t *self, const char * command)
+{
+    char tx[EVI_MAX_LINE_LENGTH];
+    size_t size = eviFrameCommand(self, command, tx, sizeof(tx));
 
+    if (self->verbose)
+    {
+        fprintf(stderr, "TX: %s\n", tx);
     }
-    else
+    if (!self->connectionTransport->write(self->connection, tx, size))
     {
-        ret = ERROR_EVI_INSTRUMENT_NOT_FOUND;
+        self->stats.writeErrors++;
+        return false;
     }
-
-    free(tx);
-    return ret;
+    self->stats.commands++;
+    self->stats.bytesTx += size;
+    if (self->inFlight++ == 0)
+    {
+        self->stats.roundTrips++;
+    }
+    return true;
 }
 
-Error_t eviCommand(Evi_t *self, const char * command, EvieResponse_t *response)
+static void eviStatsLatency(EviStats_t *stats, uint64_t us)
 {
-    char portNameBuffer[1024];
-    size_t portNameBufferSize = sizeof(portNameBuffer);
-
-    Error_t ret = ERROR_EVI_OK;
-    if (self->portName)
+    size_t bucket = 0;
+    while (bucket + 1 < EVI_STATS_LATENCY_BUCKETS && us >= ((uint64_t)EVI_STATS_LATENCY_FIRST_US << bucket))
     {
-        strcpy_s(portNameBuffer, portNameBufferSize, self->portName);
+        bucket++;
     }
-    else
+    stats->latency[bucket]++;
+    stats->latencyCount++;
+    stats->latencySumUs += us;
+    if (us > stats->latencyMaxUs)
     {
-        ret = eviFindDevice(portNameBuffer, &portNameBufferSize, self->verbose);
+        stats->latencyMaxUs = us;
     }
+}
 
-    if (ret == ERROR_EVI_OK)
+static void eviTokenize(EvieResponse_t *response)
+{
+    for (int i = 0; i < EVI_MAX_ARGS; i++)
     {
-        EVI_HANDLE hComm = eviPortOpen(portNameBuffer);
-        ret = eviCommandComm(self, hComm, command, response);
-        eviPortClose(hComm);
+        response->argv[i] = 0;
     }
-    else
+    response->argc = 0;
+    int i = 0;
+    int inQuotes = 0;
+    char quoteChar = 0;
+    bool inToken = false;
+    char *d = response->response;
+    while ((d[i] != '\0') && (i < EVI_MAX_LINE_LENGTH) && (response->argc < EVI_MAX_ARGS))
     {
-        ret = ERROR_EVI_INSTRUMENT_NOT_FOUND;
+        if (!inQuotes && (d[i] == '\'' || d[i] == '"'))
+        {
+            inQuotes = 1;
+            quoteChar = d[i];
+            response->argv[response->argc++] = &d[i + 1];  // Start after the opening quote
+            inToken = true;
+        }
+        else if (inQuotes && d[i] == quoteChar)
+        {
+            d[i] = '\0';  // Terminate the quoted string
+            inQuotes = 0;
+            inToken = false;
+        }
+        else if (!inQuotes && isspace(d[i]))
+        {
+            d[i] = '\0';
+            inToken = false;
+        }
+        else if (!inQuotes && !inToken)
+        {
+            response->argv[response->argc++] = &d[i];
+            inToken = true;
+        }
+        i++;
     }
-    return ret;
 }
 
-Error_t eviExecute(Evi_t * self, char * cmd, Error_t(execute)(EvieResponse_t *response, void *user), void *user)
+// Fills the receive buffer, waits at most until the deadline.
+static Error_t eviFill(Evi_t *self, uint64_t deadline, uint32_t timeoutMs)
 {
-    EvieResponse_t *response = eviCreateResponse();
-    Error_t ret = eviCommand(self, cmd, response);
-    if (ret == ERROR_EVI_OK)
+    const EviTransport_t *transport = self->connectionTransport;
+    EviRxBuffer_t *rx = &self->rx;
+    int received = 0;
+
+    while (received == 0)
     {
-        if (strncmp(response->argv[0], cmd, 1) == 0)
+        uint64_t now = eviMonotonicMs();
+        if (now >= deadline)
         {
-            ret = execute(response, user);
+            if (self->verbose)
+            {
+                fprintf(stderr, "RX: timeout after %u ms\n", timeoutMs);
+            }
+            self->stats.timeouts++;
+            return ERROR_EVI_TIMEOUT;
         }
-        else
+
+        int ready = transport->poll(self->connection, (uint32_t)(deadline - now));
+        if (ready == 0)
         {
-            if(response->argc == 2 && strncmp(response->argv[0], "E", 1) == 0)
+            if (self->verbose)
             {
-                ret = atoi(response->argv[1]);
+                fprintf(stderr, "RX: timeout after %u ms\n", timeoutMs);
             }
-            else
+            self->stats.timeouts++;
+            return ERROR_EVI_TIMEOUT;
+        }
+        received = ready < 0 ? -1 : transport->read(self->connection, rx->data, EVI_MAX_LINE_LENGTH - 1);
+        if (received < 0)
+        {
+            // Expected while a module reboots; the caller reports the final error
+            if (self->verbose)
             {
-                ret = ERROR_EVI_RESPONSE_ERROR;
+                fprintf(stderr, "RX: could not read from port\n");
             }
+            self->stats.disconnects++;
+            return ERROR_EVI_INSTRUMENT_NOT_FOUND;
         }
     }
-    eviFreeResponse(response);
-    return ret;
+    rx->data[received] = 0;
+
+    if (self->verbose)
+    {
+        fprintf(stderr, "RX: %s\n", rx->data);
+    }
+
+    rx->length = received;
+    rx->position = 0;
+    self->stats.bytesRx += (uint64_t)received;
+    return ERROR_EVI_OK;
 }
 
-Error_t eviNoReturn_(EvieResponse_t *response, void *user)
+// Reads one response line, bytes received after the end of the line stay in
+// the receive buffer for the next call.
+static Error_t eviReadLine(Evi_t *self, char *buffer, size_t size, uint32_t timeoutMs)
 {
-    if (response->argc == 1)
+    EviRxBuffer_t *rx = &self->rx;
+    size_t count = 0;
+    bool waitForStart = true;
+    bool done = false;
+    bool useChecksum = false;
+    int checkSumSeparator = -1;
+    crc_t crc = crc_init();
+    crc_t crcAtSeparator = 0;
+    uint64_t deadline = 0;
+
+    do
     {
-        return ERROR_EVI_OK;
+        if (rx->position >= rx->length)
+        {
+            if (deadline == 0)
+            {
+                deadline = eviMonotonicMs() + timeoutMs;
+            }
+            Error_t ret = eviFill(self, deadline, timeoutMs);
+            if (ret != ERROR_EVI_OK)
+            {
+                return ret;
+            }
+        }
+
+        while (rx->position < rx->length && !done)
+        {
+            char c = rx->data[rx->position++];
+            if (waitForStart)
+            {
+                if (c == EVI_START_NO_CHK || c == EVI_START_WITH_CHK)
+                {
+                    waitForStart = false;
+                    if (c == EVI_START_WITH_CHK)
+                    {
+                        useChecksum = true;
+                    }
+                }
+            }
+            else
+            {
+                if (c == EVI_STOP1 || c == EVI_STOP2)
+                {
+                    done = true;
+                }
+                else if (count + 1 < size)
+                {
+                    // The checksum covers everything up to the last separator, it is
+                    // updated while the bytes arrive instead of in a second pass
+                    buffer[count] = c;
+                    if (c == EVI_CHECKSUM_SEPARATOR)
+                    {
+                        checkSumSeparator = count;
+                        crcAtSeparator = crc;
+                    }
+                    crc = crc_update_byte(crc, (unsigned char)c);
+                    count++;
+                }
+            }
+        }
+    } while (!done);
+    buffer[count] = 0;
+    self->stats.responses++;
+    if (self->inFlight > 0)
+    {
+        self->inFlight--;
     }
-    else
+
+    if (useChecksum)
     {
-        return ERROR_EVI_PROTOCOL_ERROR;
+        uint32_t crcReceived;
+        crc = crc_finalize(checkSumSeparator >= 0 ? crcAtSeparator : crc);
+        if (checkSumSeparator >= 0 && eviParseUInt32(buffer + checkSumSeparator + 1, &crcReceived) && crc == crcReceived)
+        {
+            buffer[checkSumSeparator] = 0;
+        }
+        else
+        {
+            fprintf(stderr, "CRC differ: received message %s, calculated crc=%u\n", buffer, (uint32_t)crc);
+            self->stats.crcErrors++;
+            return ERROR_EVI_PROTOCOL_ERROR;
+        }
     }
-}
 
+    return ERROR_EVI_OK;
+}
 
-Error_t eviGet_(EvieResponse_t *response, void *user)
+static Error_t eviReceive(Evi_t *self, EvieResponse_t *response, uint32_t timeoutMs)
 {
-    UserGet *u = (UserGet *)user;
-    if (response->argc == 2)
+    Error_t ret = eviReadLine(self, response->response, EVI_MAX_LINE_LENGTH, timeoutMs);
+    if (ret == ERROR_EVI_OK)
     {
-        strncpy_s(u->value, u->length, response->argv[1], u->length);
-        return ERROR_EVI_OK;
+        eviTokenize(response);
     }
     else
     {
-        return ERROR_EVI_PROTOCOL_ERROR;
+        // The stream is out of sync, drop what is left of it
+        self->rx.length = 0;
     }
+    return ret;
 }
 
-Error_t eviGet(Evi_t * self, uint32_t index, char * value, size_t valueSize)
+static uint32_t eviCommandTimeout(const Evi_t *self, const char * command)
 {
-    char cmd[EVI_MAX_LINE_LENGTH];
-    UserGet user = { 0 };
-    user.value = value;
-    user.length = valueSize;
-    sprintf_s(cmd, EVI_MAX_LINE_LENGTH, "V %i", index);
-    return eviExecute(self, cmd, eviGet_, &user);
+    uint32_t shortMs = self->timeoutShortMs > 0 ? self->timeoutShortMs : EVI_TIMEOUT_SHORT_MS;
+    uint32_t longMs  = self->timeoutLongMs > 0 ? self->timeoutLongMs : EVI_TIMEOUT_LONG_MS;
+
+    switch (command[0])
+    {
+    case 'M':
+        // "M" measures, "M n" reads a stored measurement back
+        return command[1] == '\0' ? longMs : shortMs;
+    case 'C': // autogain
+    case 'G': // baseline
+    case 'X': // cuvette holder check
+    case 'Y': // selftest
+    case 'F': // firmware update: erase
+    case 'S': // firmware update: write record
+    case 'R': // firmware update: reboot
+        return longMs;
+    default:
+        return shortMs;
+    }
 }
 
-Error_t eviSet(Evi_t * self, uint32_t index, const char * value)
+static bool eviIsConnectionError(Error_t error)
 {
-    char cmd[EVI_MAX_LINE_LENGTH];
-    sprintf_s(cmd, EVI_MAX_LINE_LENGTH, "V %i %s", index, value);
-    return eviExecute(self, cmd, eviNoReturn_, 0);
+    return error == ERROR_EVI_INSTRUMENT_NOT_FOUND || error == ERROR_EVI_TIMEOUT;
 }
 
-Error_t eviLogging_(EvieResponse_t *response, void *user)
+// A broken or timed out session may still deliver the answer later. It is
+// closed, the next command reopens the port which flushes the stale input.
+static void eviCommandFailed(Evi_t *self, Error_t error)
 {
-    UserLogging *u = (UserLogging *)user;
-    if (response->argc == 2)
-    {
-        strncpy_s(u->line, u->length, response->argv[1], u->length);
-        return ERROR_EVI_OK;
-    }
-    else
+    if (eviIsConnectionError(error))
     {
-        return ERROR_EVI_PROTOCOL_ERROR;
+        if (self->portFromCache)
+        {
+            // The cached port does not answer, the next session searches again.
+            eviCacheInvalidateDevice(self->port);
+        }
+        eviClose(self);
     }
 }
 
-Error_t eviLogging(Evi_t *self, char *line, size_t length)
+// Commands which only read can be sent again after a connection loss without
+// changing the state of the device.
+static bool eviIsIdempotent(const char * command)
 {
-    UserLogging user = { 0 };
-    user.length = length;
-    user.line = line;
+    // Every command is a single letter, followed by the end or a space
+    if (command[0] == '\0' || (command[1] != '\0' && command[1] != ' '))
+    {
+        return false;
+    }
 
-    char cmd[EVI_MAX_LINE_LENGTH];
-    sprintf_s(cmd, EVI_MAX_LINE_LENGTH, "Q");
-    return eviExecute(self, cmd, eviLogging_, &user);
+    switch (command[0])
+    {
+    case 'V':
+        // "V index" reads, "V index value" writes; a bare "V" is not a read
+        return command[1] == ' ' && strchr(command + 2, ' ') == NULL;
+    case 'M':
+        // "M n" reads a stored measurement back, "M" measures
+        return command[1] == ' ';
+    case 'X':
+    case 'Q':
+        return true;
+    default:
+        return false;
+    }
 }
 
-Error_t eviSelftest_(EvieResponse_t *response, void *user)
+static bool eviRetry(Evi_t *self, const char * command, uint32_t attempt, uint32_t *backoffMs)
 {
-    UserSelftest *u = (UserSelftest *)user;
-    if (response->argc == 2)
+    uint32_t retries = self->retries > 0 ? self->retries : EVI_RETRIES_DEFAULT;
+    if (attempt >= retries)
     {
-        *(u->result)    = strtoul(response->argv[1], 0, 10);
-        return ERROR_EVI_OK;
+        return false;
     }
-    else
+    if (self->verbose)
     {
-        return ERROR_EVI_PROTOCOL_ERROR;
+        fprintf(stderr, "RETRY: %s in %u ms\n", command, *backoffMs);
     }
+    self->stats.retries++;
+    Sleep(*backoffMs);
+    *backoffMs = (*backoffMs * 2 < EVI_RETRY_BACKOFF_MAX_MS) ? *backoffMs * 2 : EVI_RETRY_BACKOFF_MAX_MS;
+    return true;
 }
 
-Error_t eviSelftest(Evi_t * self, uint32_t * result)
+Error_t eviCommandComm(Evi_t *self, const char * command, EvieResponse_t *response)
 {
-    UserSelftest user = {.result = result};
-    return eviExecute(self, "Y", eviSelftest_, &user);
+    uint64_t start = eviMonotonicUs();
+    if (!eviSend(self, command))
+    {
+        return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+    }
+    Error_t ret = eviReceive(self, response, eviCommandTimeout(self, command));
+    if (ret == ERROR_EVI_OK)
+    {
+        eviStatsLatency(&self->stats, eviMonotonicUs() - start);
+    }
+    return ret;
 }
 
-static int getlineInternal(char **lineptr, size_t *n, FILE *stream) {
-    char *bufptr = NULL;
-    char *p = bufptr;
-    size_t size;
-    int c;
-
-    if (lineptr == NULL) {
-        return -1;
-    }
-    if (stream == NULL) {
-        return -1;
+bool eviDeviceListAdd(EviDeviceInfo_t *devices, size_t maxDevices, size_t *count, const char *port, const char *serialNumber)
+{
+    for (size_t i = 0; i < *count; i++)
+    {
+        if (strcmp(devices[i].port, port) == 0)
+        {
+            return false;
+        }
     }
-    if (n == NULL) {
-        return -1;
+    if (*count >= maxDevices)
+    {
+        return false;
     }
-    bufptr = *lineptr;
-    size = *n;
+    strcpy_s(devices[*count].port, sizeof(devices[*count].port), port);
+    strcpy_s(devices[*count].serialNumber, sizeof(devices[*count].serialNumber), serialNumber);
+    (*count)++;
+    return true;
+}
 
-    c = fgetc(stream);
-    if (c == EOF) {
-        return -1;
-    }
-    if (bufptr == NULL) {
-        bufptr = malloc(128);
-        if (bufptr == NULL) {
-            return -1;
-        }
-        size = 128;
+Error_t eviFindDeviceEx(const char *serialNumber, char *portName, size_t *portNameSize, char *serialNumberFound, size_t serialNumberFoundSize, bool verbose)
+{
+    Error_t ret = ERROR_EVI_INSTRUMENT_NOT_FOUND;
+    size_t count = 0;
+    EviDeviceInfo_t *devices = (EviDeviceInfo_t *)calloc(EVI_MAX_DEVICES, sizeof(EviDeviceInfo_t));
+
+    if (devices == NULL)
+    {
+        return ret;
     }
-    p = bufptr;
-    while(c != EOF) {
-        if ((p - bufptr) > (size - 1)) {
-            size = size + 128;
-            bufptr = realloc(bufptr, size);
-            if (bufptr == NULL) {
-                return -1;
+
+    eviEnumerateDevices(devices, EVI_MAX_DEVICES, &count, verbose);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (serialNumber == NULL || strcmp(serialNumber, devices[i].serialNumber) == 0)
+        {
+            *portNameSize = snprintf(portName, *portNameSize, "%s", devices[i].port);
+            if (serialNumberFound)
+            {
+                strcpy_s(serialNumberFound, serialNumberFoundSize, devices[i].serialNumber);
             }
-        }
-        *p++ = c;
-        if (c == '\n') {
+            if (verbose)
+            {
+                fprintf(stderr, "DEVICE: %s\n", portName);
+            }
+            ret = ERROR_EVI_OK;
             break;
         }
-        c = fgetc(stream);
     }
 
-    *p++ = '\0';
-    *lineptr = bufptr;
-    *n = size;
+    free(devices);
+    return ret;
+}
 
-    return p - bufptr - 1;
+Error_t eviFindDevice(char *portName, size_t *portNameSize, bool verbose)
+{
+    return eviFindDeviceEx(NULL, portName, portNameSize, NULL, 0, verbose);
 }
 
-Error_t eviFwUpdate(Evi_t * self, const char * file)
+static Error_t eviResolvePort(Evi_t *self, const char *portName, const char *serialNumber)
 {
     Error_t ret = ERROR_EVI_OK;
-    FILE * f = fopen(file, "r");
-    if(f != NULL)
-    {
-        size_t n;
-        char * line = NULL;
-        int length = 0;
-        Error_t ret;
-        char cmd[255];
-        char portNameBuffer[1024];
-        size_t portNameBufferSize = sizeof(portNameBuffer);
-        
-        if(self->portName == 0)
-        {
-            ret = eviFindDevice(portNameBuffer, &portNameBufferSize, self->verbose);
-            if(ret != ERROR_EVI_OK)
-            {
-                fclose(f);
-                return ret;
-            }
-        }
-        else
+    size_t portSize = sizeof(self->port);
+
+    self->portFromCache = false;
+    self->usbSerialNumber[0] = 0;
+
+    if (portName)
+    {
+        strcpy_s(self->port, sizeof(self->port), portName);
+    }
+    else if (eviCacheLookupDevice(serialNumber, self->port, sizeof(self->port), self->usbSerialNumber, sizeof(self->usbSerialNumber)))
+    {
+        self->portFromCache = true;
+    }
+    else
+    {
+        ret = eviFindDeviceEx(serialNumber, self->port, &portSize, self->usbSerialNumber, sizeof(self->usbSerialNumber), self->verbose);
+        if (ret == ERROR_EVI_OK)
         {
-            strcpy_s(portNameBuffer, portNameBufferSize, self->portName);
+            eviCacheStoreDevice(self->usbSerialNumber, self->port);
         }
+    }
+    return ret;
+}
 
-        EvieResponse_t *response = eviCreateResponse();
-        EVI_HANDLE hComm = eviPortOpen(portNameBuffer);
-        ret = eviCommandComm(self, hComm, "F", response);
-        do
+static bool eviConnect(Evi_t *self)
+{
+    self->connection = self->connectionTransport->open(self->port, self->transportUser, self->verbose);
+    return self->connection != NULL;
+}
+
+static bool eviRediscover(Evi_t *self, const char *serialNumber)
+{
+    size_t portSize = sizeof(self->port);
+
+    // The device re-enumerated, e.g. after a brown-out, and may have got another port
+    if (eviFindDeviceEx(serialNumber, self->port, &portSize, self->usbSerialNumber, sizeof(self->usbSerialNumber), self->verbose) != ERROR_EVI_OK)
+    {
+        return false;
+    }
+    if (self->verbose)
+    {
+        fprintf(stderr, "DEVICE: %s (rediscovered)\n", self->port);
+    }
+    eviCacheStoreDevice(self->usbSerialNumber, self->port);
+    self->portFromCache = false;
+    return eviConnect(self);
+}
+
+// Opens a transport which finds its port by USB serial number, the cache and
+// a new search cover ports which disappeared or changed.
+static bool eviOpenDiscovered(Evi_t *self, const char *portName, const char *wantedSerialNumber)
+{
+    Error_t ret = eviResolvePort(self, portName, wantedSerialNumber);
+    bool connected = false;
+
+    if (ret == ERROR_EVI_OK)
+    {
+        if (self->verbose && self->portFromCache)
         {
-            length = getlineInternal(&line, &n, f);
-            if(length != -1)
-            {
-                snprintf(cmd, sizeof(cmd), "S %s", line);
-                ret = eviCommandComm(self, hComm, cmd, response);
-                if(ret != ERROR_EVI_OK)
-                {
-                    return ret;
-                }
-            }
+            fprintf(stderr, "DEVICE: %s (cached)\n", self->port);
         }
-        while(length != -1 && ret == ERROR_EVI_OK);
 
-        ret = eviCommandComm(self, hComm, "R", response);
-        if(ret != ERROR_EVI_OK)
+        connected = eviConnect(self);
+        if (!connected && self->portFromCache)
         {
-            return ret;
+            // Stale cache entry, forget it and search again
+            eviCacheInvalidateDevice(self->port);
+            ret = eviResolvePort(self, portName, wantedSerialNumber);
+            connected = (ret == ERROR_EVI_OK) && eviConnect(self);
         }
+    }
+
+    if (!connected && wantedSerialNumber)
+    {
+        connected = eviRediscover(self, wantedSerialNumber);
+    }
+
+    if (connected && self->usbSerialNumber[0] == 0)
+    {
+        // Explicit port, remember the device for reconnects
+        eviPortSerialNumber(self->port, self->usbSerialNumber, sizeof(self->usbSerialNumber));
+    }
+    return connected;
+}
 
-        Sleep(30000);
+// Opens a transport which is addressed directly, by the port name or else by
+// the USB serial number.
+static bool eviOpenAddressed(Evi_t *self, const char *portName, const char *wantedSerialNumber)
+{
+    const char *address = (portName && portName[0] != 0) ? portName : wantedSerialNumber;
+
+    self->portFromCache = false;
+    self->usbSerialNumber[0] = 0;
+    strcpy_s(self->port, sizeof(self->port), address ? address : "");
+
+    if (!eviConnect(self))
+    {
+        return false;
+    }
+    if (self->connectionTransport->serialNumber)
+    {
+        self->connectionTransport->serialNumber(self->connection, self->usbSerialNumber, sizeof(self->usbSerialNumber));
+    }
+    return true;
+}
+
+Error_t eviOpen(Evi_t *self)
+{
+    const char *portName = self->portName;
+    bool connected;
+
+    if (self->connected)
+    {
+        return ERROR_EVI_OK;
+    }
+
+    // Look for the requested module, a reopened session stays with the module of the previous one
+    char serialNumber[EVI_MAX_SERIAL_NUMBER_LENGTH];
+    strcpy_s(serialNumber, sizeof(serialNumber), self->serialNumber ? self->serialNumber : self->usbSerialNumber);
+    const char *wantedSerialNumber = serialNumber[0] != 0 ? serialNumber : NULL;
+
+    if (self->transport)
+    {
+        size_t n = strlen(self->transport->name);
+        self->connectionTransport = self->transport;
+        if (portName && strncmp(portName, self->transport->name, n) == 0 && portName[n] == ':')
+        {
+            portName += n + 1;
+        }
+    }
+    else
+    {
+        self->connectionTransport = eviTransportForPort(self->portName, &portName);
+    }
 
-        free(line);
-        fclose(f);
-        eviFreeResponse(response);
-        eviPortClose(hComm);
+    if (self->connectionTransport->discover)
+    {
+        connected = eviOpenDiscovered(self, portName, wantedSerialNumber);
     }
     else
     {
-        ret = ERROR_EVI_FILE_NOT_FOUND;
+        connected = eviOpenAddressed(self, portName, wantedSerialNumber);
     }
 
-    return ret;
+    if (connected)
+    {
+        self->connected = true;
+        self->rx.length = 0;
+        self->rx.position = 0;
+        self->inFlight = 0;
+        // The module may have been replaced or updated while the session was closed
+        self->constantCache.loaded = false;
+        self->constantCache.count = 0;
+        return ERROR_EVI_OK;
+    }
+
+    if (wantedSerialNumber)
+    {
+        // Keep looking for the same device on the next attempt
+        strcpy_s(self->usbSerialNumber, sizeof(self->usbSerialNumber), wantedSerialNumber);
+    }
+    return ERROR_EVI_INSTRUMENT_NOT_FOUND;
+}
+
+void eviClose(Evi_t *self)
+{
+    if (self->connected)
+    {
+        self->connectionTransport->close(self->connection);
+        self->connection = NULL;
+        self->connected = false;
+    }
+    self->inFlight = 0;
+}
+
+Error_t eviCommand(Evi_t *self, const char * command, EvieResponse_t *response)
+{
+    Error_t ret;
+    uint32_t backoffMs = EVI_RETRY_BACKOFF_MIN_MS;
+
+    for (uint32_t attempt = 0; ; attempt++)
+    {
+        bool sent = false;
+        ret = eviOpen(self);
+        if (ret == ERROR_EVI_OK)
+        {
+            sent = true;
+            ret = eviCommandComm(self, command, response);
+            eviCommandFailed(self, ret);
+        }
+
+        // A command which never reached the device can always be tried again
+        if (!eviIsConnectionError(ret) || (sent && !eviIsIdempotent(command)) || !eviRetry(self, command, attempt, &backoffMs))
+        {
+            break;
+        }
+    }
+    return ret;
+}
+
+static Error_t eviDispatch(Evi_t *self, const char * cmd, EvieResponse_t *response, EviResponseHandler_t execute, void *user, bool mayFail)
+{
+    Error_t ret;
+    if (response->argc > 0 && strncmp(response->argv[0], cmd, 1) == 0)
+    {
+        ret = execute(response, user);
+    }
+    else
+    {
+        uint32_t error;
+        if(response->argc == 2 && strncmp(response->argv[0], "E", 1) == 0 && eviParseUInt32(response->argv[1], &error))
+        {
+            if (!mayFail)
+            {
+                self->stats.deviceErrors++;
+            }
+            ret = error;
+        }
+        else
+        {
+            ret = ERROR_EVI_RESPONSE_ERROR;
+        }
+    }
+    return ret;
+}
+
+Error_t eviExecute(Evi_t * self, char * cmd, Error_t(execute)(EvieResponse_t *response, void *user), void *user)
+{
+    EvieResponse_t response;
+    Error_t ret = eviCommand(self, cmd, &response);
+    if (ret == ERROR_EVI_OK)
+    {
+        ret = eviDispatch(self, cmd, &response, execute, user, false);
+    }
+    return ret;
+}
+
+// Sends the requests with up to a window of them in flight. With stopOnError
+// nothing more is sent after the first failed request; the requests already
+// in flight are still received so the stream stays in sync.
+static Error_t eviPipeline(Evi_t * self, EviRequest_t *requests, size_t count, bool stopOnError)
+{
+    size_t window = self->pipelineWindow > 0 ? self->pipelineWindow : EVI_PIPELINE_WINDOW_DEFAULT;
+    size_t received = 0;
+    size_t limit = count;
+    uint32_t backoffMs = EVI_RETRY_BACKOFF_MIN_MS;
+    Error_t failure;
+    EvieResponse_t response;
+    // Send times of the commands in flight, a wider window measures only the latency of every command it can hold
+    uint64_t sentUs[EVI_PIPELINE_WINDOW_DEFAULT * 8];
+    const size_t slots = sizeof(sentUs) / sizeof(sentUs[0]);
+
+    for (uint32_t attempt = 0; ; attempt++)
+    {
+        size_t sent = received;
+        failure = eviOpen(self);
+
+        while (failure == ERROR_EVI_OK && received < limit)
+        {
+            // Keep up to window commands in flight, the device answers them in order
+            while (sent < limit && (sent - received) < window && failure == ERROR_EVI_OK)
+            {
+                if (eviSend(self, requests[sent].command))
+                {
+                    sentUs[sent % slots] = eviMonotonicUs();
+                    sent++;
+                }
+                else
+                {
+                    failure = ERROR_EVI_INSTRUMENT_NOT_FOUND;
+                }
+            }
+
+            if (failure == ERROR_EVI_OK)
+            {
+                failure = eviReceive(self, &response, eviCommandTimeout(self, requests[received].command));
+            }
+            if (failure == ERROR_EVI_OK)
+            {
+                if (sent - received <= slots)
+                {
+                    eviStatsLatency(&self->stats, eviMonotonicUs() - sentUs[received % slots]);
+                }
+                EviRequest_t *request = &requests[received++];
+                request->result = eviDispatch(self, request->command, &response, request->execute, request->user, request->mayFail);
+                if (stopOnError && request->result != ERROR_EVI_OK)
+                {
+                    limit = sent;
+                }
+            }
+        }
+        eviCommandFailed(self, failure);
+        if (failure != ERROR_EVI_OK && received < sent)
+        {
+            // The replies still in flight would be taken as the answers of the
+            // next exchange; reopening the port flushes them.
+            eviClose(self);
+        }
+
+        // Resend the unanswered commands only if none of them changes the device
+        bool idempotent = true;
+        for (size_t i = received; i < sent; i++)
+        {
+            idempotent = idempotent && eviIsIdempotent(requests[i].command);
+        }
+        if (!eviIsConnectionError(failure) || !idempotent || !eviRetry(self, requests[received].command, attempt, &backoffMs))
+        {
+            break;
+        }
+    }
+
+    Error_t ret = ERROR_EVI_OK;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i >= received)
+        {
+            requests[i].result = failure != ERROR_EVI_OK ? failure : ERROR_EVI_PROGRAMMING_FAILED;
+        }
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = requests[i].result;
+        }
+    }
+    return ret;
+}
+
+Error_t eviExecutePipelined(Evi_t * self, EviRequest_t *requests, size_t count)
+{
+    return eviPipeline(self, requests, count, false);
+}
+
+Error_t eviNoReturn_(EvieResponse_t *response, void *user)
+{
+    if (response->argc == 1)
+    {
+        return ERROR_EVI_OK;
+    }
+    else
+    {
+        return ERROR_EVI_PROTOCOL_ERROR;
+    }
+}
+
+
+Error_t eviGet_(EvieResponse_t *response, void *user)
+{
+    UserGet *u = (UserGet *)user;
+    if (response->argc == 2)
+    {
+        strncpy_s(u->value, u->length, response->argv[1], u->length);
+        return ERROR_EVI_OK;
+    }
+    else
+    {
+        return ERROR_EVI_PROTOCOL_ERROR;
+    }
+}
+
+#define EVI_BATCH_SIZE 16
+
+static Error_t eviValuesMany(Evi_t * self, EviValue_t * values, size_t count, bool set);
+
+// Values which never change while a module runs, unless they are set
+static const uint32_t eviDefaultConstants[] = { INDEX_VERSION, INDEX_SERIALNUMBER, INDEX_PRODUCTIONNUMBER };
+
+static bool eviIsConstant(const Evi_t *self, uint32_t index)
+{
+    const uint32_t *constants = self->constants ? self->constants : eviDefaultConstants;
+    size_t count = self->constants ? self->constantCount : sizeof(eviDefaultConstants) / sizeof(eviDefaultConstants[0]);
+
+    for (size_t i = 0; i < count && i < EVI_MAX_CONSTANTS; i++)
+    {
+        if (constants[i] == index)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *eviConstantLookup(const Evi_t *self, uint32_t index)
+{
+    const EviConstants_t *cache = &self->constantCache;
+    for (size_t i = 0; i < cache->count; i++)
+    {
+        if (cache->index[i] == index)
+        {
+            return cache->value[i];
+        }
+    }
+    return NULL;
+}
+
+// Reads all constants of the connected module in one exchange, or takes them from the cache file.
+// Indices the module rejects are not cached, they are read every time.
+static void eviConstantsLoad(Evi_t *self)
+{
+    EviConstants_t *cache = &self->constantCache;
+    const uint32_t *constants = self->constants ? self->constants : eviDefaultConstants;
+    size_t count = self->constants ? self->constantCount : sizeof(eviDefaultConstants) / sizeof(eviDefaultConstants[0]);
+    EviValue_t values[EVI_MAX_CONSTANTS];
+    EviConstants_t entry;
+
+    if (cache->loaded)
+    {
+        return;
+    }
+    if (self->persistConstants && eviCacheLookupConstants(self->usbSerialNumber, self->port, &entry))
+    {
+        // Another module or firmware may sit behind the same serial number and
+        // port by now. The file entry is only taken if the version still matches.
+        char version[EVI_MAX_VALUE_LENGTH];
+        for (size_t i = 0; i < entry.count; i++)
+        {
+            if (entry.index[i] == INDEX_VERSION && eviGetUncached(self, INDEX_VERSION, version, sizeof(version)) == ERROR_EVI_OK && strcmp(entry.value[i], version) == 0)
+            {
+                *cache = entry;
+                return;
+            }
+        }
+        // A lost connection cleared the cache, the values may belong to another module
+        if (!self->connected)
+        {
+            return;
+        }
+    }
+
+    count = count < EVI_MAX_CONSTANTS ? count : EVI_MAX_CONSTANTS;
+    for (size_t i = 0; i < count; i++)
+    {
+        values[i].index = constants[i];
+    }
+    eviValuesMany(self, values, count, false);
+
+    // A lost connection cleared the cache, the values may belong to another module
+    if (!self->connected)
+    {
+        return;
+    }
+    cache->count = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (values[i].result == ERROR_EVI_OK)
+        {
+            cache->index[cache->count] = values[i].index;
+            strcpy_s(cache->value[cache->count], EVI_MAX_VALUE_LENGTH, values[i].value);
+            cache->count++;
+        }
+    }
+    cache->loaded = true;
+    if (self->persistConstants)
+    {
+        eviCacheStoreConstants(self->usbSerialNumber, self->port, cache);
+    }
+}
+
+void eviInvalidateConstants(Evi_t *self)
+{
+    self->constantCache.loaded = false;
+    self->constantCache.count = 0;
+    if (self->persistConstants && self->usbSerialNumber[0] != 0)
+    {
+        eviCacheInvalidateConstants(self->usbSerialNumber);
+    }
+}
+
+Error_t eviGetUncached(Evi_t * self, uint32_t index, char * value, size_t valueSize)
+{
+    char cmd[EVI_MAX_LINE_LENGTH];
+    UserGet user = { 0 };
+    user.value = value;
+    user.length = valueSize;
+    sprintf_s(cmd, EVI_MAX_LINE_LENGTH, "V %i", index);
+    return eviExecute(self, cmd, eviGet_, &user);
+}
+
+Error_t eviGet(Evi_t * self, uint32_t index, char * value, size_t valueSize)
+{
+    const char *cached;
+
+    if (eviIsConstant(self, index) && eviOpen(self) == ERROR_EVI_OK)
+    {
+        eviConstantsLoad(self);
+        cached = eviConstantLookup(self, index);
+        if (cached != NULL)
+        {
+            strcpy_s(value, valueSize, cached);
+            return ERROR_EVI_OK;
+        }
+    }
+    return eviGetUncached(self, index, value, valueSize);
+}
+
+Error_t eviSet(Evi_t * self, uint32_t index, const char * value)
+{
+    char cmd[EVI_MAX_LINE_LENGTH];
+    if (eviIsConstant(self, index))
+    {
+        eviInvalidateConstants(self);
+    }
+    sprintf_s(cmd, EVI_MAX_LINE_LENGTH, "V %i %s", index, value);
+    return eviExecute(self, cmd, eviNoReturn_, 0);
+}
+
+static Error_t eviValuesMany(Evi_t * self, EviValue_t * values, size_t count, bool set)
+{
+    Error_t ret = ERROR_EVI_OK;
+    char cmds[EVI_BATCH_SIZE][EVI_MAX_LINE_LENGTH];
+    UserGet users[EVI_BATCH_SIZE];
+    EviRequest_t requests[EVI_BATCH_SIZE];
+
+    for (size_t first = 0; first < count; first += EVI_BATCH_SIZE)
+    {
+        size_t n = (count - first) < EVI_BATCH_SIZE ? (count - first) : EVI_BATCH_SIZE;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            EviValue_t *value = &values[first + i];
+            requests[i].command = cmds[i];
+            requests[i].mayFail = false;
+            if (set)
+            {
+                sprintf_s(cmds[i], EVI_MAX_LINE_LENGTH, "V %i %s", value->index, value->value);
+                requests[i].execute = eviNoReturn_;
+                requests[i].user = 0;
+            }
+            else
+            {
+                sprintf_s(cmds[i], EVI_MAX_LINE_LENGTH, "V %i", value->index);
+                users[i].value = value->value;
+                users[i].length = sizeof(value->value);
+                requests[i].execute = eviGet_;
+                requests[i].user = &users[i];
+            }
+        }
+
+        Error_t r = eviExecutePipelined(self, requests, n);
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = r;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            values[first + i].result = requests[i].result;
+        }
+    }
+    return ret;
+}
+
+Error_t eviGetMany(Evi_t * self, EviValue_t * values, size_t count)
+{
+    EviValue_t *missing;
+    size_t cached = 0;
+    size_t n = 0;
+    Error_t ret = ERROR_EVI_OK;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        cached += eviIsConstant(self, values[i].index);
+    }
+    if (cached == 0 || eviOpen(self) != ERROR_EVI_OK)
+    {
+        return eviValuesMany(self, values, count, false);
+    }
+
+    // Constants are answered from the cache, only the other indices are sent
+    eviConstantsLoad(self);
+    cached = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const char *value = eviIsConstant(self, values[i].index) ? eviConstantLookup(self, values[i].index) : NULL;
+        if (value != NULL)
+        {
+            strcpy_s(values[i].value, sizeof(values[i].value), value);
+            values[i].result = ERROR_EVI_OK;
+            cached++;
+        }
+        else
+        {
+            values[i].result = ERROR_EVI_PROGRAMMING_FAILED;
+        }
+    }
+    if (cached == count)
+    {
+        return ERROR_EVI_OK;
+    }
+    if (cached == 0)
+    {
+        return eviValuesMany(self, values, count, false);
+    }
+
+    missing = (EviValue_t *)malloc((count - cached) * sizeof(EviValue_t));
+    if (missing == NULL)
+    {
+        return eviValuesMany(self, values, count, false);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (values[i].result != ERROR_EVI_OK)
+        {
+            missing[n++].index = values[i].index;
+        }
+    }
+    eviValuesMany(self, missing, n, false);
+    n = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (values[i].result != ERROR_EVI_OK)
+        {
+            values[i] = missing[n++];
+        }
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = values[i].result;
+        }
+    }
+    free(missing);
+    return ret;
+}
+
+Error_t eviSetMany(Evi_t * self, EviValue_t * values, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (eviIsConstant(self, values[i].index))
+        {
+            eviInvalidateConstants(self);
+            break;
+        }
+    }
+    return eviValuesMany(self, values, count, true);
+}
+
+Error_t eviLogging_(EvieResponse_t *response, void *user)
+{
+    UserLogging *u = (UserLogging *)user;
+    if (response->argc == 2)
+    {
+        strncpy_s(u->line, u->length, response->argv[1], u->length);
+        return ERROR_EVI_OK;
+    }
+    else
+    {
+        return ERROR_EVI_PROTOCOL_ERROR;
+    }
+}
+
+Error_t eviLogging(Evi_t *self, char *line, size_t length)
+{
+    UserLogging user = { 0 };
+    user.length = length;
+    user.line = line;
+
+    char cmd[EVI_MAX_LINE_LENGTH];
+    sprintf_s(cmd, EVI_MAX_LINE_LENGTH, "Q");
+    return eviExecute(self, cmd, eviLogging_, &user);
+}
+
+Error_t eviSelftest_(EvieResponse_t *response, void *user)
+{
+    UserSelftest *u = (UserSelftest *)user;
+    if (response->argc == 2)
+    {
+        return eviParseUInt32(response->argv[1], u->result) ? ERROR_EVI_OK : ERROR_EVI_PROTOCOL_ERROR;
+    }
+    else
+    {
+        return ERROR_EVI_PROTOCOL_ERROR;
+    }
+}
+
+Error_t eviSelftest(Evi_t * self, uint32_t * result)
+{
+    UserSelftest user = {.result = result};
+    return eviExecute(self, "Y", eviSelftest_, &user);
+}
+
+// True once the connection of the session broke or its port disappeared.
+static bool eviWaitForDrop(Evi_t *self, uint64_t deadline)
+{
+    const EviTransport_t *transport = self->connectionTransport;
+
+    while (self->connected)
+    {
+        uint64_t now = eviMonotonicMs();
+        if (now >= deadline)
+        {
+            return false;
+        }
+        int ready = transport->poll(self->connection, (uint32_t)(deadline - now < EVI_REBOOT_POLL_MS ? deadline - now : EVI_REBOOT_POLL_MS));
+        if (ready > 0)
+        {
+            // Whatever the old firmware still sends is of no interest
+            char discard[64];
+            ready = transport->read(self->connection, discard, sizeof(discard));
+        }
+        if (ready < 0 || (transport->discover && !eviPortExists(self->port)))
+        {
+            return true;
+        }
+    }
+    return true;
+}
+
+Error_t eviWaitForReboot(Evi_t *self, uint32_t timeoutMs, char *version, size_t versionSize)
+{
+    uint64_t start = eviMonotonicMs();
+    uint64_t deadline = start + timeoutMs;
+    uint32_t retries = self->retries;
+    uint32_t timeoutShortMs = self->timeoutShortMs;
+    char value[EVI_MAX_VALUE_LENGTH];
+    Error_t ret = ERROR_EVI_INSTRUMENT_NOT_FOUND;
+
+    bool dropped = eviWaitForDrop(self, start + (timeoutMs < EVI_REBOOT_DROP_MS ? timeoutMs : EVI_REBOOT_DROP_MS));
+    if (self->verbose)
+    {
+        fprintf(stderr, "REBOOT: %s after %u ms\n", dropped ? "module gone" : "module did not drop off", (uint32_t)(eviMonotonicMs() - start));
+    }
+    eviClose(self);
+
+    // Every attempt is short, the deadline bounds them all
+    self->retries = 1;
+    self->timeoutShortMs = EVI_REBOOT_ANSWER_MS;
+    while (eviMonotonicMs() < deadline)
+    {
+        ret = eviGetUncached(self, INDEX_VERSION, value, sizeof(value));
+        if (ret == ERROR_EVI_OK)
+        {
+            break;
+        }
+        eviClose(self);
+        Sleep(EVI_REBOOT_POLL_MS);
+    }
+    self->retries = retries;
+    self->timeoutShortMs = timeoutShortMs;
+
+    if (self->verbose)
+    {
+        fprintf(stderr, "REBOOT: %s after %u ms\n", ret == ERROR_EVI_OK ? "module answers" : "module lost", (uint32_t)(eviMonotonicMs() - start));
+    }
+    if (ret == ERROR_EVI_OK && version != NULL)
+    {
+        strcpy_s(version, versionSize, value);
+    }
+    return ret;
+}
+
+typedef struct
+{
+    EviFwProgress_t progress;
+    void *user;
+    size_t done;
+    size_t total;
+} UserFwUpdate;
+
+static void eviFwReport(UserFwUpdate *u, EviFwPhase_t phase, size_t done)
+{
+    if (u->progress)
+    {
+        u->progress(phase, done, u->total, u->user);
+    }
+}
+
+static Error_t eviFwRecord_(EvieResponse_t *response, void *user)
+{
+    UserFwUpdate *u = (UserFwUpdate *)user;
+    Error_t ret = eviNoReturn_(response, NULL);
+    if (ret == ERROR_EVI_OK)
+    {
+        eviFwReport(u, EVI_FW_PHASE_WRITE, ++u->done);
+    }
+    return ret;
+}
+
+Error_t eviFwUpdateImage(Evi_t * self, const EviSrecImage_t *image, const EviFwOptions_t *options)
+{
+    static const EviFwOptions_t defaults = {.force = true};
+    UserFwUpdate u = {0};
+    EviRequest_t *requests = NULL;
+    char *commands = NULL;
+    char *c;
+    char version[EVI_MAX_VALUE_LENGTH];
+    Error_t ret;
+
+    if (options == NULL)
+    {
+        options = &defaults;
+    }
+    u.progress = options->progress;
+    u.user = options->user;
+
+    if (image->dataBytes == 0)
+    {
+        // Erasing the flash for an image without data leaves a module without firmware
+        fprintf(stderr, "Image without data records\n");
+        return ERROR_EVI_SREC_INVALID_STRING;
+    }
+    if (self->verbose)
+    {
+        fprintf(stderr, "FW: %zu records, %zu bytes, %zu records to send, version '%s'\n", image->sourceRecords, image->dataBytes, image->count, image->version);
+    }
+
+    // Every record becomes an "S <record>" command, all commands share one buffer
+    u.total = image->count;
+    commands = (char *)malloc(image->count * (EVI_SREC_MAX_RECORD_LENGTH + 3));
+    requests = (EviRequest_t *)calloc(image->count + 1, sizeof(EviRequest_t));
+    if (commands == NULL || requests == NULL)
+    {
+        ret = ERROR_EVI_OUT_OF_MEMORY;
+        goto exit;
+    }
+    c = commands;
+    for (size_t i = 0; i < image->count; i++)
+    {
+        requests[i].command = c;
+        requests[i].execute = eviFwRecord_;
+        requests[i].user = &u;
+        c += sprintf(c, "S %s", image->records[i]) + 1;
+    }
+
+    ret = eviOpen(self);
+    if (ret != ERROR_EVI_OK) goto exit;
+
+    if (!options->force && image->version[0] != '\0')
+    {
+        ret = eviGetUncached(self, INDEX_VERSION, version, sizeof(version));
+        if (ret != ERROR_EVI_OK) goto exit;
+        if (strcmp(version, image->version) == 0)
+        {
+            if (options->version != NULL)
+            {
+                strcpy_s(options->version, options->versionSize, version);
+            }
+            eviFwReport(&u, EVI_FW_PHASE_SKIP, 0);
+            goto exit;
+        }
+    }
+
+    // The version and maybe other constants change with the new firmware
+    eviInvalidateConstants(self);
+    eviFwReport(&u, EVI_FW_PHASE_ERASE, 0);
+    ret = eviExecute(self, "F", eviNoReturn_, 0);
+    if (ret != ERROR_EVI_OK) goto exit;
+
+    // The records are streamed with a window in flight, the first rejected one ends the transfer
+    ret = eviPipeline(self, requests, u.total, true);
+    if (ret != ERROR_EVI_OK) goto exit;
+
+    eviFwReport(&u, EVI_FW_PHASE_REBOOT, u.total);
+    ret = eviExecute(self, "R", eviNoReturn_, 0);
+    if (ret != ERROR_EVI_OK) goto exit;
+
+    // The device reboots and re-enumerates, wait until the new firmware answers
+    ret = eviWaitForReboot(self, EVI_REBOOT_TIMEOUT_MS, version, sizeof(version));
+    if (ret == ERROR_EVI_OK && options->version != NULL)
+    {
+        strcpy_s(options->version, options->versionSize, version);
+    }
+    if (ret == ERROR_EVI_OK && image->version[0] != '\0' && strcmp(version, image->version) != 0)
+    {
+        // The S0 text is free-form, a different spelling of the version is no failed update
+        fprintf(stderr, "Warning: module reports version '%s', the image is '%s'\n", version, image->version);
+    }
+
+exit:
+    if (ret != ERROR_EVI_OK)
+    {
+        eviClose(self);
+    }
+    free(requests);
+    free(commands);
+    return ret;
+}
+
+Error_t eviFwUpdateEx(Evi_t * self, const char * file, const EviFwOptions_t *options)
+{
+    EviSrecImage_t image;
+    size_t line;
+    Error_t ret;
+
+    // The image is checked completely before the flash is erased
+    ret = eviSrecLoad(file, options != NULL && options->coalesce, options != NULL ? options->coalesceLength : 0, &image, &line);
+    if (ret != ERROR_EVI_OK)
+    {
+        if (line > 0)
+        {
+            fprintf(stderr, "%s:%zu: invalid record\n", file, line);
+        }
+        return ret;
+    }
+    ret = eviFwUpdateImage(self, &image, options);
+    eviSrecFree(&image);
+    return ret;
+}
+
+Error_t eviFwUpdate(Evi_t * self, const char * file)
+{
+    return eviFwUpdateEx(self, file, NULL);
+}
+
+void eviGetStats(const Evi_t *self, EviStats_t *stats)
+{
+    *stats = self->stats;
+}
+
+void eviResetStats(Evi_t *self)
+{
+    memset(&self->stats, 0, sizeof(EviStats_t));
+}
+
+uint64_t eviStatsBucketLimitUs(size_t bucket)
+{
+    return bucket + 1 < EVI_STATS_LATENCY_BUCKETS ? (uint64_t)EVI_STATS_LATENCY_FIRST_US << bucket : UINT64_MAX;
 }
 
 const char * eviVersion()
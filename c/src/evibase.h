@@ -12,16 +12,6 @@
 #include <ws2tcpip.h>
 #include <windows.h>
 #define DLLEXPORT __declspec(dllexport)
-
-typedef struct
-{
-    HANDLE handle;
-    bool valid;
-    bool isSocket;
-    WSADATA wsa_data;
-    SOCKET socket;
-} EVI_HANDLE;
-
 #else
 #include <stdio.h>
 #include <string.h>
@@ -29,7 +19,6 @@ typedef struct
 #include <ctype.h>
 #include <stdarg.h>
 #define DLLEXPORT
-typedef int EVI_HANDLE;
 typedef int errno_t;
 typedef size_t rsize_t;
 #define INVALID_HANDLE_VALUE -1
@@ -43,11 +32,28 @@ extern void Sleep(uint32_t dwMilliseconds);
 
 #define EVI_MAX_LINE_LENGTH 255
 #define EVI_MAX_ARGS 20
+#define EVI_MAX_PORT_NAME_LENGTH 1024
+#define EVI_MAX_VALUE_LENGTH 100
+#define EVI_PIPELINE_WINDOW_DEFAULT 8
+#define EVI_TIMEOUT_SHORT_MS 2000
+#define EVI_TIMEOUT_LONG_MS 30000
+#define EVI_RETRIES_DEFAULT 4
+#define EVI_RETRY_BACKOFF_MIN_MS 250
+#define EVI_RETRY_BACKOFF_MAX_MS 4000
+#define EVI_REBOOT_TIMEOUT_MS 30000
+#define EVI_REBOOT_DROP_MS 5000
+#define EVI_REBOOT_POLL_MS 100
+#define EVI_REBOOT_ANSWER_MS 500
+#define EVI_MAX_SERIAL_NUMBER_LENGTH 64
+#define EVI_MAX_DEVICES 32
 #define EVI_START_NO_CHK ':'
 #define EVI_START_WITH_CHK ';'
 #define EVI_CHECKSUM_SEPARATOR '@'
 #define EVI_STOP1 '\n'
 #define EVI_STOP2 '\r'
+#define EVI_STATS_LATENCY_BUCKETS 16
+#define EVI_MAX_CONSTANTS 16
+#define EVI_STATS_LATENCY_FIRST_US 250
 
 /**
  * @struct EvieResponse_t
@@ -62,6 +68,119 @@ typedef struct
     char response[EVI_MAX_LINE_LENGTH]; /**< Response message. */    
 } EvieResponse_t;
 
+/**
+ * @struct EviRxBuffer_t
+ * @brief Bytes received from the port but not yet consumed.
+ *
+ * With several commands in flight one read can return more than one response.
+ */
+typedef struct
+{
+    char data[EVI_MAX_LINE_LENGTH]; /**< Received bytes. */
+    size_t length; /**< Number of valid bytes in data. */
+    size_t position; /**< Next byte to consume. */
+} EviRxBuffer_t;
+
+/**
+ * @brief Handler which decodes a response.
+ *
+ * @param response Pointer to the response structure.
+ * @param user User-defined data.
+ * @return An error code indicating the result of execution.
+ */
+typedef Error_t (*EviResponseHandler_t)(EvieResponse_t *response, void *user);
+
+/**
+ * @struct EviRequest_t
+ * @brief One command of a pipelined exchange, see eviExecutePipelined().
+ */
+typedef struct
+{
+    const char *command; /**< The command to be sent. */
+    EviResponseHandler_t execute; /**< Handler for the response. */
+    void *user; /**< User-defined data passed to the handler. */
+    Error_t result; /**< Result of this command, set by eviExecutePipelined(). */
+    bool mayFail; /**< An error answer is expected, e.g. for an empty slot; it is returned in result but not counted in stats.deviceErrors. */
+} EviRequest_t;
+
+/**
+ * @struct EviValue_t
+ * @brief One index of a batched get or set, see eviGetMany() and eviSetMany().
+ */
+typedef struct
+{
+    uint32_t index; /**< Index of the value. */
+    char value[EVI_MAX_VALUE_LENGTH]; /**< Value read from or written to the device. */
+    Error_t result; /**< Result for this index. */
+} EviValue_t;
+
+/**
+ * @struct EviDeviceInfo_t
+ * @brief An attached module, see eviEnumerateDevices().
+ */
+typedef struct
+{
+    char port[EVI_MAX_PORT_NAME_LENGTH]; /**< Port of the module, e.g. /dev/ttyACM0 or COM3. */
+    char serialNumber[EVI_MAX_SERIAL_NUMBER_LENGTH]; /**< USB serial number of the module. */
+} EviDeviceInfo_t;
+
+/**
+ * @struct EviTransport_t
+ * @brief Byte stream to a module, e.g. a serial port or a TCP connection.
+ *
+ * Framing, checksums and timeouts are handled by the session, a transport
+ * only moves bytes. Built-in transports are listed in evitransport.h.
+ */
+typedef struct
+{
+    const char *name; /**< Name of the transport, a port "name:address" selects it, see eviOpen(). */
+    bool discover; /**< True if the port is found by USB serial number with eviEnumerateDevices(). */
+    void *(*open)(const char *port, void *user, bool verbose); /**< Opens a port, returns the connection or NULL. */
+    void (*close)(void *connection); /**< Closes a connection. */
+    bool (*write)(void *connection, const char *data, size_t size); /**< Sends all bytes. */
+    int (*poll)(void *connection, uint32_t timeoutMs); /**< Waits until read() has data: 1 ready, 0 timeout, -1 connection lost. */
+    int (*read)(void *connection, char *data, size_t size); /**< Takes received bytes: their number, 0 if none yet, -1 connection lost. */
+    bool (*serialNumber)(void *connection, char *serialNumber, size_t size); /**< USB serial number of the connected module, may be NULL. */
+} EviTransport_t;
+
+/**
+ * @struct EviStats_t
+ * @brief Counters of the link of a session, see eviGetStats().
+ *
+ * The counters survive reconnects of the session, so they cover the whole
+ * time since the session was created or eviResetStats() was called.
+ */
+typedef struct
+{
+    uint64_t commands; /**< Command lines sent. */
+    uint64_t responses; /**< Response lines received, including the ones with a wrong checksum. */
+    uint64_t bytesTx; /**< Bytes sent including framing. */
+    uint64_t bytesRx; /**< Bytes received including framing. */
+    uint64_t roundTrips; /**< Commands sent while no other one was in flight: the times the full latency of the link was paid. */
+    uint64_t crcErrors; /**< Responses with a missing or wrong checksum. */
+    uint64_t writeErrors; /**< Writes the transport could not complete. */
+    uint64_t timeouts; /**< Responses which did not arrive in time. */
+    uint64_t disconnects; /**< Connections lost while reading. */
+    uint64_t retries; /**< Commands sent again after a connection loss or timeout. */
+    uint64_t deviceErrors; /**< "E code" answers of the module. */
+    uint64_t latencyCount; /**< Number of latencies measured, from sending a command to its response. */
+    uint64_t latencySumUs; /**< Sum of all latencies in microseconds. */
+    uint64_t latencyMaxUs; /**< Longest latency in microseconds. */
+    uint64_t latency[EVI_STATS_LATENCY_BUCKETS]; /**< Histogram: bucket i counts latencies below EVI_STATS_LATENCY_FIRST_US << i, the last one all longer ones. */
+} EviStats_t;
+
+/**
+ * @struct EviConstants_t
+ * @brief Read-only values of a module cached by its session, see eviGet().
+ */
+typedef struct
+{
+    bool loaded; /**< True once the constants were read from the module or the cache file. */
+    size_t count; /**< Number of cached values. */
+    uint32_t index[EVI_MAX_CONSTANTS]; /**< Index of each cached value. */
+    char value[EVI_MAX_CONSTANTS][EVI_MAX_VALUE_LENGTH]; /**< The cached values. */
+} EviConstants_t;
+
 /**
  * @struct Evi_t
  * @brief Represents an Evi device configuration.
@@ -72,9 +191,55 @@ typedef struct
 {
     bool verbose; /**< Enables verbose output for debugging. */
     char *portName; /**< Name of the communication port. */
+    const char *serialNumber; /**< USB serial number of the module to use if portName is not set, NULL for any module. */
     bool useChecksum; /**< Whether to use checksum validation. */
+    const EviTransport_t *transport; /**< Transport of the session, NULL to select it by the port name. */
+    void *transportUser; /**< User-defined data passed to the open() function of the transport. */
+    bool connected; /**< True while a session is open, see eviOpen(). */
+    const EviTransport_t *connectionTransport; /**< Transport of the open session. */
+    void *connection; /**< Connection of the open session, only valid if connected is true. */
+    char port[EVI_MAX_PORT_NAME_LENGTH]; /**< Port of the open session. */
+    char usbSerialNumber[EVI_MAX_SERIAL_NUMBER_LENGTH]; /**< USB serial number of the session's device, empty if unknown. */
+    bool portFromCache; /**< True if the port of the session was taken from the discovery cache. */
+    EviRxBuffer_t rx; /**< Receive buffer of the open session. */
+    uint32_t pipelineWindow; /**< Maximal number of commands in flight, 0 for EVI_PIPELINE_WINDOW_DEFAULT, 1 for stop-and-wait. */
+    uint32_t timeoutShortMs; /**< Answer deadline of quick commands like V, 0 for EVI_TIMEOUT_SHORT_MS. */
+    uint32_t timeoutLongMs; /**< Answer deadline of measuring commands like M, C and firmware update, 0 for EVI_TIMEOUT_LONG_MS. */
+    uint32_t retries; /**< Reconnect attempts after a connection loss, 0 for EVI_RETRIES_DEFAULT. */
+    EviStats_t stats; /**< Link counters, see eviGetStats(). */
+    uint32_t inFlight; /**< Commands sent but not answered yet, see EviStats_t.roundTrips. */
+    const uint32_t *constants; /**< Read-only indices cached by the session, NULL for version, serial number and production number. */
+    size_t constantCount; /**< Number of indices in constants, at most EVI_MAX_CONSTANTS. */
+    bool persistConstants; /**< Keeps the cached constants of a USB module in a file across processes, taken only if the version still matches, see evicache.h. */
+    EviConstants_t constantCache; /**< Constants of the connected module, cleared when the session connects. */
 } Evi_t;
 
+/**
+ * @brief Opens a session to the Evi device.
+ *
+ * Resolves the port (portName or eviFindDeviceEx() with serialNumber), opens and configures it once.
+ * All following commands reuse the handle until eviClose() is called.
+ * Calling eviOpen() on an already open session does nothing.
+ * Reopening a session looks for the device of the previous session by its USB
+ * serial number, even if it re-enumerated under another port.
+ * The transport is transport or, if NULL, given by the prefix of portName:
+ * "tcp:host:port", "usb:SERIAL", "memory:" or "tty:PORT". A port without
+ * prefix is a serial port, "SIMULATION" stands for "tcp:127.0.0.1:5000".
+ * Transports without discovery use portName or else serialNumber as address.
+ * Commands executed without an open session open it implicitly.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviOpen(Evi_t *self);
+
+/**
+ * @brief Closes the session opened by eviOpen().
+ *
+ * @param self Pointer to the Evi_t structure.
+ */
+DLLEXPORT void eviClose(Evi_t *self);
+
 /**
  * @brief Finds an Evi device connected to a port.
  *
@@ -85,6 +250,30 @@ typedef struct
  */
 DLLEXPORT Error_t eviFindDevice(char *portName, size_t *portNameSize, bool verbose);
 
+/**
+ * @brief Finds an Evi device, optionally with a given USB serial number.
+ *
+ * @param serialNumber USB serial number to look for or NULL for the first device found.
+ * @param portName Buffer to store the detected port name.
+ * @param portNameSize Pointer to the size of the port name buffer.
+ * @param serialNumberFound Buffer for the USB serial number of the found device, may be NULL.
+ * @param serialNumberFoundSize Size of the serialNumberFound buffer.
+ * @param verbose Whether to enable verbose output.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviFindDeviceEx(const char *serialNumber, char *portName, size_t *portNameSize, char *serialNumberFound, size_t serialNumberFoundSize, bool verbose);
+
+/**
+ * @brief Lists all attached modules.
+ *
+ * @param devices Array to store the modules.
+ * @param maxDevices Number of elements of devices, EVI_MAX_DEVICES is enough for any deck.
+ * @param count Pointer to store the number of modules found.
+ * @param verbose Whether to enable verbose output.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviEnumerateDevices(EviDeviceInfo_t *devices, size_t maxDevices, size_t *count, bool verbose);
+
 /**
  * @brief Creates a new EvieResponse_t structure.
  * @see eviFreeResponse()
@@ -99,9 +288,27 @@ DLLEXPORT EvieResponse_t *eviCreateResponse();
  */
 DLLEXPORT void eviFreeResponse(EvieResponse_t *response);
 
+/**
+ * @brief Frames a command for transmission.
+ *
+ * Adds start character, checksum (if enabled) and stop character in a single
+ * pass. Commands which don't fit into the buffer are truncated.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param command The command to be framed.
+ * @param tx Buffer to store the null terminated frame.
+ * @param txSize Size of the buffer, at least EVI_MAX_LINE_LENGTH is recommended.
+ * @return Length of the frame without terminator or 0 if the buffer is too small.
+ */
+size_t eviFrameCommand(const Evi_t *self, const char *command, char *tx, size_t txSize);
+
 /**
  * @brief Sends a command to the Evi device and stores the response.
  *
+ * If the connection is lost the session is reopened. Commands which only read
+ * (V index, M n, X and Q) are then sent again, up to Evi_t.retries times with
+ * exponential backoff.
+ *
  * @param self Pointer to the Evi_t structure.
  * @param command The command to be sent.
  * @param response Pointer to an EvieResponse_t structure to store the response.
@@ -129,9 +336,29 @@ Error_t eviNoReturn_(EvieResponse_t *response, void *user);
  */
 Error_t eviExecute(Evi_t * self, char * cmd, Error_t(execute)(EvieResponse_t *response, void *user), void *user);
 
+/**
+ * @brief Executes several commands pipelined.
+ *
+ * Writes up to pipelineWindow framed commands back-to-back before waiting for
+ * the responses. The device answers in order; each response is matched to its
+ * command by the echoed command character and passed to the command's handler.
+ * All commands are executed, even if one of them fails.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param requests Commands to execute; the result of each one is stored in its result field.
+ * @param count Number of requests.
+ * @return The first error of all requests or ERROR_EVI_OK.
+ */
+Error_t eviExecutePipelined(Evi_t * self, EviRequest_t *requests, size_t count);
+
 /**
  * @brief Retrieves a value from the Evi device.
  *
+ * Read-only indices listed in Evi_t.constants are answered from the cache of
+ * the session. The first of them that is requested reads all of them in one
+ * pipelined exchange. The cache is cleared when the session (re)connects, by
+ * a firmware update and when one of the indices is set.
+ *
  * @param self Pointer to the Evi_t structure.
  * @param index Index of the value to retrieve.
  * @param value Buffer to store the retrieved value.
@@ -140,6 +367,24 @@ Error_t eviExecute(Evi_t * self, char * cmd, Error_t(execute)(EvieResponse_t *re
  */
 DLLEXPORT Error_t eviGet(Evi_t *self, uint32_t index, char *value, size_t valueSize);
 
+/**
+ * @brief Retrieves a value from the Evi device, bypassing the cache of constants.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param index Index of the value to retrieve.
+ * @param value Buffer to store the retrieved value.
+ * @param valueSize Size of the value buffer.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviGetUncached(Evi_t *self, uint32_t index, char *value, size_t valueSize);
+
+/**
+ * @brief Drops the cached constants of a session and of its module in the cache file.
+ *
+ * @param self Pointer to the Evi_t structure.
+ */
+DLLEXPORT void eviInvalidateConstants(Evi_t *self);
+
 /**
  * @brief Sets a value on the Evi device.
  *
@@ -150,6 +395,28 @@ DLLEXPORT Error_t eviGet(Evi_t *self, uint32_t index, char *value, size_t valueS
  */
 DLLEXPORT Error_t eviSet(Evi_t *self, uint32_t index, const char *value);
 
+/**
+ * @brief Retrieves several values from the Evi device in one pipelined exchange.
+ *
+ * Cached constants are filled in without a command, see eviGet().
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param values Indices to read; value and result of each entry are filled in.
+ * @param count Number of values.
+ * @return The first error of all indices or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviGetMany(Evi_t *self, EviValue_t *values, size_t count);
+
+/**
+ * @brief Sets several values on the Evi device in one pipelined exchange.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param values Indices and values to write; the result of each entry is filled in.
+ * @param count Number of values.
+ * @return The first error of all indices or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviSetMany(Evi_t *self, EviValue_t *values, size_t count);
+
 DLLEXPORT Error_t eviLogging(Evi_t *self, char *line, size_t length);
 
 /**
@@ -170,6 +437,102 @@ DLLEXPORT Error_t eviSelftest(Evi_t *self, uint32_t *result);
  */
 DLLEXPORT Error_t eviFwUpdate(Evi_t *self, const char *file);
 
+/**
+ * @brief Waits until a module restarted, e.g. after the R command of a firmware update.
+ *
+ * First waits up to EVI_REBOOT_DROP_MS until the open connection breaks or
+ * the port disappears, then reopens the session (a re-enumerated module is
+ * found again by its USB serial number) and polls INDEX_VERSION until the
+ * firmware answers. Returns as soon as it does, at the latest after timeoutMs.
+ *
+ * @param self Pointer to the Evi_t structure, the session of the module before its restart.
+ * @param timeoutMs Maximal time for the whole restart.
+ * @param version Buffer for the version of the restarted firmware, may be NULL.
+ * @param versionSize Size of the version buffer.
+ * @return ERROR_EVI_OK if the module answers again, otherwise the error of the last attempt.
+ */
+DLLEXPORT Error_t eviWaitForReboot(Evi_t *self, uint32_t timeoutMs, char *version, size_t versionSize);
+
+/**
+ * @enum EviFwPhase_t
+ * @brief Phase of a firmware update, see EviFwProgress_t.
+ */
+typedef enum
+{
+    EVI_FW_PHASE_ERASE = 0, /**< The module erases its flash. */
+    EVI_FW_PHASE_WRITE, /**< Records are written, done of total are acknowledged. */
+    EVI_FW_PHASE_REBOOT, /**< The module starts the new firmware, see eviWaitForReboot(). */
+    EVI_FW_PHASE_SKIP, /**< The module already runs the version of the image, nothing is flashed. */
+} EviFwPhase_t;
+
+/**
+ * @brief Progress of a firmware update.
+ *
+ * @param phase Current phase.
+ * @param done Number of records acknowledged by the module.
+ * @param total Number of records sent to the module.
+ * @param user User-defined data of EviFwOptions_t.
+ */
+typedef void (*EviFwProgress_t)(EviFwPhase_t phase, size_t done, size_t total, void *user);
+
+/**
+ * @struct EviFwOptions_t
+ * @brief Options of eviFwUpdateEx().
+ */
+typedef struct
+{
+    bool force; /**< Flashes even if the module already runs the version of the image. */
+    bool coalesce; /**< Joins adjacent data records into longer ones, see eviSrecParse(). */
+    size_t coalesceLength; /**< Longest joined record in characters, 0 for the longest data record of the file. */
+    EviFwProgress_t progress; /**< Called on every phase change and acknowledged record, may be NULL. */
+    void *user; /**< User-defined data passed to progress. */
+    char *version; /**< Receives the version the module reports after the update, or runs if nothing was flashed; may be NULL. */
+    size_t versionSize; /**< Size of the version buffer. */
+} EviFwOptions_t;
+
+/**
+ * @brief Performs a firmware update and reports its progress.
+ *
+ * The whole image is validated on the host before the flash is erased, a
+ * broken file leaves the module untouched. If the S0 header carries a version
+ * equal to INDEX_VERSION of the module, nothing is flashed unless
+ * EviFwOptions_t.force is set. The records are streamed with up to
+ * Evi_t.pipelineWindow of them in flight; the first record rejected by the
+ * module ends the transfer. After the reboot the function returns as soon as
+ * the new firmware answers; the session then stays connected to it. The
+ * version it reports is stored in EviFwOptions_t.version, a version other than
+ * the one of the image is only a warning because the S0 text is free-form.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param file Path to the firmware update file (S-records).
+ * @param options Options of the update, NULL flashes unconditionally without coalescing.
+ * @return An error code indicating the result of the update process.
+ */
+DLLEXPORT Error_t eviFwUpdateEx(Evi_t *self, const char *file, const EviFwOptions_t *options);
+
+/**
+ * @brief Copies the link counters of a session.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param stats Pointer to store the counters.
+ */
+DLLEXPORT void eviGetStats(const Evi_t *self, EviStats_t *stats);
+
+/**
+ * @brief Sets all link counters of a session to zero.
+ *
+ * @param self Pointer to the Evi_t structure.
+ */
+DLLEXPORT void eviResetStats(Evi_t *self);
+
+/**
+ * @brief Upper bound of a bucket of EviStats_t.latency.
+ *
+ * @param bucket Index of the bucket.
+ * @return Latencies of the bucket are below this value in microseconds, UINT64_MAX for the last bucket.
+ */
+DLLEXPORT uint64_t eviStatsBucketLimitUs(size_t bucket);
+
 /**
  * @brief Converts an error code into a human-readable string.
  *
@@ -186,37 +549,45 @@ DLLEXPORT const char *eviError2String(Error_t e);
 DLLEXPORT const char *eviVersion();
 
 /**
- * @brief Opens a communication port for the Evi device.
+ * @brief Monotonic clock for deadlines.
  *
- * @param portName Name of the port to open.
- * @return A handle to the opened communication port.
+ * @return Milliseconds since an arbitrary point in time.
  */
-EVI_HANDLE eviPortOpen(char *portName);
+uint64_t eviMonotonicMs();
 
 /**
- * @brief Closes an open communication port.
+ * @brief Monotonic clock for latency measurements.
  *
- * @param hComm Handle to the communication port.
+ * @return Microseconds since an arbitrary point in time.
  */
-void eviPortClose(EVI_HANDLE hComm);
+uint64_t eviMonotonicUs();
 
 /**
- * @brief Writes data to the communication port.
+ * @brief Adds a module to the list of eviEnumerateDevices() unless its port is already listed.
  *
- * @param hComm Handle to the communication port.
- * @param buffer Data buffer to be written.
- * @param verbose Whether to enable verbose output.
- * @return True if the write operation was successful, otherwise false.
+ * @param devices Array of the modules.
+ * @param maxDevices Number of elements of devices.
+ * @param count Pointer to the number of modules in devices.
+ * @param port Port of the module.
+ * @param serialNumber USB serial number of the module.
+ * @return True if the module was added.
  */
-bool eviPortWrite(EVI_HANDLE hComm, char *buffer, bool verbose);
+bool eviDeviceListAdd(EviDeviceInfo_t *devices, size_t maxDevices, size_t *count, const char *port, const char *serialNumber);
 
 /**
- * @brief Reads data from the communication port.
+ * @brief Checks if a port is present without opening it.
  *
- * @param hComm Handle to the communication port.
- * @param buffer Buffer to store the received data.
- * @param size Maximum number of bytes to read.
- * @param verbose Whether to enable verbose output.
- * @return The number of bytes read from the port.
+ * @param portName Name of the port.
+ * @return True if the port exists.
+ */
+bool eviPortExists(const char *portName);
+
+/**
+ * @brief Reads the USB serial number of the device behind a port without opening it.
+ *
+ * @param portName Name of the port.
+ * @param serialNumber Buffer to store the serial number.
+ * @param serialNumberSize Size of the serialNumber buffer.
+ * @return True if the serial number is known, false if the platform can't tell.
  */
-uint32_t eviPortRead(EVI_HANDLE hComm, char *buffer, size_t size, bool verbose);
+bool eviPortSerialNumber(const char *portName, char *serialNumber, size_t serialNumberSize);
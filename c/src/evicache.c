@@ -0,0 +1,558 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evicache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN64) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define EVI_CACHE_FILE_NAME "evi-devices.cache"
+#define EVI_CONSTANTS_FILE_NAME "evi-constants.cache"
+#define EVI_CONSTANTS_LINE_LENGTH (EVI_MAX_SERIAL_NUMBER_LENGTH + EVI_MAX_PORT_NAME_LENGTH + EVI_MAX_CONSTANTS * (EVI_MAX_VALUE_LENGTH + 12) + 4)
+
+typedef struct
+{
+    char serialNumber[EVI_MAX_SERIAL_NUMBER_LENGTH];
+    char portName[EVI_MAX_PORT_NAME_LENGTH];
+} CacheEntry_t;
+
+typedef struct
+{
+    CacheEntry_t entries[EVI_CACHE_MAX_DEVICES];
+    size_t count;
+} Cache_t;
+
+#if defined(_WIN64) || defined(_WIN32)
+typedef HANDLE CacheLock_t;
+static SRWLOCK cacheMutex = SRWLOCK_INIT;
+#else
+typedef int CacheLock_t;
+static pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static bool cacheFileName(const char *variable, const char *name, char *fileName, size_t fileNameSize)
+{
+    const char *file = getenv(variable);
+    if (file != NULL)
+    {
+        if (file[0] == 0)
+        {
+            return false;
+        }
+        strcpy_s(fileName, fileNameSize, file);
+        return true;
+    }
+
+#if defined(_WIN64) || defined(_WIN32)
+    const char *dir = getenv("TEMP");
+    if (dir == NULL)
+    {
+        dir = ".";
+    }
+    snprintf(fileName, fileNameSize, "%s\\%s", dir, name);
+#else
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (dir != NULL)
+    {
+        snprintf(fileName, fileNameSize, "%s/%s", dir, name);
+        return true;
+    }
+
+    // /tmp is shared, the files go into a directory only this user can enter.
+    // A directory somebody else created or opened up disables the cache.
+    struct stat st;
+    snprintf(fileName, fileNameSize, "/tmp/evifluor-%u", (unsigned)getuid());
+    if (mkdir(fileName, 0700) != 0 && errno != EEXIST)
+    {
+        return false;
+    }
+    if (lstat(fileName, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077) != 0)
+    {
+        return false;
+    }
+    size_t length = strlen(fileName);
+    snprintf(fileName + length, fileNameSize - length, "/%s", name);
+#endif
+    return true;
+}
+
+// Opens a cache file for reading. Only a regular file of this user is read,
+// anything planted by somebody else is ignored.
+static FILE *cacheOpen(const char *fileName)
+{
+#if defined(_WIN64) || defined(_WIN32)
+    return fopen(fileName, "r");
+#else
+    struct stat st;
+    int fd = open(fileName, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != getuid())
+    {
+        close(fd);
+        return NULL;
+    }
+    FILE *f = fdopen(fd, "r");
+    if (f == NULL)
+    {
+        close(fd);
+    }
+    return f;
+#endif
+}
+
+// Creates a new file next to the cache file, it is renamed over the cache file
+// once written. The name is unique, so nothing can be prepared under it.
+static FILE *cacheCreate(const char *fileName, char *fileNameTmp, size_t fileNameTmpSize)
+{
+#if defined(_WIN64) || defined(_WIN32)
+    // Updates are serialized by the lock, the temp directory belongs to the user
+    snprintf(fileNameTmp, fileNameTmpSize, "%s.tmp", fileName);
+    return fopen(fileNameTmp, "w");
+#else
+    snprintf(fileNameTmp, fileNameTmpSize, "%s.XXXXXX", fileName);
+    int fd = mkstemp(fileNameTmp);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    FILE *f = fdopen(fd, "w");
+    if (f == NULL)
+    {
+        close(fd);
+        remove(fileNameTmp);
+    }
+    return f;
+#endif
+}
+
+// Serializes the read-modify-write of a cache file between the threads of
+// this process and, through a lock file next to it, between processes.
+// Without the lock file the update is still done, it is only a cache.
+static CacheLock_t cacheLock(const char *fileName)
+{
+    char lockName[EVI_MAX_PORT_NAME_LENGTH + 8];
+    snprintf(lockName, sizeof(lockName), "%s.lock", fileName);
+
+#if defined(_WIN64) || defined(_WIN32)
+    AcquireSRWLockExclusive(&cacheMutex);
+    HANDLE lock = CreateFileA(lockName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    OVERLAPPED overlapped = {0};
+    if (lock != INVALID_HANDLE_VALUE && !LockFileEx(lock, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped))
+    {
+        CloseHandle(lock);
+        lock = INVALID_HANDLE_VALUE;
+    }
+    return lock;
+#else
+    pthread_mutex_lock(&cacheMutex);
+    int lock = open(lockName, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (lock >= 0 && flock(lock, LOCK_EX) != 0)
+    {
+        close(lock);
+        lock = -1;
+    }
+    return lock;
+#endif
+}
+
+static void cacheUnlock(CacheLock_t lock)
+{
+    // Closing the lock file releases its lock
+#if defined(_WIN64) || defined(_WIN32)
+    if (lock != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(lock);
+    }
+    ReleaseSRWLockExclusive(&cacheMutex);
+#else
+    if (lock >= 0)
+    {
+        close(lock);
+    }
+    pthread_mutex_unlock(&cacheMutex);
+#endif
+}
+
+static void cacheLoad(const char *fileName, Cache_t *cache)
+{
+    char line[EVI_MAX_SERIAL_NUMBER_LENGTH + EVI_MAX_PORT_NAME_LENGTH + 2];
+
+    cache->count = 0;
+    FILE *f = cacheOpen(fileName);
+    if (f == NULL)
+    {
+        return;
+    }
+
+    while (cache->count < EVI_CACHE_MAX_DEVICES && fgets(line, sizeof(line), f) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        char *separator = strchr(line, '\t');
+        if (separator != NULL && separator[1] != 0)
+        {
+            CacheEntry_t *entry = &cache->entries[cache->count++];
+            *separator = 0;
+            strcpy_s(entry->serialNumber, sizeof(entry->serialNumber), line);
+            strcpy_s(entry->portName, sizeof(entry->portName), separator + 1);
+        }
+    }
+    fclose(f);
+}
+
+static void cacheSave(const char *fileName, const Cache_t *cache)
+{
+    char fileNameTmp[EVI_MAX_PORT_NAME_LENGTH + 8];
+
+    // Write a temporary file and rename it, so concurrent readers never see a partial file.
+    FILE *f = cacheCreate(fileName, fileNameTmp, sizeof(fileNameTmp));
+    if (f == NULL)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < cache->count; i++)
+    {
+        fprintf_s(f, "%s\t%s\n", cache->entries[i].serialNumber, cache->entries[i].portName);
+    }
+    fclose(f);
+
+#if defined(_WIN64) || defined(_WIN32)
+    remove(fileName);
+#endif
+    if (rename(fileNameTmp, fileName) != 0)
+    {
+        remove(fileNameTmp);
+    }
+}
+
+static void cacheRemove(Cache_t *cache, size_t index)
+{
+    for (size_t i = index + 1; i < cache->count; i++)
+    {
+        cache->entries[i - 1] = cache->entries[i];
+    }
+    cache->count--;
+}
+
+static bool cacheEntryValid(const CacheEntry_t *entry)
+{
+    char serialNumber[EVI_MAX_SERIAL_NUMBER_LENGTH];
+
+    if (!eviPortExists(entry->portName))
+    {
+        return false;
+    }
+
+    if (eviPortSerialNumber(entry->portName, serialNumber, sizeof(serialNumber)))
+    {
+        return strcmp(serialNumber, entry->serialNumber) == 0;
+    }
+
+    return true;
+}
+
+bool eviCacheLookupDevice(const char *serialNumber, char *portName, size_t portNameSize, char *serialNumberFound, size_t serialNumberFoundSize)
+{
+    char fileName[EVI_MAX_PORT_NAME_LENGTH];
+    CacheLock_t lock;
+    Cache_t cache;
+    bool found = false;
+    bool changed = false;
+    size_t i = 0;
+
+    if (!cacheFileName("EVI_DEVICE_CACHE", EVI_CACHE_FILE_NAME, fileName, sizeof(fileName)))
+    {
+        return false;
+    }
+    lock = cacheLock(fileName);
+    cacheLoad(fileName, &cache);
+
+    while (i < cache.count && !found)
+    {
+        CacheEntry_t *entry = &cache.entries[i];
+        if (serialNumber == NULL || strcmp(serialNumber, entry->serialNumber) == 0)
+        {
+            if (cacheEntryValid(entry))
+            {
+                strcpy_s(portName, portNameSize, entry->portName);
+                if (serialNumberFound)
+                {
+                    strcpy_s(serialNumberFound, serialNumberFoundSize, entry->serialNumber);
+                }
+                found = true;
+            }
+            else
+            {
+                cacheRemove(&cache, i);
+                changed = true;
+                continue;
+            }
+        }
+        i++;
+    }
+
+    if (changed)
+    {
+        cacheSave(fileName, &cache);
+    }
+    cacheUnlock(lock);
+
+    return found;
+}
+
+void eviCacheStoreDevice(const char *serialNumber, const char *portName)
+{
+    char fileName[EVI_MAX_PORT_NAME_LENGTH];
+    CacheLock_t lock;
+    Cache_t cache;
+    size_t i = 0;
+
+    if (!cacheFileName("EVI_DEVICE_CACHE", EVI_CACHE_FILE_NAME, fileName, sizeof(fileName)))
+    {
+        return;
+    }
+    lock = cacheLock(fileName);
+    cacheLoad(fileName, &cache);
+
+    // A port belongs to exactly one device and a device to exactly one port.
+    while (i < cache.count)
+    {
+        if (strcmp(cache.entries[i].portName, portName) == 0 || (serialNumber[0] != 0 && strcmp(cache.entries[i].serialNumber, serialNumber) == 0))
+        {
+            cacheRemove(&cache, i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (cache.count == EVI_CACHE_MAX_DEVICES)
+    {
+        cacheRemove(&cache, 0);
+    }
+
+    strcpy_s(cache.entries[cache.count].serialNumber, sizeof(cache.entries[cache.count].serialNumber), serialNumber);
+    strcpy_s(cache.entries[cache.count].portName, sizeof(cache.entries[cache.count].portName), portName);
+    cache.count++;
+
+    cacheSave(fileName, &cache);
+    cacheUnlock(lock);
+}
+
+void eviCacheInvalidateDevice(const char *portName)
+{
+    char fileName[EVI_MAX_PORT_NAME_LENGTH];
+    CacheLock_t lock;
+    Cache_t cache;
+    bool changed = false;
+    size_t i = 0;
+
+    if (!cacheFileName("EVI_DEVICE_CACHE", EVI_CACHE_FILE_NAME, fileName, sizeof(fileName)))
+    {
+        return;
+    }
+    lock = cacheLock(fileName);
+    cacheLoad(fileName, &cache);
+
+    while (i < cache.count)
+    {
+        if (strcmp(cache.entries[i].portName, portName) == 0)
+        {
+            cacheRemove(&cache, i);
+            changed = true;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if (changed)
+    {
+        cacheSave(fileName, &cache);
+    }
+    cacheUnlock(lock);
+}
+
+// Splits "SERIALNUMBER<TAB>PORT<TAB>..." in place, rest points to the values
+static bool constantsSplit(char *line, char **serialNumber, char **portName, char **rest)
+{
+    char *tab;
+
+    line[strcspn(line, "\r\n")] = 0;
+    *serialNumber = line;
+    tab = strchr(line, '\t');
+    if (tab == NULL)
+    {
+        return false;
+    }
+    *tab = 0;
+    *portName = tab + 1;
+    tab = strchr(*portName, '\t');
+    *rest = tab != NULL ? tab + 1 : *portName + strlen(*portName);
+    if (tab != NULL)
+    {
+        *tab = 0;
+    }
+    return true;
+}
+
+bool eviCacheLookupConstants(const char *serialNumber, const char *portName, EviConstants_t *constants)
+{
+    char fileName[EVI_MAX_PORT_NAME_LENGTH];
+    char *line;
+    bool found = false;
+    FILE *f;
+
+    if (serialNumber[0] == 0 || !cacheFileName("EVI_CONSTANTS_CACHE", EVI_CONSTANTS_FILE_NAME, fileName, sizeof(fileName)))
+    {
+        return false;
+    }
+    f = cacheOpen(fileName);
+    line = (char *)malloc(EVI_CONSTANTS_LINE_LENGTH);
+    if (f == NULL || line == NULL)
+    {
+        if (f != NULL)
+        {
+            fclose(f);
+        }
+        free(line);
+        return false;
+    }
+
+    while (!found && fgets(line, EVI_CONSTANTS_LINE_LENGTH, f) != NULL)
+    {
+        char *serial;
+        char *port;
+        char *rest;
+        if (!constantsSplit(line, &serial, &port, &rest) || strcmp(serial, serialNumber) != 0 || strcmp(port, portName) != 0)
+        {
+            continue;
+        }
+
+        constants->count = 0;
+        for (char *item = rest; *item != 0 && constants->count < EVI_MAX_CONSTANTS;)
+        {
+            size_t length = strcspn(item, "\t");
+            char *end;
+            unsigned long index = strtoul(item, &end, 10);
+            if (*end == '=' && end < item + length)
+            {
+                size_t n = length - (size_t)(end + 1 - item);
+                if (n < EVI_MAX_VALUE_LENGTH)
+                {
+                    constants->index[constants->count] = (uint32_t)index;
+                    memcpy(constants->value[constants->count], end + 1, n);
+                    constants->value[constants->count][n] = 0;
+                    constants->count++;
+                }
+            }
+            item += length;
+            item += *item == '\t';
+        }
+        constants->loaded = true;
+        found = true;
+    }
+
+    free(line);
+    fclose(f);
+    return found;
+}
+
+// Rewrites the constants cache without the entries of a module, then adds the new entry if given
+static void constantsRewrite(const char *serialNumber, const char *portName, const EviConstants_t *constants)
+{
+    char fileName[EVI_MAX_PORT_NAME_LENGTH];
+    char fileNameTmp[EVI_MAX_PORT_NAME_LENGTH + 8];
+    char *line;
+    char *copy;
+    size_t kept = 0;
+    CacheLock_t lock;
+    FILE *in;
+    FILE *out;
+
+    if (serialNumber[0] == 0 || !cacheFileName("EVI_CONSTANTS_CACHE", EVI_CONSTANTS_FILE_NAME, fileName, sizeof(fileName)))
+    {
+        return;
+    }
+    line = (char *)malloc(EVI_CONSTANTS_LINE_LENGTH);
+    copy = (char *)malloc(EVI_CONSTANTS_LINE_LENGTH);
+    lock = cacheLock(fileName);
+    out = line != NULL && copy != NULL ? cacheCreate(fileName, fileNameTmp, sizeof(fileNameTmp)) : NULL;
+    if (out == NULL)
+    {
+        cacheUnlock(lock);
+        free(copy);
+        free(line);
+        return;
+    }
+
+    // Like the discovery cache, a port belongs to one module and a module to one port
+    in = cacheOpen(fileName);
+    while (in != NULL && kept + 1 < EVI_CACHE_MAX_DEVICES && fgets(line, EVI_CONSTANTS_LINE_LENGTH, in) != NULL)
+    {
+        char *serial;
+        char *port;
+        char *rest;
+        strcpy_s(copy, EVI_CONSTANTS_LINE_LENGTH, line);
+        if (constantsSplit(copy, &serial, &port, &rest) && strcmp(serial, serialNumber) != 0 && (portName == NULL || strcmp(port, portName) != 0))
+        {
+            fputs(line, out);
+            kept++;
+        }
+    }
+    if (in != NULL)
+    {
+        fclose(in);
+    }
+
+    if (constants != NULL)
+    {
+        fprintf_s(out, "%s\t%s", serialNumber, portName);
+        for (size_t i = 0; i < constants->count; i++)
+        {
+            // A value with a tab or line break would break the line format
+            if (strpbrk(constants->value[i], "\t\r\n") == NULL)
+            {
+                fprintf_s(out, "\t%u=%s", constants->index[i], constants->value[i]);
+            }
+        }
+        fprintf_s(out, "\n");
+    }
+    fclose(out);
+
+#if defined(_WIN64) || defined(_WIN32)
+    remove(fileName);
+#endif
+    if (rename(fileNameTmp, fileName) != 0)
+    {
+        remove(fileNameTmp);
+    }
+    cacheUnlock(lock);
+    free(copy);
+    free(line);
+}
+
+void eviCacheStoreConstants(const char *serialNumber, const char *portName, const EviConstants_t *constants)
+{
+    constantsRewrite(serialNumber, portName, constants);
+}
+
+void eviCacheInvalidateConstants(const char *serialNumber)
+{
+    constantsRewrite(serialNumber, NULL, NULL);
+}
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @file evicache.h
+ * @brief Host-side caches: USB serial numbers to ports, and read-only values of modules.
+ *
+ * The discovery cache is a small text file shared by all processes on the
+ * host, one line "SERIALNUMBER<TAB>PORT" per device. It is located at the path
+ * given by the environment variable EVI_DEVICE_CACHE, or in the runtime/temp
+ * directory when unset. Setting EVI_DEVICE_CACHE to an empty string disables
+ * the cache. Without XDG_RUNTIME_DIR the files go to /tmp/evifluor-UID, a
+ * directory only the user can enter. Files owned by another user are ignored.
+ *
+ * The constants cache keeps the values of Evi_t.constants across processes,
+ * one line "SERIALNUMBER<TAB>PORT<TAB>INDEX=VALUE..." per module. Its path is
+ * given by EVI_CONSTANTS_CACHE in the same way.
+ *
+ * All functions may be called from several threads and processes at once; the
+ * updates of a file are serialized with a lock file "<file>.lock" next to it.
+ */
+
+#define EVI_CACHE_MAX_DEVICES 32
+
+/**
+ * @brief Looks up a device in the discovery cache.
+ *
+ * Entries whose port has vanished or now belongs to a device with another
+ * serial number are removed from the cache.
+ *
+ * @param serialNumber USB serial number to look for or NULL for any device.
+ * @param portName Buffer to store the cached port name.
+ * @param portNameSize Size of the portName buffer.
+ * @param serialNumberFound Buffer for the serial number of the entry, may be NULL.
+ * @param serialNumberFoundSize Size of the serialNumberFound buffer.
+ * @return True if a usable entry was found.
+ */
+bool eviCacheLookupDevice(const char *serialNumber, char *portName, size_t portNameSize, char *serialNumberFound, size_t serialNumberFoundSize);
+
+/**
+ * @brief Adds or replaces the entry of a device in the discovery cache.
+ *
+ * @param serialNumber USB serial number of the device, may be empty.
+ * @param portName Port of the device.
+ */
+void eviCacheStoreDevice(const char *serialNumber, const char *portName);
+
+/**
+ * @brief Removes the entry of a port from the discovery cache.
+ *
+ * Used when a cached port can't be opened or stops answering.
+ *
+ * @param portName Port to remove.
+ */
+void eviCacheInvalidateDevice(const char *portName);
+
+/**
+ * @brief Looks up the constants of a module.
+ *
+ * @param serialNumber USB serial number of the module.
+ * @param portName Port of the module, an entry of the same module on another port is not used.
+ * @param constants Pointer to store the constants.
+ * @return True if an entry was found.
+ */
+bool eviCacheLookupConstants(const char *serialNumber, const char *portName, EviConstants_t *constants);
+
+/**
+ * @brief Adds or replaces the constants of a module.
+ *
+ * @param serialNumber USB serial number of the module.
+ * @param portName Port of the module.
+ * @param constants The constants.
+ */
+void eviCacheStoreConstants(const char *serialNumber, const char *portName, const EviConstants_t *constants);
+
+/**
+ * @brief Removes the constants of a module, e.g. before its firmware is updated.
+ *
+ * @param serialNumber USB serial number of the module.
+ */
+void eviCacheInvalidateConstants(const char *serialNumber);
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evifanout.h"
+#include "evithread.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    Evi_t *session;
+    EviAsyncOperation_t operation;
+    void *args;
+    Error_t result;
+    EviSemaphore_t *slots;
+    EviThread_t thread;
+    bool started;
+} FanOutJob;
+
+static EVI_THREAD_RESULT eviFanOutRun(void *arg)
+{
+    FanOutJob *job = (FanOutJob *)arg;
+    if (job->slots)
+    {
+        eviSemaphoreWait(job->slots, UINT32_MAX);
+    }
+    job->result = job->operation(job->session, job->args);
+    if (job->slots)
+    {
+        eviSemaphorePost(job->slots);
+    }
+    EVI_THREAD_RETURN;
+}
+
+void eviSessionsFromDevices(const Evi_t *options, const EviDeviceInfo_t *devices, size_t count, Evi_t *sessions)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        Evi_t *session = &sessions[i];
+        memset(session, 0, sizeof(Evi_t));
+        session->verbose        = options->verbose;
+        session->useChecksum    = options->useChecksum;
+        session->transport      = options->transport;
+        session->transportUser  = options->transportUser;
+        session->pipelineWindow = options->pipelineWindow;
+        session->timeoutShortMs = options->timeoutShortMs;
+        session->timeoutLongMs  = options->timeoutLongMs;
+        session->retries        = options->retries;
+        session->constants      = options->constants;
+        session->constantCount  = options->constantCount;
+        session->persistConstants = options->persistConstants;
+        if (devices[i].serialNumber[0] != 0)
+        {
+            session->serialNumber = devices[i].serialNumber;
+        }
+        else
+        {
+            session->portName = (char *)devices[i].port;
+        }
+    }
+}
+
+void eviCloseAll(Evi_t *sessions, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        eviClose(&sessions[i]);
+    }
+}
+
+Error_t eviForEach(Evi_t *sessions, size_t count, EviAsyncOperation_t operation, void *args, size_t argsSize, Error_t *results)
+{
+    return eviForEachLimited(sessions, count, 0, operation, args, argsSize, results);
+}
+
+Error_t eviForEachLimited(Evi_t *sessions, size_t count, size_t maxConcurrent, EviAsyncOperation_t operation, void *args, size_t argsSize, Error_t *results)
+{
+    Error_t ret = ERROR_EVI_OK;
+    FanOutJob *jobs = (FanOutJob *)calloc(count, sizeof(FanOutJob));
+    EviSemaphore_t slots;
+    bool limited = maxConcurrent > 0 && maxConcurrent < count;
+
+    if (jobs == NULL)
+    {
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+    // A semaphore with one unit per slot, a job holds a unit while it runs
+    if (limited)
+    {
+        if (!eviSemaphoreInit(&slots))
+        {
+            free(jobs);
+            return ERROR_EVI_THREAD_ERROR;
+        }
+        for (size_t i = 0; i < maxConcurrent; i++)
+        {
+            eviSemaphorePost(&slots);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        jobs[i].session   = &sessions[i];
+        jobs[i].operation = operation;
+        jobs[i].args      = args ? (char *)args + i * argsSize : NULL;
+        jobs[i].slots     = limited ? &slots : NULL;
+        // The last job, or one without a thread, runs on the calling thread
+        jobs[i].started   = (i + 1 < count) && eviThreadCreate(&jobs[i].thread, eviFanOutRun, &jobs[i]);
+        if (!jobs[i].started)
+        {
+            eviFanOutRun(&jobs[i]);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (jobs[i].started)
+        {
+            eviThreadJoin(jobs[i].thread);
+        }
+        if (results)
+        {
+            results[i] = jobs[i].result;
+        }
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = jobs[i].result;
+        }
+    }
+
+    if (limited)
+    {
+        eviSemaphoreDestroy(&slots);
+    }
+    free(jobs);
+    return ret;
+}
+
+static Error_t eviSelftestAll_(Evi_t *evi, void *args)
+{
+    return eviSelftest(evi, (uint32_t *)args);
+}
+
+Error_t eviSelftestAll(Evi_t *sessions, size_t count, uint32_t *selftests, Error_t *results)
+{
+    return eviForEach(sessions, count, eviSelftestAll_, selftests, sizeof(uint32_t), results);
+}
+
+typedef struct
+{
+    EviValue_t *values;
+    size_t count;
+} GetManyArgs;
+
+static Error_t eviGetManyAll_(Evi_t *evi, void *args)
+{
+    GetManyArgs *a = (GetManyArgs *)args;
+    return eviGetMany(evi, a->values, a->count);
+}
+
+Error_t eviGetManyAll(Evi_t *sessions, size_t count, EviValue_t *values, size_t valuesPerSession, Error_t *results)
+{
+    GetManyArgs *args = (GetManyArgs *)calloc(count, sizeof(GetManyArgs));
+    if (args == NULL)
+    {
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        args[i].values = &values[i * valuesPerSession];
+        args[i].count  = valuesPerSession;
+    }
+    Error_t ret = eviForEach(sessions, count, eviGetManyAll_, args, sizeof(GetManyArgs), results);
+
+    free(args);
+    return ret;
+}
+
+typedef struct
+{
+    const EviSrecImage_t *image;
+    const EviFwOptions_t *options;
+} FwUpdateArgs;
+
+static Error_t eviFwUpdateAll_(Evi_t *evi, void *args)
+{
+    FwUpdateArgs *a = (FwUpdateArgs *)args;
+    return eviFwUpdateImage(evi, a->image, a->options);
+}
+
+Error_t eviFwUpdateAll(Evi_t *sessions, size_t count, const EviSrecImage_t *image, const EviFwOptions_t *options, size_t maxConcurrent, Error_t *results)
+{
+    FwUpdateArgs *args = (FwUpdateArgs *)calloc(count, sizeof(FwUpdateArgs));
+    if (args == NULL)
+    {
+        return ERROR_EVI_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        args[i].image   = image;
+        args[i].options = options ? &options[i] : NULL;
+    }
+    Error_t ret = eviForEachLimited(sessions, count, maxConcurrent, eviFwUpdateAll_, args, sizeof(FwUpdateArgs), results);
+
+    free(args);
+    return ret;
+}
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+#include "eviasync.h"
+#include "evisrec.h"
+
+/**
+ * @file evifanout.h
+ * @brief Drives several modules concurrently from one process.
+ *
+ * Every session is served by its own thread, so the slowest module and not
+ * the sum of all modules determines the duration of an operation.
+ */
+
+/**
+ * @brief Prepares one session per attached module.
+ *
+ * The sessions copy the options (verbose, checksum, timeouts, ...) and address
+ * their module by USB serial number, so they find it again after a re-enumeration.
+ *
+ * @param options Session with the options for all sessions.
+ * @param devices Modules, see eviEnumerateDevices(). They must stay valid as long as the sessions are used.
+ * @param count Number of modules.
+ * @param sessions Array of count sessions to initialize.
+ */
+DLLEXPORT void eviSessionsFromDevices(const Evi_t *options, const EviDeviceInfo_t *devices, size_t count, Evi_t *sessions);
+
+/**
+ * @brief Closes all sessions.
+ *
+ * @param sessions Array of sessions.
+ * @param count Number of sessions.
+ */
+DLLEXPORT void eviCloseAll(Evi_t *sessions, size_t count);
+
+/**
+ * @brief Executes an operation on all sessions concurrently.
+ *
+ * @param sessions Array of sessions.
+ * @param count Number of sessions.
+ * @param operation Operation executed once per session.
+ * @param args Array of count elements of argsSize bytes, element i is passed with session i. May be NULL.
+ * @param argsSize Size of one element of args.
+ * @param results Array of count results, may be NULL.
+ * @return The first error of all sessions or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviForEach(Evi_t *sessions, size_t count, EviAsyncOperation_t operation, void *args, size_t argsSize, Error_t *results);
+
+/**
+ * @brief Executes an operation on all sessions with at most maxConcurrent of them at a time.
+ *
+ * Every session still gets its own thread, but only maxConcurrent threads run
+ * the operation at once; the others wait for a free slot.
+ *
+ * @param sessions Array of sessions.
+ * @param count Number of sessions.
+ * @param maxConcurrent Maximal number of concurrent operations, 0 runs all at once like eviForEach().
+ * @param operation Operation executed once per session.
+ * @param args Array of count elements of argsSize bytes, element i is passed with session i. May be NULL.
+ * @param argsSize Size of one element of args.
+ * @param results Array of count results, may be NULL.
+ * @return The first error of all sessions or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviForEachLimited(Evi_t *sessions, size_t count, size_t maxConcurrent, EviAsyncOperation_t operation, void *args, size_t argsSize, Error_t *results);
+
+/**
+ * @brief Executes the self-test on all sessions concurrently, see eviSelftest().
+ *
+ * @param sessions Array of sessions.
+ * @param count Number of sessions.
+ * @param selftests Array of count self-test results.
+ * @param results Array of count results, may be NULL.
+ * @return The first error of all sessions or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviSelftestAll(Evi_t *sessions, size_t count, uint32_t *selftests, Error_t *results);
+
+/**
+ * @brief Gets the same indices from all sessions concurrently, see eviGetMany().
+ *
+ * @param sessions Array of sessions.
+ * @param count Number of sessions.
+ * @param values Array of count * valuesPerSession values, the indices must be set. Session i uses values[i * valuesPerSession].
+ * @param valuesPerSession Number of values per session.
+ * @param results Array of count results, may be NULL.
+ * @return The first error of all sessions or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviGetManyAll(Evi_t *sessions, size_t count, EviValue_t *values, size_t valuesPerSession, Error_t *results);
+
+/**
+ * @brief Updates the firmware of all sessions, see eviFwUpdateImage().
+ *
+ * Every module is erased, written, rebooted and verified by its own worker;
+ * at most maxConcurrent modules are updated at the same time. All workers
+ * send the same image, it is validated once by the caller.
+ *
+ * @param sessions Array of sessions.
+ * @param count Number of sessions.
+ * @param image The image, see eviSrecLoad().
+ * @param options Array of count options, e.g. with a progress callback per module. May be NULL.
+ * @param maxConcurrent Maximal number of concurrent updates, 0 updates all at once.
+ * @param results Array of count results, may be NULL.
+ * @return The first error of all sessions or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviFwUpdateAll(Evi_t *sessions, size_t count, const EviSrecImage_t *image, const EviFwOptions_t *options, size_t maxConcurrent, Error_t *results);
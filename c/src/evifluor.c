@@ -3,22 +3,43 @@
 
 #include "evifluor.h"
 #include "evifluorindex.h"
+#include "commonindex.h"
+#include "eviparse.h"
+#include "evifanout.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 typedef struct
 {
     SingleMeasurement_t * measurement;
 } UserMeasurement;
 
+static const uint32_t eviFluorConstants[] =
+{
+    INDEX_VERSION, INDEX_SERIALNUMBER, INDEX_PRODUCTIONNUMBER,
+    INDEX_CURRENT_LED470_POWER_MIN, INDEX_CURRENT_LED470_POWER_MAX,
+    INDEX_CURRENT_LED625_POWER_MIN, INDEX_CURRENT_LED625_POWER_MAX,
+};
+
+void eviFluorCacheConstants(Evi_t *self, bool persist)
+{
+    self->constants = eviFluorConstants;
+    self->constantCount = sizeof(eviFluorConstants) / sizeof(eviFluorConstants[0]);
+    self->persistConstants = persist;
+}
+
 Error_t eviFluorMeasure_(EvieResponse_t *response, void *user)
 {
 	UserMeasurement *u = (UserMeasurement *)user;
     if (response->argc == 7)
 	{
-        u->measurement->channel470.dark     = atof(response->argv[1]);
-        u->measurement->channel470.value    = atof(response->argv[2]);
-        u->measurement->channel470.ledPower = atoi(response->argv[3]);
+        if (!eviParseDouble(response->argv[1], &u->measurement->channel470.dark) ||
+            !eviParseDouble(response->argv[2], &u->measurement->channel470.value) ||
+            !eviParseUInt32(response->argv[3], &u->measurement->channel470.ledPower))
+        {
+            return ERROR_EVI_PROTOCOL_ERROR;
+        }
         return ERROR_EVI_OK;
 	}
 	else
@@ -37,8 +58,14 @@ Error_t eviFluorAutogain_(EvieResponse_t *response, void *user)
     UserAutogain *u = (UserAutogain *)user;
     if (response->argc == 3)
     {
-        u->autogain->found     = atoi(response->argv[1]);
-        u->autogain->ledPower  = atoi(response->argv[2]);
+        uint32_t found;
+        uint32_t ledPower;
+        if (!eviParseUInt32(response->argv[1], &found) || !eviParseUInt32(response->argv[2], &ledPower))
+        {
+            return ERROR_EVI_PROTOCOL_ERROR;
+        }
+        u->autogain->found     = found;
+        u->autogain->ledPower  = ledPower;
         return ERROR_EVI_OK;
     }
     else
@@ -57,7 +84,34 @@ Error_t eviFluorIsCuvetteHolderEmpty_(EvieResponse_t *response, void *user)
     UserEmpty *u = (UserEmpty *)user;
     if (response->argc >= 2)
     {
-        (*u->empty) = atoi(response->argv[1]);
+        uint32_t empty;
+        if (!eviParseUInt32(response->argv[1], &empty))
+        {
+            return ERROR_EVI_PROTOCOL_ERROR;
+        }
+        (*u->empty) = empty;
+        return ERROR_EVI_OK;
+    }
+    else
+    {
+        return ERROR_EVI_PROTOCOL_ERROR;
+    }
+}
+
+typedef struct
+{
+    uint32_t * count;
+} UserCount;
+
+Error_t eviFluorCount_(EvieResponse_t *response, void *user)
+{
+    UserCount *u = (UserCount *)user;
+    if (response->argc == 2)
+    {
+        if (!eviParseUInt32(response->argv[1], u->count))
+        {
+            return ERROR_EVI_PROTOCOL_ERROR;
+        }
         return ERROR_EVI_OK;
     }
     else
@@ -72,6 +126,16 @@ Error_t eviFluorMeasure(Evi_t * self, SingleMeasurement_t * measurement)
     return eviExecute(self, "M", eviFluorMeasure_, &user);
 }
 
+static Error_t eviFluorMeasureAll_(Evi_t *evi, void *args)
+{
+    return eviFluorMeasure(evi, (SingleMeasurement_t *)args);
+}
+
+Error_t eviFluorMeasureAll(Evi_t *sessions, size_t count, SingleMeasurement_t * measurements, Error_t *results)
+{
+    return eviForEach(sessions, count, eviFluorMeasureAll_, measurements, sizeof(SingleMeasurement_t), results);
+}
+
 Error_t eviFluorAutogain(Evi_t *self, uint32_t level, Autogain_t * autogain)
 {
     UserAutogain user = {autogain = autogain};
@@ -81,34 +145,161 @@ Error_t eviFluorAutogain(Evi_t *self, uint32_t level, Autogain_t * autogain)
     return eviExecute(self, cmd, eviFluorAutogain_, &user);
 }
 
-Error_t eviFluorMeasureFirstAir(Evi_t * self, MeasurementFirstAir_t * measurement)
+Error_t eviFluorMeasureAtLedPower(Evi_t * self, uint32_t ledPower, SingleMeasurement_t * measurement)
+{
+    char cmd[EVI_MAX_LINE_LENGTH];
+    UserMeasurement user = {.measurement = measurement};
+    EviRequest_t requests[] =
+    {
+        { .command = cmd, .execute = eviNoReturn_ },
+        { .command = "M", .execute = eviFluorMeasure_, .user = &user },
+    };
+
+    sprintf_s(cmd, EVI_MAX_LINE_LENGTH, "V %i %u", INDEX_CURRENT_LED470_POWER, ledPower);
+    return eviExecutePipelined(self, requests, sizeof(requests) / sizeof(requests[0]));
+}
+
+// Readings in one pipelined burst of eviFluorMeasureReplicates()
+#define EVI_FLUOR_REPLICATES_BATCH 16
+
+Error_t eviFluorMeasureReplicates(Evi_t * self, uint32_t count, double cvTarget, Replicates_t * replicates)
 {
     Error_t ret = ERROR_EVI_OK;
-    char valueMin[10];
-    char valueMax[10];
+    SingleMeasurement_t measurements[EVI_FLUOR_REPLICATES_BATCH];
+    UserMeasurement users[EVI_FLUOR_REPLICATES_BATCH];
+    EviRequest_t requests[EVI_FLUOR_REPLICATES_BATCH];
+    uint32_t done = 0;
 
-    ret = eviGet(self, INDEX_CURRENT_LED470_POWER_MIN, valueMin, sizeof(valueMin));
-    if(ret != ERROR_EVI_OK) goto exit;
+    memset(replicates, 0, sizeof(Replicates_t));
+    if (count == 0 || cvTarget < 0)
+    {
+        return ERROR_EVI_INVALID_PARAMETER;
+    }
 
-    ret = eviGet(self, INDEX_CURRENT_LED470_POWER_MAX, valueMax, sizeof(valueMax));
-    if(ret != ERROR_EVI_OK) goto exit;
+    while (done < count && ret == ERROR_EVI_OK)
+    {
+        uint32_t batch = count - done;
+        if (cvTarget > 0)
+        {
+            // Past the minimum every reading may be the last one
+            batch = done < EVI_FLUOR_REPLICATES_MIN ? EVI_FLUOR_REPLICATES_MIN - done : 1;
+            batch = batch < count - done ? batch : count - done;
+        }
+        batch = batch < EVI_FLUOR_REPLICATES_BATCH ? batch : EVI_FLUOR_REPLICATES_BATCH;
 
-    ret = eviSet(self, INDEX_CURRENT_LED470_POWER, valueMin);
-    if(ret != ERROR_EVI_OK) goto exit;
+        for (uint32_t i = 0; i < batch; i++)
+        {
+            users[i].measurement = &measurements[i];
+            requests[i] = (EviRequest_t){ .command = "M", .execute = eviFluorMeasure_, .user = &users[i] };
+        }
+        eviExecutePipelined(self, requests, batch);
 
-    ret = eviFluorMeasure(self, &(measurement->min));
-    if(ret != ERROR_EVI_OK) goto exit;
+        // Only the readings up to the first failed one count
+        for (uint32_t i = 0; i < batch && ret == ERROR_EVI_OK; i++)
+        {
+            ret = requests[i].result;
+            if (ret == ERROR_EVI_OK)
+            {
+                replicates_add(replicates, &measurements[i]);
+                done++;
+            }
+        }
 
-    ret = eviSet(self, INDEX_CURRENT_LED470_POWER, valueMax);
-    if(ret != ERROR_EVI_OK) goto exit;
+        if (cvTarget > 0 && done >= EVI_FLUOR_REPLICATES_MIN && runningStatistic_cv(&replicates->delta) <= cvTarget)
+        {
+            break;
+        }
+    }
+    return ret;
+}
 
-    ret = eviFluorMeasure(self, &(measurement->max));
-    if(ret != ERROR_EVI_OK) goto exit;
+Error_t eviFluorMeasureFirstAir(Evi_t * self, MeasurementFirstAir_t * measurement)
+{
+    return eviFluorMeasureFirstAirEx(self, measurement, NULL);
+}
 
-exit:
+Error_t eviFluorMeasureFirstAirEx(Evi_t * self, MeasurementFirstAir_t * measurement, Error_t * results)
+{
+    Error_t ret = ERROR_EVI_OK;
+    Error_t steps[EVI_FLUOR_FIRST_AIR_STEPS];
+    EviValue_t limits[] = { { .index = INDEX_CURRENT_LED470_POWER_MIN }, { .index = INDEX_CURRENT_LED470_POWER_MAX } };
+    char cmdMin[EVI_MAX_LINE_LENGTH];
+    char cmdMax[EVI_MAX_LINE_LENGTH];
+    UserMeasurement userMin = {.measurement = &measurement->min};
+    UserMeasurement userMax = {.measurement = &measurement->max};
+    // Ordered like the steps after EVI_FLUOR_FIRST_AIR_LIMITS
+    EviRequest_t requests[] =
+    {
+        { .command = cmdMin, .execute = eviNoReturn_ },
+        { .command = "M", .execute = eviFluorMeasure_, .user = &userMin },
+        { .command = cmdMax, .execute = eviNoReturn_ },
+        { .command = "M", .execute = eviFluorMeasure_, .user = &userMax },
+    };
+
+    memset(measurement, 0, sizeof(MeasurementFirstAir_t));
+
+    // The limits are needed to build the burst, usually they come from the constants cache
+    steps[EVI_FLUOR_FIRST_AIR_LIMITS] = eviGetMany(self, limits, sizeof(limits) / sizeof(limits[0]));
+    if (steps[EVI_FLUOR_FIRST_AIR_LIMITS] == ERROR_EVI_OK)
+    {
+        sprintf_s(cmdMin, EVI_MAX_LINE_LENGTH, "V %i %s", INDEX_CURRENT_LED470_POWER, limits[0].value);
+        sprintf_s(cmdMax, EVI_MAX_LINE_LENGTH, "V %i %s", INDEX_CURRENT_LED470_POWER, limits[1].value);
+        eviExecutePipelined(self, requests, sizeof(requests) / sizeof(requests[0]));
+        for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++)
+        {
+            steps[EVI_FLUOR_FIRST_AIR_SET_MIN + i] = requests[i].result;
+        }
+        // A measurement was already in flight when its LED power was rejected, it ran at the previous power
+        if (steps[EVI_FLUOR_FIRST_AIR_SET_MIN] != ERROR_EVI_OK)
+        {
+            steps[EVI_FLUOR_FIRST_AIR_MEASURE_MIN] = steps[EVI_FLUOR_FIRST_AIR_SET_MIN];
+        }
+        if (steps[EVI_FLUOR_FIRST_AIR_SET_MAX] != ERROR_EVI_OK)
+        {
+            steps[EVI_FLUOR_FIRST_AIR_MEASURE_MAX] = steps[EVI_FLUOR_FIRST_AIR_SET_MAX];
+        }
+    }
+    else
+    {
+        for (size_t i = EVI_FLUOR_FIRST_AIR_SET_MIN; i < EVI_FLUOR_FIRST_AIR_STEPS; i++)
+        {
+            steps[i] = steps[EVI_FLUOR_FIRST_AIR_LIMITS];
+        }
+    }
+
+    for (size_t i = 0; i < EVI_FLUOR_FIRST_AIR_STEPS; i++)
+    {
+        if (ret == ERROR_EVI_OK)
+        {
+            ret = steps[i];
+        }
+        if (results != NULL)
+        {
+            results[i] = steps[i];
+        }
+    }
     return ret;
 }
 
+const char *eviFluorFirstAirStep2String(EviFluorFirstAirStep_t step)
+{
+    switch (step)
+    {
+    case EVI_FLUOR_FIRST_AIR_LIMITS:
+        return "reading the LED power limits";
+    case EVI_FLUOR_FIRST_AIR_SET_MIN:
+        return "setting the minimum LED power";
+    case EVI_FLUOR_FIRST_AIR_MEASURE_MIN:
+        return "measuring at the minimum LED power";
+    case EVI_FLUOR_FIRST_AIR_SET_MAX:
+        return "setting the maximum LED power";
+    case EVI_FLUOR_FIRST_AIR_MEASURE_MAX:
+        return "measuring at the maximum LED power";
+    default:
+        return "unknown step";
+    }
+}
+
 Error_t eviFluorMeasureFirstSample(Evi_t * self, MeasurementFirstSample_t * measurement)
 {
     Error_t ret = ERROR_EVI_OK;
@@ -130,6 +321,56 @@ Error_t eviFluorLastMeasurements(Evi_t * self, uint32_t last, SingleMeasurement_
     return eviExecute(self, cmd, eviFluorMeasure_, &user);
 }
 
+Error_t eviFluorStoredMeasurements(Evi_t * self, SingleMeasurement_t * measurements, size_t maxCount, size_t * count, size_t * stored)
+{
+    Error_t ret;
+    uint32_t reported = 0;
+    UserCount userCount = {.count = &reported};
+    char cmds[EVI_FLUOR_MAX_STORED_MEASUREMENTS][EVI_MAX_LINE_LENGTH];
+    char cmdCount[EVI_MAX_LINE_LENGTH];
+    UserMeasurement users[EVI_FLUOR_MAX_STORED_MEASUREMENTS];
+    EviRequest_t requests[EVI_FLUOR_MAX_STORED_MEASUREMENTS + 1];
+    size_t n = maxCount < EVI_FLUOR_MAX_STORED_MEASUREMENTS ? maxCount : EVI_FLUOR_MAX_STORED_MEASUREMENTS;
+
+    *count = 0;
+    if (stored != NULL)
+    {
+        *stored = 0;
+    }
+    sprintf_s(cmdCount, EVI_MAX_LINE_LENGTH, "V %i", INDEX_LASTMEASUREMENTCOUNT);
+    requests[0] = (EviRequest_t){ .command = cmdCount, .execute = eviFluorCount_, .user = &userCount };
+    for (size_t i = 0; i < n; i++)
+    {
+        sprintf_s(cmds[i], EVI_MAX_LINE_LENGTH, "M %zu", i);
+        users[i].measurement = &measurements[i];
+        // Slots beyond the count are empty, the module answers them with an error
+        requests[i + 1] = (EviRequest_t){ .command = cmds[i], .execute = eviFluorMeasure_, .user = &users[i], .mayFail = true };
+    }
+
+    // The count isn't known before the answers arrive, so all measurements are requested
+    eviExecutePipelined(self, requests, n + 1);
+    ret = requests[0].result;
+    if (ret != ERROR_EVI_OK)
+    {
+        return ret;
+    }
+
+    if (stored != NULL)
+    {
+        *stored = reported;
+    }
+    n = reported < n ? reported : n;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (requests[i + 1].result != ERROR_EVI_OK)
+        {
+            return requests[i + 1].result;
+        }
+    }
+    *count = n;
+    return ERROR_EVI_OK;
+}
+
 Error_t eviFluorBaseline(Evi_t * self)
 {
     return eviExecute(self, "G", eviNoReturn_, 0);
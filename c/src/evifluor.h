@@ -5,6 +5,7 @@
 
 #include "evibase.h"
 #include "singlemeasurement.h"
+#include "replicates.h"
 #include <stdint.h>
 
 /**
@@ -33,6 +34,20 @@ typedef struct
     SingleMeasurement_t max; /**< Maximum detected measurement values. */
 } MeasurementFirstAir_t;
 
+/**
+ * @enum EviFluorFirstAirStep_t
+ * @brief The steps of a first air measurement, see eviFluorMeasureFirstAirEx().
+ */
+typedef enum
+{
+    EVI_FLUOR_FIRST_AIR_LIMITS = 0, /**< Reading the LED power limits. */
+    EVI_FLUOR_FIRST_AIR_SET_MIN, /**< Setting the LED power to its minimum. */
+    EVI_FLUOR_FIRST_AIR_MEASURE_MIN, /**< Measuring at the minimum. */
+    EVI_FLUOR_FIRST_AIR_SET_MAX, /**< Setting the LED power to its maximum. */
+    EVI_FLUOR_FIRST_AIR_MEASURE_MAX, /**< Measuring at the maximum. */
+    EVI_FLUOR_FIRST_AIR_STEPS /**< Number of steps. */
+} EviFluorFirstAirStep_t;
+
 /**
  * @struct MeasurementFirstSample_t
  * @brief Represents the first sample measurement, including autogain data.
@@ -46,6 +61,17 @@ typedef struct
     SingleMeasurement_t measurement; /**< The recorded sample measurement. */
 } MeasurementFirstSample_t;
 
+/**
+ * @brief Lets a session cache the read-only values of an eviFluor module.
+ *
+ * Besides version, serial number and production number the LED power limits
+ * are cached, see eviGet().
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param persist Keeps the values in a file across processes, see Evi_t.persistConstants.
+ */
+DLLEXPORT void eviFluorCacheConstants(Evi_t *self, bool persist);
+
 /**
  * @brief Performs an autogain adjustment for fluorescence measurement.
  *
@@ -74,6 +100,37 @@ DLLEXPORT Error_t eviFluorBaseline(Evi_t * self);
  */
 DLLEXPORT Error_t eviFluorMeasure(Evi_t *self, SingleMeasurement_t * measurement);
 
+/**
+ * @brief Sets the LED power and measures in one pipelined exchange.
+ *
+ * The LED power stays set after the measurement.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param ledPower The LED power to measure at.
+ * @param measurement Pointer to a SingleMeasurement_t structure to store the result.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviFluorMeasureAtLedPower(Evi_t *self, uint32_t ledPower, SingleMeasurement_t * measurement);
+
+/** @brief Minimal number of readings before eviFluorMeasureReplicates() checks the CV target. */
+#define EVI_FLUOR_REPLICATES_MIN 3
+
+/**
+ * @brief Measures the same sample several times and keeps the statistics.
+ *
+ * Without a CV target all readings are sent pipelined. With a CV target the
+ * first EVI_FLUOR_REPLICATES_MIN readings are sent pipelined, then one more
+ * at a time until the CV of delta is at most the target or count readings
+ * are taken. The readings taken before an error stay in replicates.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param count Number of readings, the maximum with a CV target.
+ * @param cvTarget Target CV of delta as a fraction (e.g. 0.01), 0 takes count readings.
+ * @param replicates Pointer to a Replicates_t structure to store the statistics.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviFluorMeasureReplicates(Evi_t *self, uint32_t count, double cvTarget, Replicates_t * replicates);
+
 /**
  * @brief Performs the first air measurement and stores the result.
  *
@@ -83,6 +140,30 @@ DLLEXPORT Error_t eviFluorMeasure(Evi_t *self, SingleMeasurement_t * measurement
  */
 DLLEXPORT Error_t eviFluorMeasureFirstAir(Evi_t *self, MeasurementFirstAir_t * measurement);
 
+/**
+ * @brief Performs the first air measurement and reports the result of each step.
+ *
+ * After the LED power limits are read, which needs no exchange once they are
+ * cached (see eviFluorCacheConstants()), both measurements are sent as one
+ * pipelined burst. If the limits can't be read, the other steps get their
+ * error. A measurement whose LED power was rejected gets the error of setting
+ * it, although it already ran at the previous power.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param measurement Pointer to a MeasurementFirstAir_t structure to store the min and max values.
+ * @param results Array of EVI_FLUOR_FIRST_AIR_STEPS results, indexed by EviFluorFirstAirStep_t; may be NULL.
+ * @return The error of the first failed step or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviFluorMeasureFirstAirEx(Evi_t *self, MeasurementFirstAir_t * measurement, Error_t *results);
+
+/**
+ * @brief Returns a short description of a first air step, e.g. for error messages.
+ *
+ * @param step The step.
+ * @return The description.
+ */
+DLLEXPORT const char *eviFluorFirstAirStep2String(EviFluorFirstAirStep_t step);
+
 /**
  * @brief Performs the first sample measurement with autogain and stores the result.
  *
@@ -92,6 +173,17 @@ DLLEXPORT Error_t eviFluorMeasureFirstAir(Evi_t *self, MeasurementFirstAir_t * m
  */
 DLLEXPORT Error_t eviFluorMeasureFirstSample(Evi_t *self, MeasurementFirstSample_t * measurement);
 
+/**
+ * @brief Measures fluorescence on several modules concurrently, see eviFluorMeasure().
+ *
+ * @param sessions Array of sessions, see eviSessionsFromDevices().
+ * @param count Number of sessions.
+ * @param measurements Array of count SingleMeasurement_t structures to store the results.
+ * @param results Array of count results, may be NULL.
+ * @return The first error of all sessions or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviFluorMeasureAll(Evi_t *sessions, size_t count, SingleMeasurement_t * measurements, Error_t *results);
+
 /**
  * @brief Retrieves the last fluorescence measurement results.
  *
@@ -102,6 +194,27 @@ DLLEXPORT Error_t eviFluorMeasureFirstSample(Evi_t *self, MeasurementFirstSample
  */
 DLLEXPORT Error_t eviFluorLastMeasurements(Evi_t * self, uint32_t last, SingleMeasurement_t * measurement);
 
+/** @brief Number of measurements the module keeps, see eviFluorStoredMeasurements(). */
+#define EVI_FLUOR_MAX_STORED_MEASUREMENTS 10
+
+/**
+ * @brief Retrieves all stored measurements in one pipelined exchange.
+ *
+ * The count of stored measurements and every stored measurement are requested
+ * together, the requests beyond the count are answered with an error by the
+ * module and ignored; they are not counted in Evi_t.stats. At most maxCount
+ * and EVI_FLUOR_MAX_STORED_MEASUREMENTS measurements are read, the count the
+ * module reports is returned in stored, so a caller can tell if some were left.
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param measurements Array to store the measurements, the newest first like eviFluorLastMeasurements().
+ * @param maxCount Size of the measurements array.
+ * @param count Pointer to store the number of measurements retrieved.
+ * @param stored Pointer to store the number of measurements the module reports, may be NULL.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviFluorStoredMeasurements(Evi_t * self, SingleMeasurement_t * measurements, size_t maxCount, size_t * count, size_t * stored);
+
 /**
  * @brief Performs a self-test on the fluorescence measurement system.
  *
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evifluorasync.h"
+
+typedef struct
+{
+    uint32_t level;
+    Autogain_t * autogain;
+} AutogainArgs;
+
+static Error_t eviFluorAutogainAsync_(Evi_t *evi, void *args)
+{
+    AutogainArgs *a = (AutogainArgs *)args;
+    return eviFluorAutogain(evi, a->level, a->autogain);
+}
+
+Error_t eviFluorAutogainAsync(EviAsync_t *self, uint32_t level, Autogain_t * autogain, EviAsyncCallback_t callback, void *user, uint32_t *id)
+{
+    AutogainArgs args = {level, autogain};
+    return eviAsyncSubmit(self, eviFluorAutogainAsync_, &args, sizeof(args), callback, user, id);
+}
+
+static Error_t eviFluorBaselineAsync_(Evi_t *evi, void *args)
+{
+    return eviFluorBaseline(evi);
+}
+
+Error_t eviFluorBaselineAsync(EviAsync_t *self, EviAsyncCallback_t callback, void *user, uint32_t *id)
+{
+    return eviAsyncSubmit(self, eviFluorBaselineAsync_, NULL, 0, callback, user, id);
+}
+
+typedef struct
+{
+    SingleMeasurement_t * measurement;
+} MeasureArgs;
+
+static Error_t eviFluorMeasureAsync_(Evi_t *evi, void *args)
+{
+    MeasureArgs *a = (MeasureArgs *)args;
+    return eviFluorMeasure(evi, a->measurement);
+}
+
+Error_t eviFluorMeasureAsync(EviAsync_t *self, SingleMeasurement_t * measurement, EviAsyncCallback_t callback, void *user, uint32_t *id)
+{
+    MeasureArgs args = {measurement};
+    return eviAsyncSubmit(self, eviFluorMeasureAsync_, &args, sizeof(args), callback, user, id);
+}
+
+typedef struct
+{
+    MeasurementFirstAir_t * measurement;
+} MeasureFirstAirArgs;
+
+static Error_t eviFluorMeasureFirstAirAsync_(Evi_t *evi, void *args)
+{
+    MeasureFirstAirArgs *a = (MeasureFirstAirArgs *)args;
+    return eviFluorMeasureFirstAir(evi, a->measurement);
+}
+
+Error_t eviFluorMeasureFirstAirAsync(EviAsync_t *self, MeasurementFirstAir_t * measurement, EviAsyncCallback_t callback, void *user, uint32_t *id)
+{
+    MeasureFirstAirArgs args = {measurement};
+    return eviAsyncSubmit(self, eviFluorMeasureFirstAirAsync_, &args, sizeof(args), callback, user, id);
+}
+
+typedef struct
+{
+    MeasurementFirstSample_t * measurement;
+} MeasureFirstSampleArgs;
+
+static Error_t eviFluorMeasureFirstSampleAsync_(Evi_t *evi, void *args)
+{
+    MeasureFirstSampleArgs *a = (MeasureFirstSampleArgs *)args;
+    return eviFluorMeasureFirstSample(evi, a->measurement);
+}
+
+Error_t eviFluorMeasureFirstSampleAsync(EviAsync_t *self, MeasurementFirstSample_t * measurement, EviAsyncCallback_t callback, void *user, uint32_t *id)
+{
+    MeasureFirstSampleArgs args = {measurement};
+    return eviAsyncSubmit(self, eviFluorMeasureFirstSampleAsync_, &args, sizeof(args), callback, user, id);
+}
+
+typedef struct
+{
+    uint32_t last;
+    SingleMeasurement_t * measurement;
+} LastMeasurementsArgs;
+
+static Error_t eviFluorLastMeasurementsAsync_(Evi_t *evi, void *args)
+{
+    LastMeasurementsArgs *a = (LastMeasurementsArgs *)args;
+    return eviFluorLastMeasurements(evi, a->last, a->measurement);
+}
+
+Error_t eviFluorLastMeasurementsAsync(EviAsync_t *self, uint32_t last, SingleMeasurement_t * measurement, EviAsyncCallback_t callback, void *user, uint32_t *id)
+{
+    LastMeasurementsArgs args = {last, measurement};
+    return eviAsyncSubmit(self, eviFluorLastMeasurementsAsync_, &args, sizeof(args), callback, user, id);
+}
+
+typedef struct
+{
+    uint32_t * result;
+} SelftestArgs;
+
+static Error_t eviFluorSelftestAsync_(Evi_t *evi, void *args)
+{
+    SelftestArgs *a = (SelftestArgs *)args;
+    return eviSelftest(evi, a->result);
+}
+
+Error_t eviFluorSelftestAsync(EviAsync_t *self, uint32_t *result, EviAsyncCallback_t callback, void *user, uint32_t *id)
+{
+    SelftestArgs args = {result};
+    return eviAsyncSubmit(self, eviFluorSelftestAsync_, &args, sizeof(args), callback, user, id);
+}
+
+typedef struct
+{
+    bool * empty;
+} IsCuvetteHolderEmptyArgs;
+
+static Error_t eviFluorIsCuvetteHolderEmptyAsync_(Evi_t *evi, void *args)
+{
+    IsCuvetteHolderEmptyArgs *a = (IsCuvetteHolderEmptyArgs *)args;
+    return eviFluorIsCuvetteHolderEmpty(evi, a->empty);
+}
+
+Error_t eviFluorIsCuvetteHolderEmptyAsync(EviAsync_t *self, bool * empty, EviAsyncCallback_t callback, void *user, uint32_t *id)
+{
+    IsCuvetteHolderEmptyArgs args = {empty};
+    return eviAsyncSubmit(self, eviFluorIsCuvetteHolderEmptyAsync_, &args, sizeof(args), callback, user, id);
+}
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "eviasync.h"
+#include "evifluor.h"
+
+/**
+ * @file evifluorasync.h
+ * @brief Asynchronous variants of the functions in evifluor.h.
+ *
+ * Each function submits the operation to the I/O thread started with
+ * eviAsyncStart() and returns immediately. The result structures are written
+ * by the I/O thread and must stay valid until the operation is finished.
+ */
+
+/**
+ * @brief Submits an autogain adjustment, see eviFluorAutogain().
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param level The target level (0-2500) for autogain adjustment.
+ * @param autogain Pointer to an Autogain_t structure to store the result.
+ * @param callback Called on the I/O thread when done, NULL to use the completion queue.
+ * @param user User-defined data passed to the callback or the completion.
+ * @param id Pointer to store the id of the operation, may be NULL.
+ * @return ERROR_EVI_OK if the operation was submitted, otherwise ERROR_EVI_QUEUE_FULL.
+ */
+DLLEXPORT Error_t eviFluorAutogainAsync(EviAsync_t *self, uint32_t level, Autogain_t * autogain, EviAsyncCallback_t callback, void *user, uint32_t *id);
+
+/**
+ * @brief Submits a baseline command, see eviFluorBaseline().
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param callback Called on the I/O thread when done, NULL to use the completion queue.
+ * @param user User-defined data passed to the callback or the completion.
+ * @param id Pointer to store the id of the operation, may be NULL.
+ * @return ERROR_EVI_OK if the operation was submitted, otherwise ERROR_EVI_QUEUE_FULL.
+ */
+DLLEXPORT Error_t eviFluorBaselineAsync(EviAsync_t *self, EviAsyncCallback_t callback, void *user, uint32_t *id);
+
+/**
+ * @brief Submits a fluorescence measurement, see eviFluorMeasure().
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param measurement Pointer to a SingleMeasurement_t structure to store the result.
+ * @param callback Called on the I/O thread when done, NULL to use the completion queue.
+ * @param user User-defined data passed to the callback or the completion.
+ * @param id Pointer to store the id of the operation, may be NULL.
+ * @return ERROR_EVI_OK if the operation was submitted, otherwise ERROR_EVI_QUEUE_FULL.
+ */
+DLLEXPORT Error_t eviFluorMeasureAsync(EviAsync_t *self, SingleMeasurement_t * measurement, EviAsyncCallback_t callback, void *user, uint32_t *id);
+
+/**
+ * @brief Submits the first air measurement, see eviFluorMeasureFirstAir().
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param measurement Pointer to a MeasurementFirstAir_t structure to store the min and max values.
+ * @param callback Called on the I/O thread when done, NULL to use the completion queue.
+ * @param user User-defined data passed to the callback or the completion.
+ * @param id Pointer to store the id of the operation, may be NULL.
+ * @return ERROR_EVI_OK if the operation was submitted, otherwise ERROR_EVI_QUEUE_FULL.
+ */
+DLLEXPORT Error_t eviFluorMeasureFirstAirAsync(EviAsync_t *self, MeasurementFirstAir_t * measurement, EviAsyncCallback_t callback, void *user, uint32_t *id);
+
+/**
+ * @brief Submits the first sample measurement, see eviFluorMeasureFirstSample().
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param measurement Pointer to a MeasurementFirstSample_t structure to store the autogain and measurement data.
+ * @param callback Called on the I/O thread when done, NULL to use the completion queue.
+ * @param user User-defined data passed to the callback or the completion.
+ * @param id Pointer to store the id of the operation, may be NULL.
+ * @return ERROR_EVI_OK if the operation was submitted, otherwise ERROR_EVI_QUEUE_FULL.
+ */
+DLLEXPORT Error_t eviFluorMeasureFirstSampleAsync(EviAsync_t *self, MeasurementFirstSample_t * measurement, EviAsyncCallback_t callback, void *user, uint32_t *id);
+
+/**
+ * @brief Submits the readback of a stored measurement, see eviFluorLastMeasurements().
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param last The number of previous measurements to retrieve.
+ * @param measurement Pointer to a SingleMeasurement_t structure to store the measurement data.
+ * @param callback Called on the I/O thread when done, NULL to use the completion queue.
+ * @param user User-defined data passed to the callback or the completion.
+ * @param id Pointer to store the id of the operation, may be NULL.
+ * @return ERROR_EVI_OK if the operation was submitted, otherwise ERROR_EVI_QUEUE_FULL.
+ */
+DLLEXPORT Error_t eviFluorLastMeasurementsAsync(EviAsync_t *self, uint32_t last, SingleMeasurement_t * measurement, EviAsyncCallback_t callback, void *user, uint32_t *id);
+
+/**
+ * @brief Submits a self-test, see eviSelftest().
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param result Pointer to store the self-test result.
+ * @param callback Called on the I/O thread when done, NULL to use the completion queue.
+ * @param user User-defined data passed to the callback or the completion.
+ * @param id Pointer to store the id of the operation, may be NULL.
+ * @return ERROR_EVI_OK if the operation was submitted, otherwise ERROR_EVI_QUEUE_FULL.
+ */
+DLLEXPORT Error_t eviFluorSelftestAsync(EviAsync_t *self, uint32_t *result, EviAsyncCallback_t callback, void *user, uint32_t *id);
+
+/**
+ * @brief Submits the check of the cuvette holder, see eviFluorIsCuvetteHolderEmpty().
+ *
+ * @param self Pointer to the EviAsync_t structure.
+ * @param empty Pointer to a boolean value that will be set to true if empty, false otherwise.
+ * @param callback Called on the I/O thread when done, NULL to use the completion queue.
+ * @param user User-defined data passed to the callback or the completion.
+ * @param id Pointer to store the id of the operation, may be NULL.
+ * @return ERROR_EVI_OK if the operation was submitted, otherwise ERROR_EVI_QUEUE_FULL.
+ */
+DLLEXPORT Error_t eviFluorIsCuvetteHolderEmptyAsync(EviAsync_t *self, bool * empty, EviAsyncCallback_t callback, void *user, uint32_t *id);
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evifluorkinetic.h"
+#include "evifluorindex.h"
+#include <string.h>
+
+// Puts a reading into the ring or counts it as overrun if the caller lags behind
+static void eviFluorKineticPush(EviFluorKinetic_t *self, const SingleMeasurement_t *measurement, uint64_t nowUs)
+{
+    size_t tail = self->tail;
+
+    if (tail - eviAtomicLoad(&self->head) >= EVI_FLUOR_KINETIC_RING_SIZE)
+    {
+        eviAtomicStore(&self->overruns, self->overruns + 1);
+        return;
+    }
+    EviFluorReading_t *reading = &self->ring[tail % EVI_FLUOR_KINETIC_RING_SIZE];
+    reading->timeUs      = nowUs - self->startUs;
+    reading->measurement = *measurement;
+    eviAtomicStore(&self->tail, tail + 1);
+    eviSemaphorePost(&self->ready);
+}
+
+static EVI_THREAD_RESULT eviFluorKineticRun(void *arg)
+{
+    EviFluorKinetic_t *self = (EviFluorKinetic_t *)arg;
+    const EviFluorKineticOptions_t *options = &self->options;
+    uint64_t intervalUs = (uint64_t)options->intervalMs * 1000;
+    uint64_t nextUs = self->startUs;
+    Error_t ret = ERROR_EVI_OK;
+
+    if (options->setLedPower)
+    {
+        char value[EVI_MAX_VALUE_LENGTH];
+        sprintf_s(value, EVI_MAX_VALUE_LENGTH, "%u", options->ledPower);
+        ret = eviSet(self->evi, INDEX_CURRENT_LED470_POWER, value);
+    }
+
+    for (uint32_t i = 0; ret == ERROR_EVI_OK && (options->count == 0 || i < options->count); i++)
+    {
+        SingleMeasurement_t measurement;
+        uint64_t nowUs = eviMonotonicUs();
+
+        // Wait for the next slot; a stop ends the wait
+        if (nextUs > nowUs && eviSemaphoreWait(&self->wake, (uint32_t)((nextUs - nowUs + 999) / 1000)))
+        {
+            break;
+        }
+        if (eviAtomicLoad(&self->stop))
+        {
+            break;
+        }
+
+        ret = eviFluorMeasure(self->evi, &measurement);
+        nowUs = eviMonotonicUs();
+        if (ret == ERROR_EVI_OK)
+        {
+            eviFluorKineticPush(self, &measurement, nowUs);
+        }
+        else if (ret != ERROR_EVI_INSTRUMENT_NOT_FOUND && ret != ERROR_EVI_TIMEOUT)
+        {
+            // The module rejected this reading, the next one may work
+            eviAtomicStore(&self->errors, self->errors + 1);
+            ret = ERROR_EVI_OK;
+        }
+
+        // A late reading moves the schedule instead of causing a burst to catch up
+        nextUs += intervalUs;
+        if (nextUs < nowUs)
+        {
+            nextUs = nowUs;
+        }
+    }
+
+    self->result = ret;
+    eviAtomicStore(&self->finished, 1);
+    eviSemaphorePost(&self->ready);
+    EVI_THREAD_RETURN;
+}
+
+Error_t eviFluorKineticStart(EviFluorKinetic_t *self, Evi_t *evi, const EviFluorKineticOptions_t *options)
+{
+    memset(self, 0, sizeof(EviFluorKinetic_t));
+    self->evi = evi;
+    if (options != NULL)
+    {
+        self->options = *options;
+    }
+
+    if (!eviSemaphoreInit(&self->ready))
+    {
+        return ERROR_EVI_THREAD_ERROR;
+    }
+    if (!eviSemaphoreInit(&self->wake))
+    {
+        eviSemaphoreDestroy(&self->ready);
+        return ERROR_EVI_THREAD_ERROR;
+    }
+    self->startUs = eviMonotonicUs();
+    if (!eviThreadCreate(&self->thread, eviFluorKineticRun, self))
+    {
+        eviSemaphoreDestroy(&self->wake);
+        eviSemaphoreDestroy(&self->ready);
+        return ERROR_EVI_THREAD_ERROR;
+    }
+    return ERROR_EVI_OK;
+}
+
+size_t eviFluorKineticRead(EviFluorKinetic_t *self, EviFluorReading_t *readings, size_t maxCount, uint32_t timeoutMs)
+{
+    size_t head = self->head;
+    size_t tail = eviAtomicLoad(&self->tail);
+    size_t count = 0;
+
+    // The semaphore may count readings already taken, so it is only a wake-up
+    while (head == tail && !eviAtomicLoad(&self->finished) && timeoutMs > 0)
+    {
+        if (!eviSemaphoreWait(&self->ready, timeoutMs))
+        {
+            break;
+        }
+        tail = eviAtomicLoad(&self->tail);
+    }
+
+    while (head != tail && count < maxCount)
+    {
+        readings[count++] = self->ring[head % EVI_FLUOR_KINETIC_RING_SIZE];
+        head++;
+    }
+    eviAtomicStore(&self->head, head);
+    return count;
+}
+
+bool eviFluorKineticDone(EviFluorKinetic_t *self)
+{
+    return eviAtomicLoad(&self->finished) && self->head == eviAtomicLoad(&self->tail);
+}
+
+Error_t eviFluorKineticStop(EviFluorKinetic_t *self)
+{
+    eviAtomicStore(&self->stop, 1);
+    eviSemaphorePost(&self->wake);
+    eviThreadJoin(self->thread);
+    eviSemaphoreDestroy(&self->wake);
+    eviSemaphoreDestroy(&self->ready);
+    return self->result;
+}
+
+bool eviFluorBucketAdd(EviFluorBucket_t *self, uint32_t bucketMs, const EviFluorReading_t *reading, EviFluorBucket_t *closed)
+{
+    uint64_t bucketUs = (uint64_t)bucketMs * 1000;
+    double delta = singleMeasurement_delta(&reading->measurement);
+    bool ret = false;
+
+    if (self->replicates.dark.count > 0 && (bucketUs == 0 || reading->timeUs / bucketUs != self->timeUs / bucketUs))
+    {
+        *closed = *self;
+        memset(self, 0, sizeof(EviFluorBucket_t));
+        ret = true;
+    }
+    if (self->replicates.dark.count == 0)
+    {
+        self->timeUs   = reading->timeUs;
+        self->deltaMin = delta;
+        self->deltaMax = delta;
+    }
+    replicates_add(&self->replicates, &reading->measurement);
+    self->deltaMin = delta < self->deltaMin ? delta : self->deltaMin;
+    self->deltaMax = delta > self->deltaMax ? delta : self->deltaMax;
+    return ret;
+}
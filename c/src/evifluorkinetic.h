@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evifluor.h"
+#include "evithread.h"
+
+/**
+ * @file evifluorkinetic.h
+ * @brief Continuous acquisition of fluorescence kinetics.
+ *
+ * An acquisition thread measures repeatedly at a fixed LED power and puts the
+ * readings into a fixed-size single-producer, single-consumer ring. The
+ * caller drains the ring with eviFluorKineticRead(). The measuring loop does
+ * not allocate, so the sampling rate is bounded by the module. When the ring
+ * is full, new readings are dropped and counted as overruns.
+ *
+ * Starting, reading and stopping must all be done by the same thread. While
+ * the acquisition runs, the session must not be used directly.
+ */
+
+#define EVI_FLUOR_KINETIC_RING_SIZE 256
+
+/**
+ * @struct EviFluorKineticOptions_t
+ * @brief Options of a continuous acquisition, see eviFluorKineticStart().
+ */
+typedef struct
+{
+    uint32_t intervalMs; /**< Target interval between readings, 0 measures as fast as the module answers. */
+    uint32_t count; /**< Number of readings, 0 until eviFluorKineticStop(). */
+    bool setLedPower; /**< Sets ledPower before the first reading, otherwise the current LED power is used. */
+    uint32_t ledPower; /**< LED power, see setLedPower. */
+} EviFluorKineticOptions_t;
+
+/**
+ * @struct EviFluorReading_t
+ * @brief One reading of a continuous acquisition.
+ */
+typedef struct
+{
+    uint64_t timeUs; /**< Time the reading was received, in microseconds since the start. */
+    SingleMeasurement_t measurement; /**< The reading. */
+} EviFluorReading_t;
+
+/**
+ * @struct EviFluorKinetic_t
+ * @brief A running continuous acquisition.
+ */
+typedef struct
+{
+    Evi_t *evi; /**< The session driven by the acquisition thread. */
+    EviFluorKineticOptions_t options; /**< Copy of the options. */
+    EviThread_t thread; /**< The acquisition thread. */
+    EviSemaphore_t ready; /**< Posted for every reading and when the acquisition ends. */
+    EviSemaphore_t wake; /**< Posted on stop, ends the wait for the next reading. */
+    uint64_t startUs; /**< eviMonotonicUs() at the start. */
+    EviFluorReading_t ring[EVI_FLUOR_KINETIC_RING_SIZE]; /**< Readings, written by the acquisition thread. */
+    volatile size_t head; /**< Next reading to deliver, written by the caller. */
+    volatile size_t tail; /**< Next free reading, written by the acquisition thread. */
+    volatile size_t overruns; /**< Readings dropped because the ring was full. */
+    volatile size_t errors; /**< Readings the module answered with an error. */
+    volatile size_t stop; /**< Set to stop the acquisition thread. */
+    volatile size_t finished; /**< Set by the acquisition thread when it ends. */
+    Error_t result; /**< Error which ended the acquisition, valid once finished is set. */
+} EviFluorKinetic_t;
+
+/**
+ * @struct EviFluorBucket_t
+ * @brief Readings of a time bucket reduced to their statistics, see eviFluorBucketAdd().
+ *
+ * A zero-initialized structure is an empty bucket.
+ */
+typedef struct
+{
+    uint64_t timeUs; /**< Time of the first reading in the bucket. */
+    Replicates_t replicates; /**< Means and spread of the readings. */
+    double deltaMin; /**< Smallest delta of the readings. */
+    double deltaMax; /**< Largest delta of the readings. */
+} EviFluorBucket_t;
+
+/**
+ * @brief Starts a continuous acquisition.
+ *
+ * Readings the module rejects are counted and skipped. A lost connection,
+ * after the retries of the session, ends the acquisition.
+ *
+ * @param self Pointer to the EviFluorKinetic_t structure.
+ * @param evi The session, it must stay valid until eviFluorKineticStop().
+ * @param options The options, NULL measures as fast as possible until stopped.
+ * @return An error code indicating the result of the operation.
+ */
+DLLEXPORT Error_t eviFluorKineticStart(EviFluorKinetic_t *self, Evi_t *evi, const EviFluorKineticOptions_t *options);
+
+/**
+ * @brief Takes readings out of the ring.
+ *
+ * Waits until at least one reading is available, the acquisition has ended
+ * or the timeout expired. Readings left in the ring can still be taken after
+ * eviFluorKineticStop().
+ *
+ * @param self Pointer to the EviFluorKinetic_t structure.
+ * @param readings Array to store the readings.
+ * @param maxCount Size of the readings array.
+ * @param timeoutMs Maximal time to wait in milliseconds, 0 returns at once.
+ * @return Number of readings stored.
+ */
+DLLEXPORT size_t eviFluorKineticRead(EviFluorKinetic_t *self, EviFluorReading_t *readings, size_t maxCount, uint32_t timeoutMs);
+
+/**
+ * @brief Checks whether the acquisition has ended and all readings were taken.
+ *
+ * @param self Pointer to the EviFluorKinetic_t structure.
+ * @return True if no more readings will come.
+ */
+DLLEXPORT bool eviFluorKineticDone(EviFluorKinetic_t *self);
+
+/**
+ * @brief Stops the acquisition and waits for the acquisition thread.
+ *
+ * @param self Pointer to the EviFluorKinetic_t structure.
+ * @return The error which ended the acquisition or ERROR_EVI_OK.
+ */
+DLLEXPORT Error_t eviFluorKineticStop(EviFluorKinetic_t *self);
+
+/**
+ * @brief Adds a reading to the current bucket, closing it if the reading starts the next one.
+ *
+ * The buckets are aligned to multiples of bucketMs since the start, so a
+ * trace of any length is stored with a fixed resolution.
+ *
+ * @param self Pointer to the current bucket.
+ * @param bucketMs Length of a bucket in milliseconds, 0 keeps every reading in its own bucket.
+ * @param reading The reading.
+ * @param closed Pointer to store the closed bucket.
+ * @return True if a bucket was closed and stored in closed.
+ */
+DLLEXPORT bool eviFluorBucketAdd(EviFluorBucket_t *self, uint32_t bucketMs, const EviFluorReading_t *reading, EviFluorBucket_t *closed);
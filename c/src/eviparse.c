@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "eviparse.h"
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+#define FAST_PATH_MAX_DIGITS 15
+#define FAST_PATH_MAX_EXPONENT 22
+
+// All powers of ten up to 1e22 are exact doubles.
+static const double powersOfTen[FAST_PATH_MAX_EXPONENT + 1] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool parseMagnitude(const char *s, uint32_t limit, uint32_t *value)
+{
+    uint32_t v = 0;
+
+    if (!isDigit(*s))
+    {
+        return false;
+    }
+
+    while (isDigit(*s))
+    {
+        uint32_t digit = *s - '0';
+        if (v > (limit - digit) / 10)
+        {
+            return false;
+        }
+        v = v * 10 + digit;
+        s++;
+    }
+
+    if (*s != '\0')
+    {
+        return false;
+    }
+
+    *value = v;
+    return true;
+}
+
+bool eviParseUInt32(const char *s, uint32_t *value)
+{
+    if (*s == '+')
+    {
+        s++;
+    }
+    return parseMagnitude(s, UINT32_MAX, value);
+}
+
+bool eviParseInt32(const char *s, int32_t *value)
+{
+    bool negative = false;
+    uint32_t magnitude;
+
+    if (*s == '-' || *s == '+')
+    {
+        negative = (*s == '-');
+        s++;
+    }
+
+    if (!parseMagnitude(s, negative ? (uint32_t)INT32_MAX + 1 : INT32_MAX, &magnitude))
+    {
+        return false;
+    }
+
+    *value = negative ? (int32_t)(0 - magnitude) : (int32_t)magnitude;
+    return true;
+}
+
+static bool parseDoubleSlow(const char *s, double *value)
+{
+    char *end;
+
+    errno = 0;
+    double v = strtod(s, &end);
+    if (end == s || *end != '\0' || errno == ERANGE || !isfinite(v))
+    {
+        return false;
+    }
+
+    *value = v;
+    return true;
+}
+
+bool eviParseDouble(const char *s, double *value)
+{
+    const char *p = s;
+    bool negative = false;
+    bool anyDigit = false;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    if (*p == '-' || *p == '+')
+    {
+        negative = (*p == '-');
+        p++;
+    }
+
+    while (isDigit(*p))
+    {
+        anyDigit = true;
+        if (digits < FAST_PATH_MAX_DIGITS + 1)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += (mantissa != 0);
+        }
+        else
+        {
+            exponent++;
+        }
+        p++;
+    }
+
+    if (*p == '.')
+    {
+        p++;
+        while (isDigit(*p))
+        {
+            anyDigit = true;
+            if (digits < FAST_PATH_MAX_DIGITS + 1)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += (mantissa != 0);
+                exponent--;
+            }
+            p++;
+        }
+    }
+
+    if (!anyDigit)
+    {
+        return false;
+    }
+
+    if (*p != '\0' || digits > FAST_PATH_MAX_DIGITS || exponent < -FAST_PATH_MAX_EXPONENT || exponent > FAST_PATH_MAX_EXPONENT)
+    {
+        // Exponent notation, too many digits or garbage, strtod() sorts it out
+        return parseDoubleSlow(s, value);
+    }
+
+    // The mantissa is exact and so is the power of ten, one rounding step gives the correctly rounded result.
+    double v = (double)mantissa;
+    v = exponent < 0 ? v / powersOfTen[-exponent] : v * powersOfTen[exponent];
+    *value = negative ? -v : v;
+    return true;
+}
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file eviparse.h
+ * @brief Strict number decoding for response arguments.
+ *
+ * Unlike atoi()/atof() these functions reject empty strings, trailing
+ * characters and values which don't fit into the target type. They don't
+ * allocate and decode in a single pass over the string.
+ */
+
+/**
+ * @brief Decodes an unsigned decimal integer.
+ *
+ * @param s The string to decode.
+ * @param value Pointer to store the decoded value, unchanged on failure.
+ * @return True if s is a valid number within range.
+ */
+bool eviParseUInt32(const char *s, uint32_t *value);
+
+/**
+ * @brief Decodes a signed decimal integer.
+ *
+ * @param s The string to decode.
+ * @param value Pointer to store the decoded value, unchanged on failure.
+ * @return True if s is a valid number within range.
+ */
+bool eviParseInt32(const char *s, int32_t *value);
+
+/**
+ * @brief Decodes a floating point number.
+ *
+ * Plain decimal numbers with up to 15 significant digits are converted
+ * exactly without strtod(); everything else falls back to strtod().
+ *
+ * @param s The string to decode.
+ * @param value Pointer to store the decoded value, unchanged on failure.
+ * @return True if s is a valid, finite number.
+ */
+bool eviParseDouble(const char *s, double *value);
@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evisrec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Largest byte count of a record: address, data and checksum
+#define SREC_MAX_BYTES 255
+
+typedef struct
+{
+    unsigned type;
+    uint32_t address;
+    size_t addressLength;
+    uint8_t data[SREC_MAX_BYTES];
+    size_t length;
+} SrecRecord_t;
+
+typedef struct
+{
+    EviSrecImage_t *image;
+    char *out;
+    bool pending; // record holds data which is not written yet
+    bool coalesce;
+    size_t maxLength; // Longest joined record in characters
+    SrecRecord_t record;
+    size_t dataRecords;
+} SrecWriter_t;
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Bytes of the address field by record type, 0 for the types the module rejects
+static size_t srecAddressLength(unsigned type)
+{
+    switch (type)
+    {
+    case 0: case 1: case 5: case 9:
+        return 2;
+    case 2: case 8:
+        return 3;
+    case 3: case 7:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+// Most data bytes of a record of this type which still fit into maxLength characters
+static size_t srecMaxData(size_t addressLength, size_t maxLength)
+{
+    size_t bytes = maxLength > 4 ? (maxLength - 4) / 2 : 0;
+    if (bytes > SREC_MAX_BYTES)
+    {
+        bytes = SREC_MAX_BYTES;
+    }
+    return bytes > addressLength + 1 ? bytes - addressLength - 1 : 0;
+}
+
+static Error_t srecDecode(const char *line, size_t length, SrecRecord_t *record)
+{
+    uint8_t bytes[SREC_MAX_BYTES + 1];
+    size_t count;
+    unsigned sum = 0;
+
+    if (length < 4 || line[0] != 'S' || line[1] < '0' || line[1] > '9')
+    {
+        return ERROR_EVI_SREC_INVALID_STRING;
+    }
+    record->type = (unsigned)(line[1] - '0');
+    record->addressLength = srecAddressLength(record->type);
+    if (record->addressLength == 0)
+    {
+        return ERROR_EVI_SREC_UNSUPPORTED_TYPE;
+    }
+    if (length % 2 != 0 || length > EVI_SREC_MAX_RECORD_LENGTH)
+    {
+        return ERROR_EVI_SREC_INVALID_STRING;
+    }
+
+    count = (length - 2) / 2;
+    for (size_t i = 0; i < count; i++)
+    {
+        int high = hexValue(line[2 + 2 * i]);
+        int low = hexValue(line[3 + 2 * i]);
+        if (high < 0 || low < 0)
+        {
+            return ERROR_EVI_SREC_INVALID_STRING;
+        }
+        bytes[i] = (uint8_t)(high << 4 | low);
+        sum += bytes[i];
+    }
+    // The byte count covers address, data and checksum
+    if (bytes[0] != count - 1 || bytes[0] < record->addressLength + 1)
+    {
+        return ERROR_EVI_SREC_INVALID_STRING;
+    }
+    if ((sum & 0xff) != 0xff)
+    {
+        return ERROR_EVI_SREC_INVALID_CRC;
+    }
+
+    record->address = 0;
+    for (size_t i = 0; i < record->addressLength; i++)
+    {
+        record->address = record->address << 8 | bytes[1 + i];
+    }
+    record->length = bytes[0] - record->addressLength - 1;
+    memcpy(record->data, bytes + 1 + record->addressLength, record->length);
+    return ERROR_EVI_OK;
+}
+
+static void srecPutByte(char **out, uint8_t byte, unsigned *sum)
+{
+    *(*out)++ = hexDigits[byte >> 4];
+    *(*out)++ = hexDigits[byte & 0xf];
+    *sum += byte;
+}
+
+static void srecEncode(SrecWriter_t *w, const SrecRecord_t *record)
+{
+    EviSrecImage_t *image = w->image;
+    unsigned sum = 0;
+    char *out = w->out;
+
+    image->records[image->count++] = out;
+    *out++ = 'S';
+    *out++ = (char)('0' + record->type);
+    srecPutByte(&out, (uint8_t)(record->addressLength + record->length + 1), &sum);
+    for (size_t i = record->addressLength; i > 0; i--)
+    {
+        srecPutByte(&out, (uint8_t)(record->address >> (8 * (i - 1))), &sum);
+    }
+    for (size_t i = 0; i < record->length; i++)
+    {
+        srecPutByte(&out, record->data[i], &sum);
+    }
+    srecPutByte(&out, (uint8_t)~sum, &sum);
+    *out++ = '\0';
+    w->out = out;
+}
+
+static void srecFlush(SrecWriter_t *w)
+{
+    if (w->pending)
+    {
+        srecEncode(w, &w->record);
+        w->dataRecords++;
+        w->pending = false;
+    }
+}
+
+// Appends a data record to the pending one if it continues it, otherwise starts a new one
+static void srecAddData(SrecWriter_t *w, const SrecRecord_t *record)
+{
+    SrecRecord_t *p = &w->record;
+    if (w->coalesce && w->pending && p->type == record->type && p->address + p->length == record->address &&
+        p->length + record->length <= srecMaxData(p->addressLength, w->maxLength))
+    {
+        memcpy(p->data + p->length, record->data, record->length);
+        p->length += record->length;
+        return;
+    }
+    srecFlush(w);
+    *p = *record;
+    w->pending = true;
+}
+
+// The text of S0 is usually "name version", the version is its last word
+static void srecVersion(const SrecRecord_t *record, char *version, size_t size)
+{
+    char text[SREC_MAX_BYTES + 1];
+    size_t length = 0;
+    char *word;
+
+    while (length < record->length && record->data[length] >= ' ' && record->data[length] < 0x7f)
+    {
+        text[length] = (char)record->data[length];
+        length++;
+    }
+    while (length > 0 && text[length - 1] == ' ')
+    {
+        length--;
+    }
+    text[length] = '\0';
+    word = strrchr(text, ' ');
+    strcpy_s(version, size, word != NULL ? word + 1 : text);
+}
+
+Error_t eviSrecParse(const char *data, size_t size, bool coalesce, size_t coalesceLength, EviSrecImage_t *image, size_t *errorLine)
+{
+    SrecWriter_t w = {.image = image, .coalesce = coalesce};
+    size_t lines = 1;
+    size_t line = 1;
+    size_t longest = 0;
+    Error_t ret = ERROR_EVI_OK;
+
+    memset(image, 0, sizeof(EviSrecImage_t));
+    if (errorLine != NULL)
+    {
+        *errorLine = 0;
+    }
+    for (size_t i = 0, start = 0; i <= size; i++)
+    {
+        if (i == size || data[i] == '\n' || data[i] == '\r')
+        {
+            // Only data records are joined, so only they give the default length
+            if (i - start > longest && i - start >= 2 && data[start] == 'S' && data[start + 1] >= '1' && data[start + 1] <= '3')
+            {
+                longest = i - start;
+            }
+            lines += i < size;
+            start = i + 1;
+        }
+    }
+    w.maxLength = coalesceLength > 0 ? coalesceLength : longest;
+    if (w.maxLength > EVI_SREC_MAX_RECORD_LENGTH)
+    {
+        w.maxLength = EVI_SREC_MAX_RECORD_LENGTH;
+    }
+    // Coalesced and regenerated records never need more room than the records of the file
+    image->text = (char *)malloc(size + lines + 1);
+    image->records = (char **)calloc(lines, sizeof(char *));
+    if (image->text == NULL || image->records == NULL)
+    {
+        eviSrecFree(image);
+        return ERROR_EVI_FILE_IO_ERROR;
+    }
+    w.out = image->text;
+
+    for (size_t i = 0; i < size; line++)
+    {
+        SrecRecord_t record;
+        size_t length = 0;
+
+        while (i + length < size && data[i + length] != '\r' && data[i + length] != '\n')
+        {
+            length++;
+        }
+        if (length > 0)
+        {
+            ret = srecDecode(data + i, length, &record);
+            if (ret != ERROR_EVI_OK)
+            {
+                break;
+            }
+            image->sourceRecords++;
+            if (record.type >= 1 && record.type <= 3)
+            {
+                image->dataBytes += record.length;
+                srecAddData(&w, &record);
+            }
+            else
+            {
+                srecFlush(&w);
+                if (record.type == 0 && image->version[0] == '\0')
+                {
+                    srecVersion(&record, image->version, sizeof(image->version));
+                }
+                // The count of S5 has to match the records sent, a count beyond 16 bits is left out
+                if (record.type == 5)
+                {
+                    record.address = (uint32_t)w.dataRecords;
+                }
+                if (record.type != 5 || w.dataRecords <= 0xffff)
+                {
+                    srecEncode(&w, &record);
+                }
+            }
+        }
+        i += length;
+        if (i < size && data[i] == '\r')
+        {
+            i++;
+        }
+        if (i < size && data[i] == '\n')
+        {
+            i++;
+        }
+    }
+
+    if (ret == ERROR_EVI_OK)
+    {
+        srecFlush(&w);
+    }
+    else
+    {
+        if (errorLine != NULL)
+        {
+            *errorLine = line;
+        }
+        eviSrecFree(image);
+    }
+    return ret;
+}
+
+Error_t eviSrecLoad(const char *file, bool coalesce, size_t coalesceLength, EviSrecImage_t *image, size_t *errorLine)
+{
+    FILE *f = fopen(file, "rb");
+    char *data = NULL;
+    long length;
+    Error_t ret;
+
+    memset(image, 0, sizeof(EviSrecImage_t));
+    if (errorLine != NULL)
+    {
+        *errorLine = 0;
+    }
+    if (f == NULL)
+    {
+        return ERROR_EVI_FILE_NOT_FOUND;
+    }
+    // The whole file is read with one read
+    if (fseek(f, 0, SEEK_END) != 0 || (length = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0 ||
+        (data = (char *)malloc((size_t)length + 1)) == NULL || fread(data, 1, (size_t)length, f) != (size_t)length)
+    {
+        free(data);
+        fclose(f);
+        return ERROR_EVI_FILE_IO_ERROR;
+    }
+    fclose(f);
+
+    ret = eviSrecParse(data, (size_t)length, coalesce, coalesceLength, image, errorLine);
+    free(data);
+    return ret;
+}
+
+void eviSrecFree(EviSrecImage_t *image)
+{
+    free(image->records);
+    free(image->text);
+    memset(image, 0, sizeof(EviSrecImage_t));
+}
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @file evisrec.h
+ * @brief Host-side validation and preparation of firmware images (Motorola S-records).
+ *
+ * The image is checked like the module checks it, so a broken file is
+ * rejected before the flash is erased.
+ */
+
+/**
+ * @brief Longest record which still fits into one "S <record>" command line with checksum framing.
+ */
+#define EVI_SREC_MAX_RECORD_LENGTH (EVI_MAX_LINE_LENGTH - 12)
+
+/**
+ * @struct EviSrecImage_t
+ * @brief A validated firmware image.
+ */
+typedef struct
+{
+    char *text; /**< Storage of all records, each terminated by '\0'. */
+    char **records; /**< The records to send, e.g. "S1130000...". */
+    size_t count; /**< Number of records. */
+    size_t sourceRecords; /**< Number of records in the file. */
+    size_t dataBytes; /**< Number of bytes of all data records. */
+    char version[EVI_MAX_VALUE_LENGTH]; /**< Version in the S0 header, e.g. "2.0.0", empty if there is none. */
+} EviSrecImage_t;
+
+/**
+ * @brief Validates an image and prepares its records.
+ *
+ * Checks the record types (S4 and S6 are not supported by the module), the
+ * hex digits, the byte count and the checksum of every record. With coalesce
+ * adjacent data records of the same type and contiguous addresses are joined
+ * into records of up to coalesceLength characters; an S5 record count is
+ * recomputed.
+ *
+ * @param data The content of the SREC file.
+ * @param size Number of bytes of data.
+ * @param coalesce Joins adjacent data records.
+ * @param coalesceLength Longest joined record in characters, 0 for the longest data record of the file; at most EVI_SREC_MAX_RECORD_LENGTH.
+ * @param image The prepared image, free it with eviSrecFree().
+ * @param errorLine Pointer to store the line of the first invalid record, may be NULL.
+ * @return ERROR_EVI_OK, ERROR_EVI_SREC_UNSUPPORTED_TYPE, ERROR_EVI_SREC_INVALID_CRC or ERROR_EVI_SREC_INVALID_STRING.
+ */
+DLLEXPORT Error_t eviSrecParse(const char *data, size_t size, bool coalesce, size_t coalesceLength, EviSrecImage_t *image, size_t *errorLine);
+
+/**
+ * @brief Reads a file and validates it with eviSrecParse().
+ *
+ * @param file Path to the SREC file.
+ * @param coalesce Joins adjacent data records.
+ * @param coalesceLength Longest joined record in characters, see eviSrecParse().
+ * @param image The prepared image, free it with eviSrecFree().
+ * @param errorLine Pointer to store the line of the first invalid record, may be NULL.
+ * @return ERROR_EVI_OK, ERROR_EVI_FILE_NOT_FOUND, ERROR_EVI_FILE_IO_ERROR or an error of eviSrecParse().
+ */
+DLLEXPORT Error_t eviSrecLoad(const char *file, bool coalesce, size_t coalesceLength, EviSrecImage_t *image, size_t *errorLine);
+
+/**
+ * @brief Releases a prepared image.
+ *
+ * @param image The image.
+ */
+DLLEXPORT void eviSrecFree(EviSrecImage_t *image);
+
+/**
+ * @brief Performs a firmware update with an image already validated, see eviFwUpdateEx().
+ *
+ * The image is only read, so several sessions may flash the same image
+ * concurrently, see eviFwUpdateAll().
+ *
+ * @param self Pointer to the Evi_t structure.
+ * @param image The image, see eviSrecLoad().
+ * @param options Options of the update, NULL flashes unconditionally; coalesce is not used.
+ * @return An error code indicating the result of the update process.
+ */
+DLLEXPORT Error_t eviFwUpdateImage(Evi_t *self, const EviSrecImage_t *image, const EviFwOptions_t *options);
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evithread.h"
+
+#if defined(_WIN64) || defined(_WIN32)
+
+bool eviThreadCreate(EviThread_t *thread, EviThreadRun_t run, void *arg)
+{
+    *thread = CreateThread(NULL, 0, run, arg, 0, NULL);
+    return *thread != NULL;
+}
+
+void eviThreadJoin(EviThread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+bool eviSemaphoreInit(EviSemaphore_t *semaphore)
+{
+    *semaphore = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+    return *semaphore != NULL;
+}
+
+void eviSemaphoreDestroy(EviSemaphore_t *semaphore)
+{
+    CloseHandle(*semaphore);
+}
+
+void eviSemaphorePost(EviSemaphore_t *semaphore)
+{
+    ReleaseSemaphore(*semaphore, 1, NULL);
+}
+
+bool eviSemaphoreWait(EviSemaphore_t *semaphore, uint32_t timeoutMs)
+{
+    return WaitForSingleObject(*semaphore, timeoutMs == UINT32_MAX ? INFINITE : timeoutMs) == WAIT_OBJECT_0;
+}
+
+size_t eviAtomicLoad(const volatile size_t *value)
+{
+    size_t v = *value;
+    MemoryBarrier();
+    return v;
+}
+
+void eviAtomicStore(volatile size_t *value, size_t newValue)
+{
+    MemoryBarrier();
+    *value = newValue;
+}
+
+#else
+
+#include <errno.h>
+#include <time.h>
+
+bool eviThreadCreate(EviThread_t *thread, EviThreadRun_t run, void *arg)
+{
+    return pthread_create(thread, NULL, run, arg) == 0;
+}
+
+void eviThreadJoin(EviThread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+
+bool eviSemaphoreInit(EviSemaphore_t *semaphore)
+{
+    return sem_init(semaphore, 0, 0) == 0;
+}
+
+void eviSemaphoreDestroy(EviSemaphore_t *semaphore)
+{
+    sem_destroy(semaphore);
+}
+
+void eviSemaphorePost(EviSemaphore_t *semaphore)
+{
+    sem_post(semaphore);
+}
+
+bool eviSemaphoreWait(EviSemaphore_t *semaphore, uint32_t timeoutMs)
+{
+    int ret;
+
+    if (timeoutMs == UINT32_MAX)
+    {
+        while ((ret = sem_wait(semaphore)) == -1 && errno == EINTR)
+        {
+        }
+        return ret == 0;
+    }
+
+    // sem_timedwait() only knows absolute CLOCK_REALTIME deadlines
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while ((ret = sem_timedwait(semaphore, &deadline)) == -1 && errno == EINTR)
+    {
+    }
+    return ret == 0;
+}
+
+size_t eviAtomicLoad(const volatile size_t *value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+void eviAtomicStore(volatile size_t *value, size_t newValue)
+{
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+}
+
+#endif
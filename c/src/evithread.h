@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file evithread.h
+ * @brief Minimal threading layer over pthreads and the Windows API.
+ */
+
+#if defined(_WIN64) || defined(_WIN32)
+#include <windows.h>
+
+typedef HANDLE EviThread_t;
+typedef HANDLE EviSemaphore_t;
+typedef DWORD (WINAPI *EviThreadRun_t)(void *arg);
+#define EVI_THREAD_RESULT DWORD WINAPI
+#define EVI_THREAD_RETURN return 0
+
+#else
+#include <pthread.h>
+#include <semaphore.h>
+
+typedef pthread_t EviThread_t;
+typedef sem_t EviSemaphore_t;
+typedef void *(*EviThreadRun_t)(void *arg);
+#define EVI_THREAD_RESULT void *
+#define EVI_THREAD_RETURN return NULL
+
+#endif
+
+/**
+ * @brief Starts a thread.
+ *
+ * Thread functions are declared as EVI_THREAD_RESULT run(void *arg) and end with EVI_THREAD_RETURN.
+ *
+ * @param thread Pointer to store the thread.
+ * @param run Function executed by the thread.
+ * @param arg Argument passed to run.
+ * @return True if the thread was started.
+ */
+bool eviThreadCreate(EviThread_t *thread, EviThreadRun_t run, void *arg);
+
+/**
+ * @brief Waits until a thread has ended and releases it.
+ *
+ * @param thread The thread.
+ */
+void eviThreadJoin(EviThread_t thread);
+
+/**
+ * @brief Initializes a counting semaphore with the value 0.
+ *
+ * @param semaphore Pointer to the semaphore.
+ * @return True on success.
+ */
+bool eviSemaphoreInit(EviSemaphore_t *semaphore);
+
+/**
+ * @brief Releases a semaphore.
+ *
+ * @param semaphore Pointer to the semaphore.
+ */
+void eviSemaphoreDestroy(EviSemaphore_t *semaphore);
+
+/**
+ * @brief Increments a semaphore and wakes one waiting thread.
+ *
+ * @param semaphore Pointer to the semaphore.
+ */
+void eviSemaphorePost(EviSemaphore_t *semaphore);
+
+/**
+ * @brief Waits until a semaphore can be decremented.
+ *
+ * @param semaphore Pointer to the semaphore.
+ * @param timeoutMs Maximal time to wait in milliseconds, UINT32_MAX waits forever.
+ * @return True if the semaphore was decremented, false on timeout.
+ */
+bool eviSemaphoreWait(EviSemaphore_t *semaphore, uint32_t timeoutMs);
+
+/**
+ * @brief Reads a value written by another thread with eviAtomicStore().
+ *
+ * Acquire semantics: everything written before the matching store is visible afterwards.
+ *
+ * @param value Pointer to the shared value.
+ * @return The value.
+ */
+size_t eviAtomicLoad(const volatile size_t *value);
+
+/**
+ * @brief Writes a value read by another thread with eviAtomicLoad().
+ *
+ * Release semantics: everything written before is visible to the reading thread.
+ *
+ * @param value Pointer to the shared value.
+ * @param newValue The value to write.
+ */
+void eviAtomicStore(volatile size_t *value, size_t newValue);
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "evitransport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    EviMemoryDevice_t *device;
+    char pending[EVI_MEMORY_BUFFER_SIZE];
+    size_t length;
+    size_t position;
+} MemoryConnection;
+
+static void *eviMemoryOpen(const char *port, void *user, bool verbose)
+{
+    EviMemoryDevice_t *device = (EviMemoryDevice_t *)user;
+    MemoryConnection *connection;
+
+    if (device == NULL || device->respond == NULL)
+    {
+        fprintf(stderr, "Memory transport without device\n");
+        return NULL;
+    }
+    connection = (MemoryConnection *)calloc(1, sizeof(MemoryConnection));
+    if (connection)
+    {
+        connection->device = device;
+    }
+    return connection;
+}
+
+static void eviMemoryClose(void *connection)
+{
+    free(connection);
+}
+
+static bool eviMemoryWrite(void *connection, const char *data, size_t size)
+{
+    MemoryConnection *c = (MemoryConnection *)connection;
+
+    if (c->position == c->length)
+    {
+        c->position = 0;
+        c->length = 0;
+    }
+    c->length += c->device->respond(data, size, c->pending + c->length, sizeof(c->pending) - c->length, c->device->user);
+    return true;
+}
+
+static int eviMemoryPoll(void *connection, uint32_t timeoutMs)
+{
+    MemoryConnection *c = (MemoryConnection *)connection;
+
+    // Nobody else can produce a reply, waiting would not help
+    return c->position < c->length ? 1 : 0;
+}
+
+static int eviMemoryRead(void *connection, char *data, size_t size)
+{
+    MemoryConnection *c = (MemoryConnection *)connection;
+    size_t n = c->length - c->position;
+
+    if (n > size)
+    {
+        n = size;
+    }
+    memcpy(data, c->pending + c->position, n);
+    c->position += n;
+    return (int)n;
+}
+
+const EviTransport_t eviTransportMemory = {
+    .name   = "memory",
+    .open   = eviMemoryOpen,
+    .close  = eviMemoryClose,
+    .write  = eviMemoryWrite,
+    .poll   = eviMemoryPoll,
+    .read   = eviMemoryRead,
+};
+
+size_t eviMemoryScriptRespond(const char *request, size_t length, char *reply, size_t replySize, void *user)
+{
+    EviMemoryScript_t *script = (EviMemoryScript_t *)user;
+    size_t n;
+
+    if (script->count == 0)
+    {
+        return 0;
+    }
+    n = strlen(script->replies[script->next]);
+    if (n > replySize)
+    {
+        n = replySize;
+    }
+    memcpy(reply, script->replies[script->next], n);
+    script->next = (script->next + 1) % script->count;
+    return n;
+}
+
+static const EviTransport_t *const transports[] = {
+    &eviTransportTty,
+    &eviTransportTcp,
+    &eviTransportUsb,
+    &eviTransportMemory,
+};
+
+const EviTransport_t *eviTransportByName(const char *name)
+{
+    for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+    {
+        if (strcmp(transports[i]->name, name) == 0)
+        {
+            return transports[i];
+        }
+    }
+    return NULL;
+}
+
+const EviTransport_t *eviTransportForPort(const char *portName, const char **port)
+{
+    *port = portName;
+    if (portName == NULL)
+    {
+        return &eviTransportTty;
+    }
+
+    // Name of the port of the simulator in the first versions of the library
+    if (strcmp(portName, "SIMULATION") == 0)
+    {
+        *port = EVI_TCP_DEFAULT_PORT;
+        return &eviTransportTcp;
+    }
+
+    for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+    {
+        size_t n = strlen(transports[i]->name);
+        if (strncmp(portName, transports[i]->name, n) == 0 && portName[n] == ':')
+        {
+            *port = portName + n + 1;
+            return transports[i];
+        }
+    }
+    return &eviTransportTty;
+}
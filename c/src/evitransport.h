@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "evibase.h"
+
+/**
+ * @file evitransport.h
+ * @brief Built-in transports, see EviTransport_t.
+ */
+
+#define EVI_MEMORY_BUFFER_SIZE 1024
+#define EVI_TCP_DEFAULT_PORT "127.0.0.1:5000"
+
+/**
+ * @brief Serial port of the operating system, e.g. /dev/ttyACM0 or COM3. Found by eviEnumerateDevices().
+ */
+DLLEXPORT extern const EviTransport_t eviTransportTty;
+
+/**
+ * @brief TCP connection to "host:port", e.g. to the simulator. An empty port is EVI_TCP_DEFAULT_PORT.
+ */
+DLLEXPORT extern const EviTransport_t eviTransportTcp;
+
+/**
+ * @brief CDC bulk endpoints through libusb, the port is the USB serial number or empty for any module.
+ *
+ * Only works if the library is built with EVI_WITH_LIBUSB.
+ */
+DLLEXPORT extern const EviTransport_t eviTransportUsb;
+
+/**
+ * @brief Replies generated in the calling thread, without any system call.
+ *
+ * Evi_t.transportUser must point to an EviMemoryDevice_t. Intended for tests
+ * and for profiling the protocol layer without any I/O.
+ */
+DLLEXPORT extern const EviTransport_t eviTransportMemory;
+
+/**
+ * @brief Generates the reply of the in-memory device to one request.
+ *
+ * @param request The bytes written by the session, usually one framed command.
+ * @param length Number of bytes of the request.
+ * @param reply Buffer for the reply, it must be framed like the reply of a module.
+ * @param replySize Size of the reply buffer.
+ * @param user User-defined data of the EviMemoryDevice_t.
+ * @return Number of bytes of the reply, 0 to not answer.
+ */
+typedef size_t (*EviMemoryResponder_t)(const char *request, size_t length, char *reply, size_t replySize, void *user);
+
+/**
+ * @struct EviMemoryDevice_t
+ * @brief The device behind eviTransportMemory.
+ */
+typedef struct
+{
+    EviMemoryResponder_t respond; /**< Generates the replies. */
+    void *user; /**< User-defined data passed to respond. */
+} EviMemoryDevice_t;
+
+/**
+ * @struct EviMemoryScript_t
+ * @brief Fixed replies for eviMemoryScriptRespond().
+ */
+typedef struct
+{
+    const char *const *replies; /**< Framed replies, e.g. ":V 1.2.3\n". */
+    size_t count; /**< Number of replies. */
+    size_t next; /**< Index of the next reply, wraps around after the last one. */
+} EviMemoryScript_t;
+
+/**
+ * @brief Responder which answers every request with the next reply of an EviMemoryScript_t.
+ *
+ * Use it as EviMemoryDevice_t.respond with a pointer to the script as user.
+ */
+DLLEXPORT size_t eviMemoryScriptRespond(const char *request, size_t length, char *reply, size_t replySize, void *user);
+
+/**
+ * @brief Looks up a built-in transport.
+ *
+ * @param name Name of the transport: "tty", "tcp", "usb" or "memory".
+ * @return The transport or NULL if the name is unknown.
+ */
+DLLEXPORT const EviTransport_t *eviTransportByName(const char *name);
+
+/**
+ * @brief Selects the transport of a port name, see eviOpen().
+ *
+ * @param portName Port name, may have a prefix "name:". May be NULL.
+ * @param port Pointer to store the address for the transport, portName without the prefix.
+ * @return The transport, eviTransportTty if there is no known prefix.
+ */
+DLLEXPORT const EviTransport_t *eviTransportForPort(const char *portName, const char **port);
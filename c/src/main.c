@@ -9,13 +9,18 @@
 #include "cmdselftest.h"
 #include "cmdcommand.h"
 #include "cmdfwupdate.h"
+#include "cmdstats.h"
 #include "cmdrun.h"
 #include "cmddata.h"
 #include "cmdsave.h"
 #include "cmdexport.h"
 #include "cmdempty.h"
+#include "cmddevices.h"
+#include "evifluor.h"
+#include "evitransport.h"
 #include "printerror.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define VERSION_TOOL "0.6.0"
@@ -29,22 +34,30 @@ void help(int argcCmd, char **argvCmd)
             fprintf_s(stdout, "  baseline            : starts a new series of measurements\n");
             fprintf_s(stdout, "  command COMMAND     : executes a device command; e.g. \"evifluor.exe command \\\"V 0\\\"\" returns the value at index 0\n");
             fprintf_s(stdout, "  data                : handles data in a data file\n");
+            fprintf_s(stdout, "  devices             : lists the serial number and port of all attached modules\n");
             fprintf_s(stdout, "  empty               : checks if the cuvette guide is empty\n");
             fprintf_s(stdout, "  export              : exports JSON data files as CSV files\n");
-            fprintf_s(stdout, "  fwupdate FILE       : loads a new firmware\n");
-            fprintf_s(stdout, "  get INDEX           : gets a value from the device\n");
+            fprintf_s(stdout, "  fwupdate FILE       : loads a new firmware if the module runs another version\n");
+            fprintf_s(stdout, "  get INDEX...        : gets values from the device\n");
             fprintf_s(stdout, "  help [COMMAND]      : prints detailed help\n");
             fprintf_s(stdout, "  measure             : starts a measurement and returns the values\n");
             fprintf_s(stdout, "  run                 : performs a guided workflow\n");
             fprintf_s(stdout, "  save                : saves the last measurement(s)\n");
             fprintf_s(stdout, "  selftest            : executes an internal self-test\n");
-            fprintf_s(stdout, "  set INDEX VALUE     : sets a value in the device\n");
+            fprintf_s(stdout, "  set INDEX VALUE...  : sets values in the device\n");
+            fprintf_s(stdout, "  stats [COUNT]       : probes the link and prints its counters and latencies\n");
             fprintf_s(stdout, "  version             : returns the version\n");
             fprintf_s(stdout, "Options:\n");
             fprintf_s(stdout, "  --verbose           : prints debug info\n");
             fprintf_s(stdout, "  --help, -h          : show this help and exit\n");
             fprintf_s(stdout, "  --device DEVICE     : use the given device; if omitted, the CLI searches for a device\n");
+            fprintf_s(stdout, "  --serial SERIAL     : use the module with the given USB serial number\n");
+            fprintf_s(stdout, "  --all               : executes measure, selftest, get or fwupdate on all attached modules concurrently\n");
+            fprintf_s(stdout, "  --transport NAME    : tty (default), usb (libusb), tcp (e.g. the simulator); a device 'NAME:ADDRESS' selects it too\n");
             fprintf_s(stdout, "  --use-checksum      : use the protocol with a checksum\n");
+            fprintf_s(stdout, "  --pipeline-window N : maximal number of commands in flight (default %d, 1 = wait for each response)\n", EVI_PIPELINE_WINDOW_DEFAULT);
+            fprintf_s(stdout, "  --stats             : prints the link counters of the command on stderr\n");
+            fprintf_s(stdout, "  --cache-constants   : keeps serial number, version and LED limits in a file for the next runs\n");
             fprintf_s(stdout, "\n");
             fprintf_s(stdout, "The command-line tool returns the following exit codes:\n");
             fprintf_s(stdout, "    0: No error.\n");
@@ -64,6 +77,9 @@ void help(int argcCmd, char **argvCmd)
             fprintf_s(stdout, "   55: Invalid number\n");
             fprintf_s(stdout, "   56: File not found\n");
             fprintf_s(stdout, "   57: Cuvette guide not empty\n");
+            fprintf_s(stdout, "   58: Queue full\n");
+            fprintf_s(stdout, "   59: Could not start thread\n");
+            fprintf_s(stdout, "   60: Out of memory\n");
             fprintf_s(stdout, "  100: Communication error\n");
 	}
 	else
@@ -72,8 +88,8 @@ void help(int argcCmd, char **argvCmd)
 		{
 			if(strcmp(argvCmd[1], "get") == 0)
 			{
-                fprintf_s(stdout, "Usage: evifluor get INDEX\n");
-                fprintf_s(stdout, "  Get a value from the device\n");
+                fprintf_s(stdout, "Usage: evifluor get INDEX [INDEX...]\n");
+                fprintf_s(stdout, "  Get values from the device, one line per index\n");
                 fprintf_s(stdout, "INDEX:\n");
                 fprintf_s(stdout, "   0: Firmware version\n");
                 fprintf_s(stdout, "   1: Serial number\n");
@@ -85,8 +101,8 @@ void help(int argcCmd, char **argvCmd)
 			}
 			else if(strcmp(argvCmd[1], "set") == 0)
 			{
-                fprintf_s(stdout, "Usage: evifluor set INDEX VALUE\n");
-                fprintf_s(stdout, "  Set a value on the device\n");
+                fprintf_s(stdout, "Usage: evifluor set INDEX VALUE [INDEX VALUE...]\n");
+                fprintf_s(stdout, "  Set values on the device\n");
                 fprintf_s(stdout, "WARNING:\n");
                 fprintf_s(stdout, "  Changing a value can damage the device or lead to incorrect results!\n");
                 fprintf_s(stdout, "INDEX:\n");
@@ -135,10 +151,22 @@ void help(int argcCmd, char **argvCmd)
                 fprintf_s(stdout, "Output (measure)    : dark sample ledPower\n");
                 fprintf_s(stdout, "Output (first-air)  : min-dark min-sample min-ledPower max-dark max-sample max-ledPower\n");
                 fprintf_s(stdout, "Output (first-sample) : dark sample ledPower autogain-found autogain-ledPower\n");
+                fprintf_s(stdout, "Output (replicates) : count, ledPower and mean sd cv of dark, value and delta, one per line\n");
+                fprintf_s(stdout, "Output (continuous) : time count dark value ledPower delta-min delta-mean delta-max, one line per bucket\n");
                 fprintf_s(stdout, "Options:\n");
                 fprintf_s(stdout, "  --measure             : perform the default measurement (default)\n");
                 fprintf_s(stdout, "  --first-air           : perform a first-air measurement\n");
                 fprintf_s(stdout, "  --first-sample        : perform a first-sample measurement (autogain)\n");
+                fprintf_s(stdout, "  --replicates N        : measure N times back-to-back and print the statistics\n");
+                fprintf_s(stdout, "  --cv PERCENT          : with --replicates, stop as soon as the CV of delta is at most PERCENT\n");
+                fprintf_s(stdout, "  --continuous          : measure repeatedly until --count, --duration or Ctrl+C\n");
+                fprintf_s(stdout, "  --interval MS         : with --continuous, target interval between readings (default 0, as fast as possible)\n");
+                fprintf_s(stdout, "  --count N             : with --continuous, stop after N readings\n");
+                fprintf_s(stdout, "  --duration S          : with --continuous, stop after S seconds\n");
+                fprintf_s(stdout, "  --bucket MS           : with --continuous, reduce the readings to one line per MS milliseconds\n");
+                fprintf_s(stdout, "  --led-power P         : with --continuous, set the LED power before the first reading\n");
+                fprintf_s(stdout, "  --save FILE           : with --replicates or --continuous, append the result to the JSON file FILE\n");
+                fprintf_s(stdout, "  --comment COMMENT     : with --save, the comment of the entry\n");
 			}
             else if(strcmp(argvCmd[1], "run") == 0)
             {
@@ -172,15 +200,40 @@ void help(int argcCmd, char **argvCmd)
 			}
 			else if(strcmp(argvCmd[1], "fwupdate") == 0)
             {
-                fprintf_s(stdout, "Usage: evifluor fwupdate SREC_FILE\n");
+                fprintf_s(stdout, "Usage: evifluor fwupdate [OPTIONS] SREC_FILE\n");
                 fprintf_s(stdout, "  Updates the firmware from the specified SREC file.\n");
+                fprintf_s(stdout, "  The file is validated before the flash is erased. If the version in its S0\n");
+                fprintf_s(stdout, "  header equals the version of the module, nothing is flashed.\n");
+                fprintf_s(stdout, "Options:\n");
+                fprintf_s(stdout, "  --force             : flashes even if the module already runs this version\n");
+                fprintf_s(stdout, "  --coalesce          : joins adjacent data records up to the longest data record of the file\n");
+                fprintf_s(stdout, "  --coalesce-length N : joins adjacent data records up to N characters (at most 243)\n");
+                fprintf_s(stdout, "  --jobs N            : with --all, updates at most N modules at the same time (default all)\n");
+                fprintf_s(stdout, "With --all every attached module is updated by its own worker; a line per\n");
+                fprintf_s(stdout, "module with its serial number, 'updated', 'mismatch', 'skipped' or 'failed' and\n");
+                fprintf_s(stdout, "the version the module reports afterwards is printed.\n");
 			}
+            else if(strcmp(argvCmd[1], "stats") == 0)
+            {
+                fprintf_s(stdout, "Usage: evifluor stats [COUNT]\n");
+                fprintf_s(stdout, "  Reads the firmware version COUNT times (default 100), each read waits for its\n");
+                fprintf_s(stdout, "  answer, and prints the counters of the link: commands, responses, bytes,\n");
+                fprintf_s(stdout, "  round trips, CRC errors, write errors, timeouts, disconnects, retries, error\n");
+                fprintf_s(stdout, "  answers of the module and a histogram of the latencies.\n");
+                fprintf_s(stdout, "  The option --stats prints the same counters after any other command.\n");
+            }
             else if(strcmp(argvCmd[1], "empty") == 0)
             {
                 fprintf_s(stdout, "Usage: evifluor empty\n");
                 fprintf_s(stdout, "  Checks if the cuvette guide is empty.\n");
                 fprintf_s(stdout, "  Returns 'Empty' if the cuvette guide is empty; otherwise, returns 'Not empty'.\n");
             }
+            else if(strcmp(argvCmd[1], "devices") == 0)
+            {
+                fprintf_s(stdout, "Usage: evifluor devices\n");
+                fprintf_s(stdout, "  Lists all attached modules, one line per module: USB serial number and port separated by a tab.\n");
+                fprintf_s(stdout, "  Use --serial SERIAL to address one of them, or --all to execute measure, selftest, get or fwupdate on all of them.\n");
+            }
             else if(strcmp(argvCmd[1], "command") == 0)
 			{
                 fprintf_s(stdout, "Usage: evifluor command COMMAND\n");
@@ -207,6 +260,9 @@ int main(int argc, char *argv[])
 	bool options = true;
 	int i = 1;
     Evi_t evifluor = {0};
+    bool allModules = false;
+    bool printStats = false;
+    bool cacheConstants = false;
 
 	while (i < argc && options)
 	{
@@ -229,6 +285,42 @@ int main(int argc, char *argv[])
 			{
 				i++;
                 evifluor.portName = argv[i];
+			}
+			else if ((strcmp(argv[i], "--serial") == 0) && (i + 1 < argc))
+			{
+				i++;
+                evifluor.serialNumber = argv[i];
+			}
+			else if (strcmp(argv[i], "--all") == 0)
+			{
+                allModules = true;
+			}
+			else if (strcmp(argv[i], "--stats") == 0)
+			{
+                printStats = true;
+			}
+			else if (strcmp(argv[i], "--cache-constants") == 0)
+			{
+                cacheConstants = true;
+			}
+			else if ((strcmp(argv[i], "--transport") == 0) && (i + 1 < argc))
+			{
+				i++;
+                evifluor.transport = eviTransportByName(argv[i]);
+                if (evifluor.transport == NULL)
+                {
+                    return printError(ERROR_EVI_INVALID_PARAMETER, "'%s' is not a valid transport.\n", argv[i]);
+                }
+			}
+			else if ((strcmp(argv[i], "--pipeline-window") == 0) && (i + 1 < argc))
+			{
+				char *endptr;
+				i++;
+                evifluor.pipelineWindow = strtoul(argv[i], &endptr, 10);
+                if (*endptr != '\0' || evifluor.pipelineWindow == 0)
+                {
+                    return printError(ERROR_EVI_INVALID_NUMBER, "'%s' is not a valid window.\n", argv[i]);
+                }
 			}
 			else
 			{
@@ -245,19 +337,26 @@ int main(int argc, char *argv[])
 	argcCmd = argc - i;
 	argvCmd = argv + i;
 
+	// Serial number, version and LED limits are read once per session, on request kept across runs
+	eviFluorCacheConstants(&evifluor, cacheConstants);
+
 	if (argcCmd > 0)
 	{
-		if (strcmp(argvCmd[0], "get") == 0 && argcCmd == 2)
+		if (allModules)
+		{
+            ret = cmdAll(&evifluor, argcCmd, argvCmd);
+		}
+		else if (strcmp(argvCmd[0], "get") == 0 && argcCmd >= 2)
 		{
-            return cmdGet(&evifluor, argvCmd[1]);
+            ret = cmdGet(&evifluor, argcCmd - 1, argvCmd + 1);
 		}
-		else if (strcmp(argvCmd[0], "set") == 0 && argcCmd == 3)
+		else if (strcmp(argvCmd[0], "set") == 0 && argcCmd >= 3 && (argcCmd % 2) == 1)
 		{
-            return cmdSet(&evifluor, argvCmd[1], argvCmd[2]);
+            ret = cmdSet(&evifluor, (argcCmd - 1) / 2, argvCmd + 1);
 		}
         else if (strcmp(argvCmd[0], "measure") == 0 && argcCmd >= 1)
 		{
-            return cmdMeasure(&evifluor, argcCmd, argvCmd);
+            ret = cmdMeasure(&evifluor, argcCmd, argvCmd);
 		}
 		else if (strcmp(argvCmd[0], "version") == 0)
 		{
@@ -265,39 +364,47 @@ int main(int argc, char *argv[])
 		}
 		else if (strcmp(argvCmd[0], "selftest") == 0 && argcCmd == 1)
 		{
-            return cmdSelftest(&evifluor);
+            ret = cmdSelftest(&evifluor);
 		}
-		else if (strcmp(argvCmd[0], "fwupdate") == 0 && argcCmd == 2)
+		else if (strcmp(argvCmd[0], "fwupdate") == 0)
 		{
-            return cmdFwUpdate(&evifluor, argvCmd[1]);
+            ret = cmdFwUpdate(&evifluor, argcCmd, argvCmd);
 		}
 		else if (strcmp(argvCmd[0], "command") == 0 && argcCmd == 2)
 		{
-            return cmdCommand(&evifluor, argvCmd[1]);
+            ret = cmdCommand(&evifluor, argvCmd[1]);
 		}
         else if (strcmp(argvCmd[0], "data") == 0)
         {
-            return cmdData(&evifluor, argcCmd, argvCmd);
+            ret = cmdData(&evifluor, argcCmd, argvCmd);
         }
         else if (strcmp(argvCmd[0], "save") == 0)
 		{
-            return cmdSave(&evifluor, argcCmd, argvCmd);
+            ret = cmdSave(&evifluor, argcCmd, argvCmd);
 		}
         else if (strcmp(argvCmd[0], "export") == 0)
         {
-            return cmdExport(&evifluor, argcCmd, argvCmd);
+            ret = cmdExport(&evifluor, argcCmd, argvCmd);
         }
 		else if (strcmp(argvCmd[0], "baseline") == 0)
 		{
-            return cmdBaseline(&evifluor);
+            ret = cmdBaseline(&evifluor);
 		}
         else if (strcmp(argvCmd[0], "empty") == 0)
         {
-            return cmdEmpty(&evifluor);
+            ret = cmdEmpty(&evifluor);
+        }
+        else if (strcmp(argvCmd[0], "devices") == 0 && argcCmd == 1)
+        {
+            ret = cmdDevices(&evifluor);
         }
         else if (strcmp(argvCmd[0], "run") == 0)
         {
-            return cmdRun(&evifluor, argcCmd, argvCmd);
+            ret = cmdRun(&evifluor, argcCmd, argvCmd);
+        }
+        else if (strcmp(argvCmd[0], "stats") == 0)
+        {
+            ret = cmdStats(&evifluor, argcCmd, argvCmd);
         }
         else if (strcmp(argvCmd[0], "help") == 0)
 		{
@@ -314,5 +421,14 @@ int main(int argc, char *argv[])
 		help(0, NULL);
 	}
 
+	eviClose(&evifluor);
+
+	if (printStats)
+	{
+		EviStats_t stats;
+		eviGetStats(&evifluor, &stats);
+		cmdPrintStats(stderr, &stats);
+	}
+
 	return ret;
 }
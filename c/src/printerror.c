@@ -3,16 +3,21 @@
 
 #include "printerror.h"
 #include <stdio.h>
+#include <string.h>
 
 Error_t printError(Error_t error, char * format, ...)
 {
     if(format)
     {
       va_list args;
+      char message[1024];
       fprintf_s(stderr, "Error (%i): \n", error);
       va_start(args, format);
-      vfprintf(stderr, format, args);
+      vsnprintf(message, sizeof(message), format, args);
       va_end(args);
+      // Messages with and without a trailing newline end the same way
+      size_t length = strlen(message);
+      fprintf_s(stderr, "%s%s", message, length == 0 || message[length - 1] != '\n' ? "\n" : "");
     }
     else
     {
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#include "replicates.h"
+#include "evibase.h"
+#include "dict.h"
+#include <math.h>
+
+void runningStatistic_add(RunningStatistic_t * self, double x)
+{
+    // Welford's update, stable also for many readings with a large offset
+    double d = x - self->mean;
+    self->count++;
+    self->mean += d / self->count;
+    self->m2 += d * (x - self->mean);
+}
+
+double runningStatistic_sd(const RunningStatistic_t * self)
+{
+    return self->count > 1 ? sqrt(self->m2 / (self->count - 1)) : 0;
+}
+
+double runningStatistic_cv(const RunningStatistic_t * self)
+{
+    double sd = runningStatistic_sd(self);
+    if (self->mean == 0)
+    {
+        return sd == 0 ? 0 : HUGE_VAL;
+    }
+    return sd / fabs(self->mean);
+}
+
+void replicates_add(Replicates_t * self, const SingleMeasurement_t * measurement)
+{
+    runningStatistic_add(&self->dark, measurement->channel470.dark);
+    runningStatistic_add(&self->value, measurement->channel470.value);
+    runningStatistic_add(&self->delta, singleMeasurement_delta(measurement));
+    self->ledPower = measurement->channel470.ledPower;
+}
+
+SingleMeasurement_t replicates_mean(const Replicates_t * self)
+{
+    return singleMeasurement_init(channel_init(self->dark.mean, self->value.mean, self->ledPower));
+}
+
+SingleMeasurement_t replicates_sd(const Replicates_t * self)
+{
+    return singleMeasurement_init(channel_init(runningStatistic_sd(&self->dark), runningStatistic_sd(&self->value), self->ledPower));
+}
+
+static void replicatesPrintStatistic(const char * name, const RunningStatistic_t * statistic, FILE * stream)
+{
+    double cv = runningStatistic_cv(statistic);
+
+    // A mean of 0 with spread has no CV
+    if (isfinite(cv))
+    {
+        fprintf_s(stream, "%-9s%.03f %.03f %.02f%%\n", name, statistic->mean, runningStatistic_sd(statistic), 100 * cv);
+    }
+    else
+    {
+        fprintf_s(stream, "%-9s%.03f %.03f -\n", name, statistic->mean, runningStatistic_sd(statistic));
+    }
+}
+
+void replicates_print(const Replicates_t * self, FILE * stream)
+{
+    fprintf_s(stream, "%-9s%u\n", "count", self->dark.count);
+    fprintf_s(stream, "%-9s%u\n", DICT_LED_POWER, self->ledPower);
+    replicatesPrintStatistic(DICT_DARK, &self->dark, stream);
+    replicatesPrintStatistic(DICT_VALUE, &self->value, stream);
+    replicatesPrintStatistic(DICT_DELTA, &self->delta, stream);
+}
+
+static cJSON* replicatesStatisticToJson(const RunningStatistic_t * statistic)
+{
+    cJSON* obj = cJSON_CreateObject();
+    double cv = runningStatistic_cv(statistic);
+
+    cJSON_AddItemToObject(obj, DICT_MEAN, cJSON_CreateNumber(statistic->mean));
+    cJSON_AddItemToObject(obj, DICT_SD, cJSON_CreateNumber(runningStatistic_sd(statistic)));
+    // JSON has no infinity, a missing CV stands for a mean of 0 with spread
+    if (isfinite(cv))
+    {
+        cJSON_AddItemToObject(obj, DICT_CV, cJSON_CreateNumber(cv));
+    }
+    return obj;
+}
+
+cJSON* replicates_toJson(const Replicates_t * self)
+{
+    cJSON* obj = cJSON_CreateObject();
+    SingleMeasurement_t mean = replicates_mean(self);
+
+    cJSON_AddItemToObject(obj, DICT_COUNT, cJSON_CreateNumber(self->dark.count));
+    cJSON_AddItemToObject(obj, DICT_MEAN, singleMeasurement_toJson(&mean));
+    cJSON_AddItemToObject(obj, DICT_DARK, replicatesStatisticToJson(&self->dark));
+    cJSON_AddItemToObject(obj, DICT_VALUE, replicatesStatisticToJson(&self->value));
+    cJSON_AddItemToObject(obj, DICT_DELTA, replicatesStatisticToJson(&self->delta));
+    return obj;
+}
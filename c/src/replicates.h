@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: MIT
+// SPDX-FileCopyrightText: © 2024 HSE AG, <opensource@hseag.com>
+
+#pragma once
+
+#include "singlemeasurement.h"
+#include "cJSON.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(_WIN64) || defined(_WIN32)
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+/**
+ * @struct RunningStatistic_t
+ * @brief Mean and variance of a series, updated reading by reading (Welford).
+ *
+ * A zero-initialized structure is an empty series.
+ */
+typedef struct
+{
+    uint32_t count; /**< Number of readings. */
+    double mean;    /**< Mean of the readings. */
+    double m2;      /**< Sum of the squared deviations from the mean. */
+} RunningStatistic_t;
+
+/**
+ * @struct Replicates_t
+ * @brief Statistics of replicate readings of the same sample.
+ *
+ * A zero-initialized structure holds no readings.
+ */
+typedef struct
+{
+    RunningStatistic_t dark;  /**< Dark signal in millivolts (mV). */
+    RunningStatistic_t value; /**< Illuminated signal in millivolts (mV). */
+    RunningStatistic_t delta; /**< Illuminated minus dark signal of each reading. */
+    uint32_t ledPower;        /**< LED drive level of the last reading. */
+} Replicates_t;
+
+/**
+ * @brief Adds a reading to a series.
+ *
+ * @param self Pointer to the RunningStatistic_t structure.
+ * @param x The reading.
+ */
+DLLEXPORT void runningStatistic_add(RunningStatistic_t * self, double x);
+
+/**
+ * @brief Returns the sample standard deviation of a series.
+ *
+ * @param self Pointer to the RunningStatistic_t structure.
+ * @return The standard deviation, 0 for less than two readings.
+ */
+DLLEXPORT double runningStatistic_sd(const RunningStatistic_t * self);
+
+/**
+ * @brief Returns the coefficient of variation (standard deviation / |mean|) of a series.
+ *
+ * @param self Pointer to the RunningStatistic_t structure.
+ * @return The coefficient of variation as a fraction, HUGE_VAL for a mean of 0 with any spread.
+ */
+DLLEXPORT double runningStatistic_cv(const RunningStatistic_t * self);
+
+/**
+ * @brief Adds a reading to the replicates.
+ *
+ * @param self Pointer to the Replicates_t structure.
+ * @param measurement The reading.
+ */
+DLLEXPORT void replicates_add(Replicates_t * self, const SingleMeasurement_t * measurement);
+
+/**
+ * @brief Returns the means of dark and value with the LED power of the readings.
+ *
+ * @param self Pointer to the Replicates_t structure.
+ * @return The mean as a single measurement, e.g. for measurement_init().
+ */
+DLLEXPORT SingleMeasurement_t replicates_mean(const Replicates_t * self);
+
+/**
+ * @brief Returns the standard deviations of dark and value with the LED power of the readings.
+ *
+ * @param self Pointer to the Replicates_t structure.
+ * @return The standard deviations as a single measurement.
+ */
+DLLEXPORT SingleMeasurement_t replicates_sd(const Replicates_t * self);
+
+/**
+ * @brief Prints count, LED power and mean, standard deviation and CV of dark, value and delta.
+ *
+ * A CV which is not finite is printed as "-".
+ *
+ * @param self Pointer to the Replicates_t structure.
+ * @param stream Output file stream where the data will be printed.
+ */
+DLLEXPORT void replicates_print(const Replicates_t * self, FILE * stream);
+
+/**
+ * @brief Serializes the statistics into a newly allocated JSON object.
+ *
+ * The member "mean" has the layout of singleMeasurement_toJson(). The member
+ * "cv" of a statistic is left out if it is not finite, see runningStatistic_cv().
+ *
+ * @param self Pointer to the Replicates_t structure.
+ * @return A cJSON object owned by the caller.
+ */
+DLLEXPORT cJSON* replicates_toJson(const Replicates_t * self);